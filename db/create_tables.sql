@@ -2,23 +2,78 @@ drop table if exists sensor;
 
 create table sensor
 (
-    timestamp   datetime            not null,
+    -- When the reading was received, to the millisecond. sensord works
+    -- this out from when it read the receiver and the reading's age.
+    timestamp   datetime(3)         not null,
 
     -- Definitions for wireless sensor messages
     --
     --  uint8_t     id          Unique station ID
-    --  uint8_t     nvalues     Number of sensor readings
+    --  uint8_t     nvalues     Message version and number of sensor readings
     --
     --  nvalues * [
     --  uint8_t     type        Sensor type (WL_SENSOR_TYPE_*)
-    --  int16_t     value       Sensor value (little endian)
+    --  intN_t      value       Sensor value (little endian; up to 32 bits)
     --  ]
+    --
+    -- sensord also stores values derived from the readings, with sensor
+    -- types from 128 up (DERIVED_TYPE_* in rpi-tools/common/derived.h):
+    -- 128 sea level pressure, 129 dew point, 130 battery level (%)
 
     station     tinyint unsigned    not null,
     sensor      tinyint unsigned    not null,
-    value       smallint            not null,
+    value       int                 not null,
 
     index sensor_1 (timestamp, station, sensor),
-    index sensor_2 (timestamp, sensor, station)
+    index sensor_2 (timestamp, sensor, station),
+    index sensor_3 (station, sensor, timestamp)
+)
+engine=MyISAM default charset=utf8 collate=utf8_bin;
+
+drop table if exists receiver_diagnostics;
+
+create table receiver_diagnostics
+(
+    -- When sensord read the diagnostics. The receiver last reset uptime
+    -- seconds before this.
+    timestamp           datetime(3)         not null,
+
+    -- The cause of the receiver's last reset (its MCUSR): 1 power on,
+    -- 2 reset pin, 4 brown out, 8 watchdog
+    reset_cause         tinyint unsigned    not null,
+
+    -- Watchdog timeouts since the receiver was programmed
+    watchdog_timeouts   smallint unsigned   not null,
+
+    uptime              int unsigned        not null,
+
+    -- Since the last reset (and wrapping at 65536): radio frames ignored
+    -- because the last message hadn't been handled, frames with a bad
+    -- CRC, and messages dropped because the station table was full
+    overruns            smallint unsigned   not null,
+    errors              smallint unsigned   not null,
+    dropped             smallint unsigned   not null,
+
+    -- The least free SRAM since the last reset, in bytes
+    sram_free           smallint unsigned   not null,
+
+    index receiver_diagnostics_1 (timestamp)
+)
+engine=MyISAM default charset=utf8 collate=utf8_bin;
+
+drop table if exists sensor_quarantine;
+
+create table sensor_quarantine
+(
+    timestamp           datetime(3)         not null,
+    station             tinyint unsigned    not null,
+    sensor              tinyint unsigned    not null,
+
+    -- The reading, and the median of the sensor's recent readings it was
+    -- too far from
+    value               int                 not null,
+    median              int                 not null,
+
+    index sensor_quarantine_1 (timestamp, station, sensor)
 )
 engine=MyISAM default charset=utf8 collate=utf8_bin;
@@ -0,0 +1,33 @@
+-- Add the table sensord stores the receiver's diagnostics in (see
+-- create_tables.sql).
+--
+--  mysql -u root -p sensors < migrate-receiver-diagnostics.sql
+
+create table receiver_diagnostics
+(
+    -- When sensord read the diagnostics. The receiver last reset uptime
+    -- seconds before this.
+    timestamp           datetime(3)         not null,
+
+    -- The cause of the receiver's last reset (its MCUSR): 1 power on,
+    -- 2 reset pin, 4 brown out, 8 watchdog
+    reset_cause         tinyint unsigned    not null,
+
+    -- Watchdog timeouts since the receiver was programmed
+    watchdog_timeouts   smallint unsigned   not null,
+
+    uptime              int unsigned        not null,
+
+    -- Since the last reset (and wrapping at 65536): radio frames ignored
+    -- because the last message hadn't been handled, frames with a bad
+    -- CRC, and messages dropped because the station table was full
+    overruns            smallint unsigned   not null,
+    errors              smallint unsigned   not null,
+    dropped             smallint unsigned   not null,
+
+    -- The least free SRAM since the last reset, in bytes
+    sram_free           smallint unsigned   not null,
+
+    index receiver_diagnostics_1 (timestamp)
+)
+engine=MyISAM default charset=utf8 collate=utf8_bin;
@@ -0,0 +1,6 @@
+-- Index rows by station and sensor, for finding the next or latest row of
+-- a sensor (see sensor-runs.sql).
+--
+--  mysql -u root -p sensors < migrate-sensor-index.sql
+
+alter table sensor add index sensor_3 (station, sensor, timestamp);
@@ -0,0 +1,19 @@
+-- Add the table sensord stores readings it rejects as spikes in (see
+-- create_tables.sql).
+--
+--  mysql -u root -p sensors < migrate-sensor-quarantine.sql
+
+create table sensor_quarantine
+(
+    timestamp           datetime(3)         not null,
+    station             tinyint unsigned    not null,
+    sensor              tinyint unsigned    not null,
+
+    -- The reading, and the median of the sensor's recent readings it was
+    -- too far from
+    value               int                 not null,
+    median              int                 not null,
+
+    index sensor_quarantine_1 (timestamp, station, sensor)
+)
+engine=MyISAM default charset=utf8 collate=utf8_bin;
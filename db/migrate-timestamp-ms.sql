@@ -0,0 +1,7 @@
+-- Keep milliseconds in sensor.timestamp. sensord timestamps each reading
+-- itself, from when it read the receiver, rather than using the server's
+-- now(). Needs MySQL 5.6.4 or later; existing rows are unchanged.
+--
+--  mysql -u root -p sensors < migrate-timestamp-ms.sql
+
+alter table sensor modify timestamp datetime(3) not null;
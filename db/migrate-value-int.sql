@@ -0,0 +1,7 @@
+-- Widen sensor.value from smallint to int, for version 1 messages whose
+-- values are up to 32 bits wide (see include/wireless.h). Existing rows are
+-- unchanged.
+--
+--  mysql -u root -p sensors < migrate-value-int.sql
+
+alter table sensor modify value int not null;
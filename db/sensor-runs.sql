@@ -0,0 +1,82 @@
+-- Reading a sensor table stored with a heartbeat (sensord's "heartbeat"
+-- setting). sensord then only stores a reading when its value changes, or
+-- when the last row for the sensor is a heartbeat old, so each row stands
+-- for a run of the same value up to the next row for that sensor.
+--
+--  mysql -u root -p sensors < sensor-runs.sql
+--
+-- These look up rows by station and sensor; an existing table needs
+-- migrate-sensor-index.sql first.
+
+-- Each row, with the time the run ended (the next row for the sensor), or
+-- null for the latest row.
+
+create or replace view sensor_runs as
+select
+    s.station,
+    s.sensor,
+    s.value,
+    s.timestamp as run_start,
+    (
+        select min(n.timestamp)
+        from sensor n
+        where n.station = s.station
+        and n.sensor = s.sensor
+        and n.timestamp > s.timestamp
+    ) as run_end
+from sensor s;
+
+-- A regular series from the runs: the value of a sensor every p_step
+-- seconds from p_from to p_to, from the latest row at or before each time.
+-- The value is null where that row is more than p_max_age seconds old
+-- (the station had stopped); give the heartbeat plus the time between a
+-- station's messages.
+--
+--  call sensor_series(21, 1, '2016-03-13 00:00', '2016-03-14 00:00', 300, 1000);
+
+drop procedure if exists sensor_series;
+
+delimiter //
+
+create procedure sensor_series
+(
+    in p_station    tinyint unsigned,
+    in p_sensor     tinyint unsigned,
+    in p_from       datetime(3),
+    in p_to         datetime(3),
+    in p_step       int,
+    in p_max_age    int
+)
+begin
+    declare t datetime(3) default p_from;
+
+    drop temporary table if exists sensor_series_times;
+    create temporary table sensor_series_times
+    (
+        timestamp   datetime(3)     not null primary key
+    );
+
+    while t <= p_to do
+        insert into sensor_series_times values (t);
+        set t = t + interval p_step second;
+    end while;
+
+    select
+        t.timestamp,
+        (
+            select s.value
+            from sensor s
+            where s.station = p_station
+            and s.sensor = p_sensor
+            and s.timestamp <= t.timestamp
+            and s.timestamp > t.timestamp - interval p_max_age second
+            order by s.timestamp desc
+            limit 1
+        ) as value
+    from sensor_series_times t
+    order by t.timestamp;
+
+    drop temporary table sensor_series_times;
+end//
+
+delimiter ;
@@ -1,33 +1,83 @@
 #ifndef __INCLUDE_WIRELESS_H
 #define __INCLUDE_WIRELESS_H
 
+#include <stdint.h>
+
 /*
  * Definitions for wireless sensor messages
  *
  *  uint8_t     id          Unique station ID
- *  uint8_t     nvalues     Number of sensor readings
+ *  uint8_t     nvalues     Message version (upper 4 bits) and number of
+ *                          sensor readings (lower 4 bits)
  *
  *  nvalues * [
  *  uint8_t     type        Sensor type (WL_SENSOR_TYPE_*)
- *  int16_t     value       Sensor value (little endian)
+ *  intN_t      value       Sensor value (little endian)
  *  ]
+ *
+ * In a version 0 message every value is an int16_t. In a version 1 message
+ * each value takes the width given for its type by WL_SENSOR_TYPE_WIDTH().
+ * Version 0 stations never set the upper bits of nvalues, so both can be
+ * told apart.
  */
 
 /*
- * Maximum number of sensor values in a message
+ * Frame sync bytes. The sync byte follows the preamble, and selects how the
+ * message carried in the rest of the frame is encoded:
+ *
+ *  WL_SYNC_FLAG_COMPACT    the message is a compact message
+ *  WL_SYNC_FLAG_FEC        the rest of the frame is FEC-coded
+ *                          (see wireless_fec.h)
  */
-#define WL_SENSOR_MAX_VALUES            3
+#define WL_SYNC_BASE                    0xc4
+#define WL_SYNC_FLAG_COMPACT            0x01
+#define WL_SYNC_FLAG_FEC                0x02
+#define WL_SYNC_FLAGS                   (WL_SYNC_FLAG_COMPACT | WL_SYNC_FLAG_FEC)
+
+#define WL_SYNC_STANDARD                (WL_SYNC_BASE)
+#define WL_SYNC_COMPACT                 (WL_SYNC_BASE | WL_SYNC_FLAG_COMPACT)
+
+#define WL_SYNC_VALID(SYNC)             \
+    (((SYNC) & ~WL_SYNC_FLAGS) == WL_SYNC_BASE)
 
 /*
- * Message component sizes
+ * A station that hasn't been heard from for this many seconds is regarded
+ * as dead. Stations that only report on change must still send a heartbeat
+ * well inside this, so that losing one heartbeat doesn't trip it.
+ */
+#define WL_STATION_DEAD_THRESHOLD       600
+
+/*
+ * Maximum number of sensor values in a message (including the counter).
+ * This sizes the receiver's per-station buffers, so it's kept small.
+ */
+#define WL_SENSOR_MAX_VALUES            5
+
+/*
+ * Message versions
+ */
+#define WL_SENSOR_MSG_VERSION_0         0
+#define WL_SENSOR_MSG_VERSION_1         1
+
+/*
+ * Message component sizes. WL_SENSOR_MSG_VALUE_LEN and WL_SENSOR_MSG_SIZE()
+ * are for version 0 messages.
  */
 #define WL_SENSOR_MSG_HDR_LEN           2
 #define WL_SENSOR_MSG_VALUE_LEN         3
 #define WL_SENSOR_MSG_SIZE(NVALUES) \
     (WL_SENSOR_MSG_HDR_LEN + (NVALUES) * WL_SENSOR_MSG_VALUE_LEN)
 
-#define WL_SENSOR_MSG_MAX_SIZE      \
-    WL_SENSOR_MSG_SIZE(WL_SENSOR_MAX_VALUES) \
+/*
+ * The largest version 1 message: the counter, two 4-byte values (pressure
+ * and light) and the rest 2-byte values. This is larger than the largest
+ * version 0 message.
+ */
+#define WL_SENSOR_VALUE_MAX_WIDTH       4
+
+#define WL_SENSOR_MSG_MAX_SIZE          \
+    (WL_SENSOR_MSG_HDR_LEN + WL_SENSOR_MAX_VALUES \
+        + 2 * WL_SENSOR_VALUE_MAX_WIDTH + (WL_SENSOR_MAX_VALUES - 2) * 2)
 
 /*
  * Standard sensor types
@@ -42,6 +92,35 @@
 
 #define WL_SENSOR_TYPE_MAX              6
 
+/*
+ * The width (in bytes) of each sensor type's value in a version 1 message,
+ * and the divisor that converts a value to its units:
+ *
+ *  Type            Width   Scale   Units
+ *  TEMPERATURE     2       10      degrees C
+ *  PRESSURE        4       10      hPa
+ *  COUNTER         2       1
+ *  LIGHT           4       1       sensor dependent
+ *  HUMIDITY        2       10      %RH
+ *  BATTERY         2       10      V
+ *
+ * Any other type is 2 bytes wide, with a scale of 1.
+ */
+#define WL_SENSOR_TYPE_WIDTH(TYPE)      \
+    ((TYPE) == WL_SENSOR_TYPE_PRESSURE || (TYPE) == WL_SENSOR_TYPE_LIGHT ? 4 : 2)
+
+#define WL_SENSOR_TYPE_SCALE(TYPE)      \
+    ((TYPE) == WL_SENSOR_TYPE_TEMPERATURE || (TYPE) == WL_SENSOR_TYPE_PRESSURE \
+     || (TYPE) == WL_SENSOR_TYPE_HUMIDITY || (TYPE) == WL_SENSOR_TYPE_BATTERY \
+     ? 10 : 1)
+
+/*
+ * The COUNTER value is 15 bits: stations count their messages from 0 and
+ * wrap from WL_COUNTER_MASK back to 0. A station also starts again from 0
+ * when it resets.
+ */
+#define WL_COUNTER_MASK                 0x7fff
+
 /*
  * Macros to access message components
  */
@@ -51,11 +130,234 @@
 #define WL_SENSOR_MSG_NUM_VALUES(MSG)   \
     *(uint8_t *)((MSG) + 1)
 
+#define WL_SENSOR_MSG_VERSION(MSG)      \
+    (WL_SENSOR_MSG_NUM_VALUES(MSG) >> 4)
+
+#define WL_SENSOR_MSG_COUNT(MSG)        \
+    (WL_SENSOR_MSG_NUM_VALUES(MSG) & 0x0f)
+
+#define WL_SENSOR_MSG_NVALUES(VERSION, COUNT) \
+    (((VERSION) << 4) | (COUNT))
+
+/*
+ * These only apply to version 0 messages; use wl_sensor_get_value() to walk
+ * a message of either version.
+ */
 #define WL_SENSOR_MSG_TYPE(MSG, N)      \
     *(uint8_t *)((MSG) + WL_SENSOR_MSG_HDR_LEN + (N) * WL_SENSOR_MSG_VALUE_LEN)
 
 #define WL_SENSOR_MSG_VALUE(MSG, N)     \
     *(int16_t *)((MSG) + WL_SENSOR_MSG_HDR_LEN + (N) * WL_SENSOR_MSG_VALUE_LEN + 1)
-            
+
+/*
+ * Compact messages (sent with WL_SYNC_COMPACT), version 1
+ *
+ *  uint8_t     id          Unique station ID
+ *  uint8_t     mask        Sensor types present, plus WL_COMPACT_FLAG_*
+ *  uint8_t     seq         Low 8 bits of the message sequence number
+ *
+ *  for each type in mask, in ascending order, except COUNTER [
+ *  varint      value       Zigzag-encoded sensor value, 7 bits per byte,
+ *                          least significant group first
+ *  ]
+ *
+ * Values have the range of their type's WL_SENSOR_TYPE_WIDTH().
+ *
+ * Bit (type - 1) of the mask is set if a value of that type is present. The
+ * sequence number is carried in the seq byte, and the receiver extends it
+ * back to a full counter value.
+ *
+ * The temperature is sent as an absolute value in a key frame (every
+ * WL_COMPACT_KEYFRAME_INTERVAL messages, when the low bits of the sequence
+ * number are zero), and otherwise as a delta from the most recent key frame
+ * with WL_COMPACT_FLAG_DELTA set. A lost delta frame therefore costs only
+ * that reading; a lost key frame costs the readings up to the next one.
+ */
+#define WL_COMPACT_MSG_HDR_LEN          3
+#define WL_COMPACT_VALUE_MAX_LEN        3   /* for a 2-byte type */
+#define WL_COMPACT_VALUE32_MAX_LEN      5   /* for a 4-byte type */
+
+#define WL_COMPACT_MSG_MAX_SIZE         \
+    (WL_COMPACT_MSG_HDR_LEN + 2 * WL_COMPACT_VALUE32_MAX_LEN \
+        + (WL_SENSOR_MAX_VALUES - 3) * WL_COMPACT_VALUE_MAX_LEN)
+
+#define WL_COMPACT_TYPE_BIT(TYPE)       (1 << ((TYPE) - 1))
+#define WL_COMPACT_TYPE_MASK            0x3f
+#define WL_COMPACT_FLAG_DELTA           0x40
+
+#define WL_COMPACT_KEYFRAME_INTERVAL    8   /* must be a power of 2 */
+
+#define WL_COMPACT_MSG_STATION_ID(MSG)  \
+    *(uint8_t *)((MSG))
+
+#define WL_COMPACT_MSG_MASK(MSG)        \
+    *(uint8_t *)((MSG) + 1)
+
+#define WL_COMPACT_MSG_SEQ(MSG)         \
+    *(uint8_t *)((MSG) + 2)
+
+/*
+ * The largest message that can be carried in a frame, in any encoding
+ */
+#define WL_FRAME_MSG_MAX_SIZE           \
+    (WL_SENSOR_MSG_MAX_SIZE > WL_COMPACT_MSG_MAX_SIZE ? \
+        WL_SENSOR_MSG_MAX_SIZE : WL_COMPACT_MSG_MAX_SIZE)
+
+/*
+ * Return the size of a message of either version, given its header.
+ */
+static inline uint8_t
+wl_sensor_msg_size(const uint8_t *msg)
+{
+    uint8_t     n   = WL_SENSOR_MSG_HDR_LEN;
+    uint8_t     i;
+
+    if (WL_SENSOR_MSG_VERSION(msg) == WL_SENSOR_MSG_VERSION_0)
+        return WL_SENSOR_MSG_SIZE(WL_SENSOR_MSG_COUNT(msg));
+
+    for (i = 0; i < WL_SENSOR_MSG_COUNT(msg); i++)
+        n += 1 + WL_SENSOR_TYPE_WIDTH(msg[n]);
+
+    return n;
+}
+
+/*
+ * Append a type and value to a version 1 message. The value is truncated
+ * to the width of its type.
+ *
+ * Returns a pointer to the byte following the value.
+ */
+static inline uint8_t *
+wl_sensor_put_value(uint8_t *p, uint8_t type, int32_t value)
+{
+    uint8_t     width   = WL_SENSOR_TYPE_WIDTH(type);
+
+    *p++ = type;
+
+    while (width-- != 0)
+    {
+        *p++ = (uint8_t)value;
+        value >>= 8;
+    }
+
+    return p;
+}
+
+/*
+ * Extract a type and value from a message of the given version, reading no
+ * further than end.
+ *
+ * Returns a pointer to the byte following the value, or NULL if the value
+ * is truncated.
+ */
+static inline const uint8_t *
+wl_sensor_get_value
+(
+    const uint8_t   *p,
+    const uint8_t   *end,
+    uint8_t         version,
+    uint8_t         *type,
+    int32_t         *value
+)
+{
+    uint32_t    v       = 0;
+    uint8_t     width;
+    uint8_t     i;
+
+    if (p >= end)
+        return (const uint8_t *)0;
+
+    *type = *p++;
+
+    if (version == WL_SENSOR_MSG_VERSION_0)
+        width = 2;
+    else
+        width = WL_SENSOR_TYPE_WIDTH(*type);
+
+    if (end - p < width)
+        return (const uint8_t *)0;
+
+    for (i = 0; i < width; i++)
+        v |= (uint32_t)p[i] << (8 * i);
+
+    /*
+     * Sign-extend narrower values
+     */
+    if (width < 4 && (v & ((uint32_t)0x80 << (8 * (width - 1)))) != 0)
+        v |= (uint32_t)0xffffffff << (8 * width);
+
+    *value = (int32_t)v;
+
+    return p + width;
+}
+
+/*
+ * Append a value to a compact message.
+ *
+ * Returns a pointer to the byte following the encoded value.
+ */
+static inline uint8_t *
+wl_compact_put_value(uint8_t *p, int16_t value)
+{
+    uint16_t    z   = ((uint16_t)value << 1) ^ (uint16_t)(value >> 15);
+
+    while (z >= 0x80)
+    {
+        *p++ = (uint8_t)z | 0x80;
+        z >>= 7;
+    }
+    *p++ = (uint8_t)z;
+
+    return p;
+}
+
+/*
+ * Append a value of a 4-byte type to a compact message.
+ *
+ * Returns a pointer to the byte following the encoded value.
+ */
+static inline uint8_t *
+wl_compact_put_value32(uint8_t *p, int32_t value)
+{
+    uint32_t    z   = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+
+    while (z >= 0x80)
+    {
+        *p++ = (uint8_t)z | 0x80;
+        z >>= 7;
+    }
+    *p++ = (uint8_t)z;
+
+    return p;
+}
+
+/*
+ * Extract a value from a compact message, reading no further than end.
+ *
+ * Returns a pointer to the byte following the encoded value, or NULL if the
+ * value is truncated or malformed.
+ */
+static inline const uint8_t *
+wl_compact_get_value(const uint8_t *p, const uint8_t *end, int32_t *value)
+{
+    uint32_t    z       = 0;
+    uint8_t     shift   = 0;
+    uint8_t     b;
+
+    do
+    {
+        if (p >= end || shift > 28)
+            return (const uint8_t *)0;
+
+        b = *p++;
+        z |= (uint32_t)(b & 0x7f) << shift;
+        shift += 7;
+    }
+    while (b & 0x80);
+
+    *value = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+
+    return p;
+}
 
 #endif /* __INCLUDE_WIRELESS_H */
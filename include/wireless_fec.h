@@ -0,0 +1,90 @@
+#ifndef __INCLUDE_WIRELESS_FEC_H
+#define __INCLUDE_WIRELESS_FEC_H
+
+#include <stdint.h>
+
+/*
+ * Forward error correction for frames sent with WL_SYNC_FLAG_FEC.
+ *
+ * Every byte after the sync byte (length, message and CRC) is sent as two
+ * extended Hamming(8,4) codewords, low nibble first. Each codeword corrects
+ * any single bit error and detects any double bit error, so a frame
+ * survives one bad bit in every 8 sent. The CRC is still checked after
+ * decoding.
+ *
+ * Codeword layout:
+ *
+ *  bit     0   1   2   3   4   5   6   7
+ *          d0  d1  d2  d3  p0  p1  p2  p3
+ *
+ *  p0 = d0 ^ d1 ^ d3
+ *  p1 = d0 ^ d2 ^ d3
+ *  p2 = d1 ^ d2 ^ d3
+ *  p3 = even parity over bits 0-6
+ *
+ * Everything is computed rather than looked up, so this costs no RAM or
+ * flash tables on the AVRs.
+ */
+
+#define WL_FEC_ERROR                    0xff
+
+static inline uint8_t
+wl_fec_parity(uint8_t x)
+{
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+
+    return x & 1;
+}
+
+/*
+ * Encode the low 4 bits of d as a codeword.
+ */
+static inline uint8_t
+wl_fec_encode(uint8_t d)
+{
+    uint8_t     c;
+
+    c = d & 0x0f;
+    c |= wl_fec_parity(c & 0x0b) << 4;
+    c |= wl_fec_parity(c & 0x0d) << 5;
+    c |= wl_fec_parity(c & 0x0e) << 6;
+    c |= wl_fec_parity(c) << 7;
+
+    return c;
+}
+
+/*
+ * Decode a codeword, correcting a single bit error.
+ *
+ * Returns the 4 data bits, or WL_FEC_ERROR if there is more than one error.
+ */
+static inline uint8_t
+wl_fec_decode(uint8_t c)
+{
+    uint8_t     s;
+
+    /*
+     * The syndrome says which parity checks failed. A single error in a
+     * data bit fails 2 or 3 checks, and in a parity bit only that one.
+     */
+    s = wl_fec_parity(c & 0x1b)
+        | wl_fec_parity(c & 0x2d) << 1
+        | wl_fec_parity(c & 0x4e) << 2;
+
+    if (wl_fec_parity(c) == 0)
+        return s == 0 ? (c & 0x0f) : WL_FEC_ERROR;
+
+    switch (s)
+    {
+    case 3:     c ^= 0x01;  break;
+    case 5:     c ^= 0x02;  break;
+    case 6:     c ^= 0x04;  break;
+    case 7:     c ^= 0x08;  break;
+    }
+
+    return c & 0x0f;
+}
+
+#endif /* __INCLUDE_WIRELESS_FEC_H */
@@ -0,0 +1,103 @@
+#ifndef __INCLUDE_WIRELESS_TIMING_H
+#define __INCLUDE_WIRELESS_TIMING_H
+
+/*
+ * Line timing shared by the transmitter (sensor-t) and the receiver
+ * (rpi-receiver).
+ *
+ * WL_BAUD is the line rate in half-bits per second. Manchester coding sends
+ * each bit as two half-bits, so the data rate is half of this. Change it
+ * here (or with -DWL_BAUD=...) and rebuild both firmwares.
+ *
+ * The timer settings are worked out from F_CPU, so they are only defined
+ * when building firmware. The build fails if a setting can't be reached
+ * accurately enough, or if the receiver can't keep up. The supported
+ * settings are:
+ *
+ *  WL_BAUD     sensor-t, sensor-m      rpi-receiver
+ *              (3.6864MHz)             (10MHz)     (20MHz)
+ *  4800        yes                     yes         yes
+ *  9600        yes                     no          yes
+ *  19200       yes                     no          no
+ *
+ * The receiver's "no"s fail its build: the sample period would be shorter
+ * than the sampling interrupt. "make check" in sensor-t/sim checks each
+ * pair on the host, and runs the receiver's decoder at the ones it
+ * supports.
+ */
+#ifndef WL_BAUD
+#define WL_BAUD                         4800
+#endif
+
+#if WL_BAUD != 4800 && WL_BAUD != 9600 && WL_BAUD != 19200
+#error "WL_BAUD must be 4800, 9600 or 19200"
+#endif
+
+/*
+ * Timing errors are checked against this, in parts per thousand. The
+ * receiver re-locks on every bit, so it tolerates far more than this; the
+ * limit is there to catch a bad F_CPU/WL_BAUD combination.
+ */
+#define WL_BAUD_MAX_ERROR_PPT           10
+
+#define WL_BAUD_ERROR_PPT(ACTUAL)       \
+    (((ACTUAL) > WL_BAUD ? (ACTUAL) - WL_BAUD : WL_BAUD - (ACTUAL)) * 1000 / WL_BAUD)
+
+/*
+ * The receiver samples 16 times per bit, i.e. 8 times per half-bit.
+ */
+#define WL_RX_SAMPLES_PER_HALF_BIT      8
+#define WL_RX_SAMPLE_RATE               (WL_RX_SAMPLES_PER_HALF_BIT * WL_BAUD)
+
+/*
+ * An estimate of the worst-case length of the receiver's sampling interrupt,
+ * in CPU cycles, including entry and exit. The sample period has to be
+ * longer than this.
+ *
+ * It has not been counted from the compiled code. To check it, take the
+ * longest path through TIMER1_COMPA_vect in "avr-objdump -d wireless.o"
+ * (a sample that ends the last message byte: the transition search, the
+ * CRC update and the state changes), or time the handler on a scope with
+ * the PA7 DEBUG lines in wireless.c. Whether the decoder keeps lock at
+ * each supported WL_BAUD is checked by sensor-t/sim/rxtest.c.
+ */
+#define WL_RX_ISR_CYCLES                200
+
+#ifdef F_CPU
+
+/*
+ * Transmitter: an 8-bit timer in CTC mode interrupts once per half-bit.
+ * Use the smallest prescaler that lets the compare value fit in 8 bits.
+ */
+#if F_CPU / WL_BAUD <= 256
+#define WL_TX_PRESCALE                  1
+#elif F_CPU / (8 * WL_BAUD) <= 256
+#define WL_TX_PRESCALE                  8
+#elif F_CPU / (64 * WL_BAUD) <= 256
+#define WL_TX_PRESCALE                  64
+#else
+#define WL_TX_PRESCALE                  0
+#endif
+
+#if WL_TX_PRESCALE != 0
+
+#define WL_TX_TIMER_TOP                 \
+    ((F_CPU + WL_TX_PRESCALE * WL_BAUD / 2) / (WL_TX_PRESCALE * WL_BAUD) - 1)
+
+#define WL_TX_BAUD_ACTUAL               \
+    (F_CPU / (WL_TX_PRESCALE * (WL_TX_TIMER_TOP + 1)))
+
+#endif
+
+/*
+ * Receiver: a 16-bit timer with no prescaler interrupts once per sample.
+ */
+#define WL_RX_TIMER_TOP                 \
+    ((F_CPU + WL_RX_SAMPLE_RATE / 2) / WL_RX_SAMPLE_RATE - 1)
+
+#define WL_RX_BAUD_ACTUAL               \
+    (F_CPU / (WL_RX_TIMER_TOP + 1) / WL_RX_SAMPLES_PER_HALF_BIT)
+
+#endif /* F_CPU */
+
+#endif /* __INCLUDE_WIRELESS_TIMING_H */
@@ -9,22 +9,20 @@
 #include "common.h"
 
 /*
- * A 1-second counter.
+ * A free-running tick counter.
  * 
  * We need to use Timer0 (8-bit) as Timer1 is used in the radio receiver.
- * The maximum we can count up to is 1024 * 256 (prescaler + max count),
- * so we need to increment the seconds counter every 38 interrupts.
+ * Timer0 runs from the /1024 prescaler, and the clock is the count of its
+ * overflows with the timer's own count as the low 8 bits, so one tick is
+ * 1024 CPU cycles. The clock wraps after 2^32 ticks
+ * (about 5 days at 10MHz), so differences between clock values are fine
+ * as long as they're less than that.
  */
-static volatile clock_time_t    clock_1sec;
-static volatile uint8_t         clock_tick_ctr;
+static volatile clock_time_t    clock_overflows;
 
 ISR(TIMER0_OVF_vect)
 {
-    if (++clock_tick_ctr == 38)
-    {
-        clock_tick_ctr = 0;
-        clock_1sec++;
-    }
+    clock_overflows++;
 }
 
 void
@@ -51,8 +49,7 @@ clock_init(void)
      */
     sbi(TIMSK0, TOIE0);
 
-    clock_1sec = 0;
-    clock_tick_ctr = 0;
+    clock_overflows = 0;
 
     /*
      * Enable Timer0
@@ -60,6 +57,26 @@ clock_init(void)
     cbi(PRR, PRTIM0);
 }
 
+/*
+ * Get the current clock value, but don't lock. Used if we know interrupts are
+ * disabled.
+ */
+clock_time_t clock_time_unlocked(void)
+{
+    clock_time_t    overflows   = clock_overflows;
+    uint8_t         count       = TCNT0;
+
+    /*
+     * If the timer has overflowed but the interrupt hasn't been taken yet,
+     * count the overflow here. A small count means it overflowed before we
+     * read it.
+     */
+    if ((TIFR0 & (1 << TOV0)) && count < 128)
+        overflows++;
+
+    return (overflows << 8) | count;
+}
+
 /*
  * Get the current clock value
  */
@@ -68,17 +85,8 @@ clock_time_t clock_time(void)
     clock_time_t t;
 
     cli();
-    t = clock_1sec;
+    t = clock_time_unlocked();
     sei();
 
     return t;
 }
-
-/*
- * Get the current clock value, but don't lock. Used if we know interrupts are
- * disabled.
- */
-clock_time_t clock_time_unlocked(void)
-{
-    return clock_1sec;
-}
@@ -3,10 +3,17 @@
 
 #include <stdint.h>
 
-typedef uint16_t        clock_time_t;
+/*
+ * Clock ticks are 1024 CPU cycles (102.4us at 10MHz); see clock.c
+ */
+typedef uint32_t        clock_time_t;
 
 extern volatile uint8_t msg_pending;
 extern volatile uint8_t msg_error;
+extern volatile uint8_t msg_sync;
+extern volatile uint8_t msg_length;
+extern volatile uint16_t msg_overruns;
+extern volatile uint16_t msg_errors;
 extern char             msg_buffer[];
 
 extern void             wireless_init
@@ -17,6 +24,8 @@ extern void             wireless_init
                             uint8_t pin
                         );
 
+extern uint8_t          wireless_fec_decode(void);
+
 extern void             clock_init(void);
 extern clock_time_t     clock_time(void);
 extern clock_time_t     clock_time_unlocked(void);
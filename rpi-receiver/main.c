@@ -24,25 +24,202 @@
 
 #define MAX_STATIONS    8
 
-#define TX_BUFFER_SIZE  (3 + MAX_STATIONS * (WL_SENSOR_MSG_MAX_SIZE + 2))
-
-static uint8_t              tx_buffer[TX_BUFFER_SIZE];
-static uint8_t              *tx_eom;
-static uint8_t              *tx_ptr;
-
+/*
+ * Each station's latest message is kept as a version 1 message, whatever
+ * encoding it arrived in.
+ */
 typedef struct
 {
     uint8_t         msg[WL_SENSOR_MSG_MAX_SIZE];
     clock_time_t    timestamp;
+
+    /* the last compact key frame, used to resolve temperature deltas */
+    int16_t         key_temperature;
+    uint8_t         key_seq;
+    uint8_t         key_valid;
 }
     station_info_t;
 
 static station_info_t   stations[MAX_STATIONS];
 
+/*
+ * Find the last counter value held for a station.
+ *
+ * Returns non-zero if there is one.
+ */
+static uint8_t
+station_counter(const station_info_t *st, int32_t *counter)
+{
+    const uint8_t   *p      = st->msg + WL_SENSOR_MSG_HDR_LEN;
+    const uint8_t   *end    = st->msg + sizeof(st->msg);
+    uint8_t         type;
+    uint8_t         i;
+
+    for (i = 0; i < WL_SENSOR_MSG_COUNT(st->msg); i++)
+    {
+        if ((p = wl_sensor_get_value(p, end, WL_SENSOR_MSG_VERSION_1, &type, counter)) == 0)
+            return 0;
+
+        if (type == WL_SENSOR_TYPE_COUNTER)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Store a standard message of either version in the station's slot.
+ * A malformed message leaves the slot untouched.
+ */
+static void
+store_standard(station_info_t *st, const uint8_t *msg, uint8_t length)
+{
+    uint8_t         record[WL_SENSOR_MSG_MAX_SIZE];
+    const uint8_t   *p;
+    const uint8_t   *end        = msg + length;
+    uint8_t         *q          = record + WL_SENSOR_MSG_HDR_LEN;
+    uint8_t         version     = WL_SENSOR_MSG_VERSION(msg);
+    uint8_t         nvalues     = WL_SENSOR_MSG_COUNT(msg);
+    uint8_t         type;
+    int32_t         value;
+    uint8_t         i;
+
+    if
+    (
+        length < WL_SENSOR_MSG_HDR_LEN
+        ||
+        version > WL_SENSOR_MSG_VERSION_1
+        ||
+        nvalues > WL_SENSOR_MAX_VALUES
+    )
+        return;
+
+    p = msg + WL_SENSOR_MSG_HDR_LEN;
+
+    for (i = 0; i < nvalues; i++)
+    {
+        if ((p = wl_sensor_get_value(p, end, version, &type, &value)) == 0)
+            return;
+
+        q = wl_sensor_put_value(q, type, value);
+    }
+
+    WL_SENSOR_MSG_STATION_ID(record) = WL_SENSOR_MSG_STATION_ID(msg);
+    WL_SENSOR_MSG_NUM_VALUES(record) =
+        WL_SENSOR_MSG_NVALUES(WL_SENSOR_MSG_VERSION_1, nvalues);
+
+    memcpy(st->msg, record, q - record);
+
+    /*
+     * A station sending standard messages has no compact key frame
+     */
+    st->key_valid = 0;
+}
+
+/*
+ * Expand a compact message into the standard message format, and store it
+ * in the station's slot.
+ *
+ * The 8-bit sequence number is extended using the last counter value we had
+ * from the station. A temperature delta is only applied if we hold the key
+ * frame it refers to; otherwise the temperature is left out of the record.
+ * A malformed message leaves the slot untouched.
+ */
+static void
+expand_compact(station_info_t *st, const uint8_t *msg, uint8_t length)
+{
+    uint8_t         record[WL_SENSOR_MSG_MAX_SIZE];
+    const uint8_t   *p;
+    const uint8_t   *end        = msg + length;
+    uint8_t         *q          = record + WL_SENSOR_MSG_HDR_LEN;
+    uint8_t         id          = WL_COMPACT_MSG_STATION_ID(msg);
+    uint8_t         mask        = WL_COMPACT_MSG_MASK(msg);
+    uint8_t         seq         = WL_COMPACT_MSG_SEQ(msg);
+    uint8_t         nvalues     = 0;
+    uint8_t         key_seq     = st->key_seq;
+    uint8_t         key_valid   = st->key_valid;
+    int16_t         key_temperature = st->key_temperature;
+    int32_t         counter     = seq;
+    int32_t         value;
+    uint8_t         type;
+
+    if (length < WL_COMPACT_MSG_HDR_LEN)
+        return;
+
+    /*
+     * Extend the sequence number from the previous counter value
+     */
+    if (WL_SENSOR_MSG_STATION_ID(st->msg) == id)
+    {
+        if (station_counter(st, &value))
+            counter = (value + (uint8_t)(seq - (uint8_t)value)) & 0x7fff;
+    }
+    else
+        key_valid = 0;
+
+    p = msg + WL_COMPACT_MSG_HDR_LEN;
+
+    for (type = 1; type <= WL_SENSOR_TYPE_MAX; type++)
+    {
+        if ((mask & WL_COMPACT_TYPE_BIT(type)) == 0)
+            continue;
+
+        if (type == WL_SENSOR_TYPE_COUNTER)
+            value = counter;
+        else
+        if ((p = wl_compact_get_value(p, end, &value)) == 0)
+            return;
+
+        if (type == WL_SENSOR_TYPE_TEMPERATURE)
+        {
+            if (mask & WL_COMPACT_FLAG_DELTA)
+            {
+                if
+                (
+                    !key_valid
+                    ||
+                    (uint8_t)(seq - key_seq) >= WL_COMPACT_KEYFRAME_INTERVAL
+                )
+                    continue;
+
+                value += key_temperature;
+            }
+            else
+            {
+                key_temperature = value;
+                key_seq = seq;
+                key_valid = 1;
+            }
+        }
+
+        if (nvalues < WL_SENSOR_MAX_VALUES)
+        {
+            q = wl_sensor_put_value(q, type, value);
+            nvalues++;
+        }
+    }
+
+    WL_SENSOR_MSG_STATION_ID(record) = id;
+    WL_SENSOR_MSG_NUM_VALUES(record) =
+        WL_SENSOR_MSG_NVALUES(WL_SENSOR_MSG_VERSION_1, nvalues);
+
+    memcpy(st->msg, record, q - record);
+
+    st->key_temperature = key_temperature;
+    st->key_seq = key_seq;
+    st->key_valid = key_valid;
+}
+
 /***************************************************************************
  * Watchdog management
  ***************************************************************************/
 
+/*
+ * The number of watchdog timeouts, kept in EEPROM so that it survives the
+ * resets they cause (an erased EEPROM reads as 0xffff)
+ */
+#define WATCHDOG_COUNT_ADDR     ((uint16_t *)0)
+
 static volatile uint16_t    watchdog_timeouts;
 
 static uint8_t mcusr_saved \
@@ -64,6 +241,108 @@ void watchdog_init(void)
     wdt_disable();
 }
 
+/*
+ * Read the count of watchdog timeouts so far.
+ */
+static uint16_t
+watchdog_count(void)
+{
+    uint16_t    timeouts    = eeprom_read_word(WATCHDOG_COUNT_ADDR);
+
+    return timeouts == 0xffff ? 0 : timeouts;
+}
+
+/***************************************************************************
+ * Diagnostics
+ ***************************************************************************/
+
+/*
+ * Free SRAM is measured by filling it with a pattern before main() runs,
+ * and seeing how far down the stack has written over it since. The
+ * pattern isn't any of the protocol's constants (sync bytes, snapshot
+ * types), which often turn up on the stack.
+ */
+#define SRAM_PAINT              0x5a
+
+#define TICKS_PER_SECOND        (F_CPU / 1024)
+
+extern uint8_t              __heap_start;
+
+static uint16_t             sram_free;          /* lowest since reset, in bytes */
+static uint32_t             uptime;             /* seconds since reset */
+static clock_time_t         uptime_mark;
+static uint16_t             msg_dropped;        /* no free slot in stations[] */
+
+void
+sram_paint(void) \
+    __attribute__((naked)) \
+    __attribute__((section(".init3")));
+
+/*
+ * Paint the SRAM between the end of the data and the top of the stack.
+ * This is called before main(), with nothing on the stack yet.
+ */
+void sram_paint(void)
+{
+    uint8_t     *p;
+
+    for (p = &__heap_start; p <= (uint8_t *)RAMEND; p++)
+        *p = SRAM_PAINT;
+}
+
+/*
+ * Bring the free SRAM down to the lowest byte the stack has reached. The
+ * paint is counted up from the bottom, since the stack can hold bytes
+ * that happen to match it; only the paint left last time can still be
+ * untouched, so the count stops there.
+ */
+static void
+sram_check(void)
+{
+    uint16_t    n   = 0;
+
+    while (n < sram_free && (&__heap_start)[n] == SRAM_PAINT)
+        n++;
+
+    if (n != sram_free)
+    {
+        cli();
+        sram_free = n;
+        sei();
+    }
+}
+
+/*
+ * Count the seconds since reset, from the clock (which wraps too soon to
+ * give the uptime itself). TICKS_PER_SECOND is rounded down, so this runs
+ * fast by less than 0.01%.
+ */
+static void
+uptime_update(void)
+{
+    clock_time_t    now     = clock_time();
+
+    while (now - uptime_mark >= TICKS_PER_SECOND)
+    {
+        uptime_mark += TICKS_PER_SECOND;
+
+        cli();
+        uptime++;
+        sei();
+    }
+}
+
+/*
+ * Count a message dropped for want of a slot in stations[].
+ */
+static void
+count_dropped(void)
+{
+    cli();
+    msg_dropped++;
+    sei();
+}
+
 /***************************************************************************
  * Interrupt handlers
  ***************************************************************************/
@@ -72,102 +351,301 @@ ISR(WDT_vect)
 {
     uint16_t    timeouts;
 
-    timeouts = eeprom_read_word(0);
+    timeouts = watchdog_count();
     timeouts++;
-    eeprom_write_word(0, timeouts);
+    eeprom_write_word(WATCHDOG_COUNT_ADDR, timeouts);
+
+    watchdog_timeouts = timeouts;
 }
 
-ISR(TWI_vect)
+/*
+ * Snapshot of the station table, as read by the Raspberry Pi (integers are
+ * LSB first):
+ *
+ *  1   0x04
+ *  2   length of the rest of the snapshot
+ *  4   the clock (see clock.c) when the snapshot was started
+ *  1   number of stations
+ *
+ *  per station:
+ *  n   the station's latest message (version 1, see wireless.h)
+ *  4   age of the message, in clock ticks
+ *
+ * The snapshot is sent straight out of stations[] rather than being copied
+ * into a buffer first, as there isn't the RAM for one. Received messages
+ * aren't applied to stations[] while a snapshot is being read (twi_busy),
+ * so it stays consistent.
+ *
+ * A read starts a new snapshot, unless the Pi wrote TWI_CMD_CONTINUE just
+ * before it, when the read carries on from where the last one stopped. So
+ * the Pi can read the header, then exactly the rest of the snapshot, with
+ * nothing changing in between. A read that carries on first sends
+ * SNAPSHOT_RESUME and the snapshot's length again, so the Pi can tell it
+ * from a new snapshot. A snapshot left part read for longer than
+ * SNAPSHOT_PAUSE_MAX is given up, so messages can be stored again.
+ *
+ * If the Pi writes TWI_CMD_DIAGNOSTICS, the next read gets the receiver's
+ * diagnostics instead:
+ *
+ *  1   0x05
+ *  2   length of the rest of the message (19)
+ *  4   the clock when the message was started
+ *  1   the cause of the last reset (MCUSR: PORF, EXTRF, BORF, WDRF)
+ *  2   watchdog timeouts, ever (kept in EEPROM)
+ *  4   seconds since the last reset
+ *  2   frames ignored because the last message hadn't been handled yet
+ *  2   frames with a bad CRC, or too many errors to correct
+ *  2   messages dropped because stations[] was full
+ *  2   the least free SRAM since the last reset, in bytes
+ *
+ * The counters are since the last reset, and wrap around.
+ */
+#define SNAPSHOT_TYPE           0x04
+#define SNAPSHOT_HDR_LEN        8
+#define SNAPSHOT_AGE_LEN        4
+
+#define SNAPSHOT_RESUME         0x06
+#define SNAPSHOT_RESUME_LEN     3
+
+#define DIAGNOSTICS_TYPE        0x05
+#define DIAGNOSTICS_LEN         22
+
+#define TWI_CMD_SNAPSHOT        0x01    /* start a new snapshot (the default) */
+#define TWI_CMD_CONTINUE        0x02    /* carry on with the current snapshot */
+#define TWI_CMD_DIAGNOSTICS     0x03    /* send the diagnostics */
+
+#define SNAPSHOT_PAUSE_MAX      (F_CPU / 1024 / 2)  /* 0.5s, in clock ticks */
+
+/*
+ * Station timestamps are kept from falling further behind the clock than
+ * this, so that their ages don't wrap around (the station is long dead by
+ * then anyway).
+ */
+#define STATION_AGE_MAX         0x80000000UL
+
+static volatile uint8_t     twi_busy;
+static uint8_t              twi_command;
+static volatile uint8_t     twi_paused;
+static clock_time_t         twi_paused_at;
+static uint16_t             tx_remaining;
+static uint8_t              tx_header[DIAGNOSTICS_LEN];     /* or the diagnostics */
+static uint8_t              tx_header_len;
+static uint8_t              tx_header_pos;
+static uint8_t              tx_resume_pos;
+static uint8_t              tx_station;
+static uint8_t              tx_pos;
+static clock_time_t         tx_now;
+static clock_time_t         tx_age;
+
+/*
+ * Start a new snapshot.
+ */
+static void
+snapshot_start(void)
 {
-    uint8_t     twi_status;
+    uint8_t         i;
+    uint8_t         n_stations  = 0;
+    uint16_t        n_bytes     = 5;
+    clock_time_t    now         = clock_time_unlocked();
 
-    twi_status = TWSR & 0xf8;
+    for (i = 0; i < MAX_STATIONS; i++)
+    {
+        if (WL_SENSOR_MSG_STATION_ID(stations[i].msg) != 0)
+        {
+            n_stations++;
+            n_bytes += wl_sensor_msg_size(stations[i].msg) + SNAPSHOT_AGE_LEN;
+        }
+    }
 
-    if (twi_status == TW_ST_SLA_ACK)
+    tx_header[0] = SNAPSHOT_TYPE;
+    tx_header[1] = (uint8_t)n_bytes;
+    tx_header[2] = (uint8_t)(n_bytes >> 8);
+    tx_header[3] = (uint8_t)now;
+    tx_header[4] = (uint8_t)(now >> 8);
+    tx_header[5] = (uint8_t)(now >> 16);
+    tx_header[6] = (uint8_t)(now >> 24);
+    tx_header[7] = n_stations;
+
+    tx_remaining = 3 + n_bytes;
+    tx_header_len = SNAPSHOT_HDR_LEN;
+    tx_header_pos = 0;
+    tx_resume_pos = SNAPSHOT_RESUME_LEN;
+    tx_station = 0;
+    tx_pos = 0;
+    tx_now = now;
+}
+
+/*
+ * Put a 16-bit integer, LSB first.
+ */
+static uint8_t *
+put_u16(uint8_t *p, uint16_t v)
+{
+    *p++ = (uint8_t)v;
+    *p++ = (uint8_t)(v >> 8);
+
+    return p;
+}
+
+/*
+ * Put a 32-bit integer, LSB first.
+ */
+static uint8_t *
+put_u32(uint8_t *p, uint32_t v)
+{
+    p = put_u16(p, (uint16_t)v);
+
+    return put_u16(p, (uint16_t)(v >> 16));
+}
+
+/*
+ * Start sending the diagnostics. They all fit in tx_header[], so they are
+ * sent as a header with nothing after it.
+ */
+static void
+diagnostics_start(void)
+{
+    uint8_t         *p  = tx_header;
+
+    *p++ = DIAGNOSTICS_TYPE;
+    p = put_u16(p, DIAGNOSTICS_LEN - 3);
+    p = put_u32(p, clock_time_unlocked());
+    *p++ = mcusr_saved;
+    p = put_u16(p, watchdog_timeouts);
+    p = put_u32(p, uptime);
+    p = put_u16(p, msg_overruns);
+    p = put_u16(p, msg_errors);
+    p = put_u16(p, msg_dropped);
+    put_u16(p, sram_free);
+
+    tx_remaining = DIAGNOSTICS_LEN;
+    tx_header_len = DIAGNOSTICS_LEN;
+    tx_header_pos = 0;
+    tx_resume_pos = SNAPSHOT_RESUME_LEN;
+}
+
+/*
+ * Return the next byte of the snapshot.
+ */
+static uint8_t
+snapshot_next(void)
+{
+    station_info_t  *st;
+    uint8_t         size;
+    uint8_t         b;
+
+    /*
+     * A read carrying on with the snapshot starts with SNAPSHOT_RESUME in
+     * place of the type, then the length again
+     */
+    if (tx_resume_pos < SNAPSHOT_RESUME_LEN)
     {
-        uint8_t         i;
-        uint8_t         j;
-        uint8_t         n_stations  = 0;
-        uint8_t         n_bytes     = 1;
-        uint16_t        v16;
+        b = tx_resume_pos == 0 ? SNAPSHOT_RESUME : tx_header[tx_resume_pos];
+        tx_resume_pos++;
+        return b;
+    }
 
-        clock_time_t    now         = clock_time_unlocked();
+    tx_remaining--;
 
-        /*
-         * SLA+R received, ACK has been sent
-         *
-         * Build up the message to send.
-         */
-        tx_eom = tx_buffer;
+    if (tx_header_pos < tx_header_len)
+        return tx_header[tx_header_pos++];
+
+    for (; tx_station < MAX_STATIONS; tx_station++, tx_pos = 0)
+    {
+        st = &stations[tx_station];
+
+        if (WL_SENSOR_MSG_STATION_ID(st->msg) == 0)
+            continue;
 
-        for (i = 0; i < MAX_STATIONS; i++)
+        size = wl_sensor_msg_size(st->msg);
+
+        if (tx_pos < size)
+            return st->msg[tx_pos++];
+
+        if (tx_pos == size)
+            tx_age = tx_now - st->timestamp;
+
+        if (tx_pos < size + SNAPSHOT_AGE_LEN)
         {
-            if (WL_SENSOR_MSG_STATION_ID(stations[i].msg) != 0)
-            {
-                n_stations++;
-
-                n_bytes +=
-                    4
-                    +
-                    WL_SENSOR_MSG_NUM_VALUES(stations[i].msg)
-                    *
-                    WL_SENSOR_MSG_VALUE_LEN;
-            }
+            b = (uint8_t)tx_age;
+            tx_age >>= 8;
+            tx_pos++;
+            return b;
         }
+    }
 
-        /*
-         * Message header
-         */
-        *tx_eom++ = 0x01;       /* sensor message */
-        *tx_eom++ = n_bytes;
+    return 0xff;
+}
 
-        /*
-         * Number of stations
-         */
-        *tx_eom++ = n_stations;
+/*
+ * Stop station timestamps from falling so far behind the clock that their
+ * ages wrap around.
+ */
+static void
+station_limit_ages(void)
+{
+    clock_time_t    now     = clock_time();
+    uint8_t         i;
 
-        for (i = 0; i < MAX_STATIONS; i++)
+    for (i = 0; i < MAX_STATIONS; i++)
+    {
+        if (now - stations[i].timestamp > STATION_AGE_MAX)
         {
-            if (WL_SENSOR_MSG_STATION_ID(stations[i].msg) != 0)
-            {
-                /*
-                 * Sensor information
-                 */
-                *tx_eom++ = WL_SENSOR_MSG_STATION_ID(stations[i].msg);
-                *tx_eom++ = WL_SENSOR_MSG_NUM_VALUES(stations[i].msg);
-
-                /*
-                 * Sensor reading[s]
-                 */
-                for (j = 0; j < WL_SENSOR_MSG_NUM_VALUES(stations[i].msg); j++)
-                {
-                    v16 = WL_SENSOR_MSG_VALUE(stations[i].msg, j);
+            cli();
+            stations[i].timestamp = now - STATION_AGE_MAX;
+            sei();
+        }
+    }
+}
 
-                    *tx_eom++ = WL_SENSOR_MSG_TYPE(stations[i].msg, j);
-                    *tx_eom++ = ((uint8_t *)&v16)[0];
-                    *tx_eom++ = ((uint8_t *)&v16)[1];
-                }
+/*
+ * Give up on a snapshot that has been left part read for too long.
+ */
+static void
+snapshot_timeout(void)
+{
+    cli();
 
-                /*
-                 * Sensor reading age
-                 */
-                if (now >= stations[i].timestamp)
-                    v16 = now - stations[i].timestamp;
-                else
-                    v16 = 65535 - (stations[i].timestamp - now);
-                *tx_eom++ = ((uint8_t *)&v16)[0];
-                *tx_eom++ = ((uint8_t *)&v16)[1];
-            }
-        }
+    if (twi_paused && clock_time_unlocked() - twi_paused_at > SNAPSHOT_PAUSE_MAX)
+    {
+        twi_paused = 0;
+        twi_busy = 0;
+        tx_remaining = 0;
+    }
+
+    sei();
+}
 
-#if 0
-        tx_eom = tx_buffer;
-        *tx_eom++ = 0x02;       /* error message */
-        *tx_eom++ = 1;          /* size of message */
-        *tx_eom++ = n_stations;       /* not implemented */
-#endif
+ISR(TWI_vect)
+{
+    uint8_t     twi_status;
+
+    twi_status = TWSR & 0xf8;
 
-        tx_ptr = tx_buffer;
+    if (twi_status == TW_SR_DATA_ACK)
+    {
+        /*
+         * Command byte received, ACK returned
+         */
+        twi_command = TWDR;
+    }
+    else
+    if (twi_status == TW_ST_SLA_ACK)
+    {
+        /*
+         * SLA+R received, ACK has been sent
+         */
+        if (twi_command == TWI_CMD_DIAGNOSTICS)
+            diagnostics_start();
+        else
+        if (twi_command != TWI_CMD_CONTINUE || !twi_paused)
+            snapshot_start();
+        else
+            tx_resume_pos = 0;
+
+        twi_busy = 1;
+        twi_paused = 0;
+        twi_command = TWI_CMD_SNAPSHOT;
     }
 
     if (twi_status == TW_ST_SLA_ACK || twi_status == TW_ST_DATA_ACK)
@@ -176,27 +654,21 @@ ISR(TWI_vect)
          * SLA+R received, ACK returned, or
          * data transmitted, ACK received
          *
-         * Send the next byte in the message.
+         * Send the next byte in the snapshot.
          */
-        if (tx_eom > tx_buffer)
+        if (tx_remaining > 0)
         {
-            /*
-             * Send another byte
-             */
-            if (tx_ptr < tx_eom - 1)
+            TWDR = snapshot_next();
+
+            if (tx_remaining > 0)
             {
-                // send the next byte
-                TWDR = *tx_ptr++;
                 sbi(TWCR, TWEA);    // request an ACK
             }
             else
             {
-                // send the last byte
-                TWDR = *tx_ptr++;
+                // this is the last byte
                 cbi(TWCR, TWEA);    // request an NACK
-
-                // reset the transmit buffer
-                tx_ptr = tx_eom = tx_buffer;
+                twi_busy = 0;
             }
         }
         else
@@ -211,9 +683,17 @@ ISR(TWI_vect)
          * data transmitted, NACK received, or
          * last data byte transmitted, ACK received
          *
-         * XXX: Mismatch between the amount of data we sent vs the amount that
-         * was expected.
+         * If the Pi stopped short of the end of the snapshot, hold on to it
+         * in case the Pi carries on reading it.
          */
+        if (tx_remaining > 0 && tx_header[0] == SNAPSHOT_TYPE)
+        {
+            twi_paused = 1;
+            twi_paused_at = clock_time_unlocked();
+        }
+        else
+            twi_busy = 0;
+
         cbi(TWCR, TWSTA);
         cbi(TWCR, TWSTO);
         sbi(TWCR, TWEA);
@@ -268,6 +748,9 @@ main(void)
      */
     clock_init();
 
+    watchdog_timeouts = watchdog_count();
+    sram_free = (uint8_t *)RAMEND + 1 - &__heap_start;
+
     /*
      * Initialise the TWI module
      */
@@ -315,8 +798,6 @@ main(void)
     sbi(DDRA, PA7); cbi(PORTA, PA7);
     */
 
-    tx_ptr = tx_eom = tx_buffer;
-
     sei();
 
     for (;;)
@@ -324,9 +805,30 @@ main(void)
         /*
          * Received a message from the wireless receiver?
          */
+        if (twi_busy)
+        {
+            /*
+             * A snapshot is being read; hold on to the message until it's
+             * finished
+             */
+        }
+        else
+        if (msg_pending && (msg_sync & WL_SYNC_FLAG_FEC) && !wireless_fec_decode())
+        {
+            /*
+             * Too many bit errors to correct, or a bad CRC
+             */
+            cli();
+            msg_error = 1;
+            msg_errors++;
+            sei();
+            msg_pending = 0;
+        }
+        else
         if (msg_pending)
         {
-            uint8_t     n   = 0xff;
+            station_info_t  update;
+            uint8_t         n       = 0xff;
 
             /*
              * Find the slot in stations[] or allocate a new one
@@ -353,18 +855,44 @@ main(void)
             /*
              * Copy the message into stations[]. If there was no slot found,
              * just drop the message.
+             *
+             * A snapshot read can start at any moment, and is sent straight
+             * out of stations[], so the message is decoded into a copy of
+             * the slot, and only copied back with interrupts off once it's
+             * certain no snapshot has started. If one has, the message is
+             * left pending until the snapshot is finished.
              */
             if (n != 0xff)
             {
-                for (i = 0; i < WL_SENSOR_MSG_MAX_SIZE; i++)
-                    stations[n].msg[i] = msg_buffer[i];
+                update = stations[n];
 
-                stations[n].timestamp = clock_time();
-            }
+                if (msg_sync & WL_SYNC_FLAG_COMPACT)
+                    expand_compact(&update, (const uint8_t *)msg_buffer, msg_length);
+                else
+                    store_standard(&update, (const uint8_t *)msg_buffer, msg_length);
 
-            msg_pending = 0;
+                update.timestamp = clock_time();
+
+                cli();
+                if (!twi_busy)
+                {
+                    stations[n] = update;
+                    msg_pending = 0;
+                }
+                sei();
+            }
+            else
+            {
+                count_dropped();
+                msg_pending = 0;
+            }
         }
 
+        station_limit_ages();
+        snapshot_timeout();
+        uptime_update();
+        sram_check();
+
         wdt_reset();
     }
 
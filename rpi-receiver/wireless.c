@@ -7,13 +7,29 @@
 
 #include "avr-common.h"
 #include "../include/wireless.h"
+#include "../include/wireless_timing.h"
+#include "../include/wireless_fec.h"
+#include "wireless_rx.h"
 
 static volatile uint8_t *rx_ddr;
 static volatile uint8_t *rx_porto;
 static volatile uint8_t *rx_porti;
 static volatile uint8_t rx_pin;
 
-#define MSG_MAX_LENGTH      WL_SENSOR_MSG_MAX_SIZE
+/*
+ * The sampling rate comes from WL_BAUD and F_CPU (see wireless_timing.h).
+ */
+#if WL_RX_TIMER_TOP > 0xffff
+#error "F_CPU is too fast to sample WL_BAUD with Timer1"
+#endif
+
+#if WL_BAUD_ERROR_PPT(WL_RX_BAUD_ACTUAL) > WL_BAUD_MAX_ERROR_PPT
+#error "WL_BAUD can't be sampled accurately enough from F_CPU"
+#endif
+
+#if WL_RX_TIMER_TOP + 1 < WL_RX_ISR_CYCLES
+#error "WL_BAUD is too fast for the sampling interrupt at this F_CPU"
+#endif
 
 typedef enum
 {
@@ -26,26 +42,6 @@ typedef enum
 
 static volatile recv_state_t  recv_state  = RS_IDLE;
 
-static volatile uint8_t     msg_length;
-static volatile uint8_t     msg_crc;
-static volatile char        *msg_wrptr;
-
-char                        msg_buffer[MSG_MAX_LENGTH];
-volatile uint8_t            msg_pending     = 0;
-volatile uint8_t            msg_error       = 0;
-
-typedef enum
-{
-    UNSYNC       = 0,
-    SYNCING,
-    SYNCED,
-    GOTHDR,
-    GOTLEN,
-    GOTMSG,
-}
-    state_t;
-
-
 static inline void push_msg_byte(uint8_t v)
 {
     if (msg_wrptr == &msg_buffer[MSG_MAX_LENGTH-1])
@@ -58,243 +54,54 @@ static inline void push_msg_byte(uint8_t v)
 }
 
 /*
- * The last 16 sampled bits from the radio receiver
+ * This interrupt handler is called once per sample (see wireless_rx.h). It
+ * has to finish within one sample period (WL_RX_ISR_CYCLES).
  */
-static volatile uint16_t    sample_bits;
+ISR(TIMER1_COMPA_vect)
+{
+    // sbi(PORTA, PA7);    // DEBUG: enter interrupt handler
 
-/*
- * The receiver FSM state
- */
-static volatile state_t     state           = UNSYNC;
+    wireless_rx_sample(*rx_porti & (1 << rx_pin));
 
-/*
- * A counter that tells us how many samples until we should look for
- * the next bit transition.
- */
-static volatile uint8_t     sample_ctr;
+    // cbi(PORTA, PA7);    // DEBUG: leave interrupt handler
+}
 
-static volatile uint8_t     current_byte;
-static volatile uint8_t     bit_ctr;
 
 /*
- * This interrupt handler is called at 16 times the rf signal clock rate
- * so that we can recover the transmission clock from the Manchester-coded
- * data.
+ * Decode a received FEC frame into msg_buffer, and check its CRC.
+ *
+ * This is called from the main loop rather than the sampling interrupt,
+ * which doesn't have the cycles to spare.
+ *
+ * Returns non-zero if the message is good.
  */
-ISR(TIMER1_COMPA_vect)
+uint8_t
+wireless_fec_decode(void)
 {
-    // sbi(PORTA, PA7);    // DEBUG: enter interrupt handler
-    // cbi(PORTA, PA5);    // DEBUG: lost sync
-    // cbi(PORTA, PA4);    // DEBUG: EOB
-    // cbi(PORTA, PA3);    // DEBUG: sampling
+    uint8_t     crc     = _crc_ibutton_update(0, msg_length);
+    uint8_t     lo;
+    uint8_t     hi;
+    uint8_t     i;
 
-    /*
-     * Read in another sample for a bit value.
-     */
-    sample_bits <<= 1;
-    if (*rx_porti & (1 << rx_pin))
+    for (i = 0; i <= msg_length; i++)
     {
-        // sbi(PORTA, PA6);    // DEBUG: sample
-        sample_bits |= 1;
-    }
-    else
-    {
-        // cbi(PORTA, PA6);    // DEBUG: sample
-    }
+        lo = wl_fec_decode(fec_buffer[2 * i]);
+        hi = wl_fec_decode(fec_buffer[2 * i + 1]);
 
-    if (state == UNSYNC)
-    {
-        /*
-         * The initial sync matches a set of 16 bits with a 0->1 (manchester 0)
-         * bit in the middle.
-         *
-         * Here we compare the 10 bits in the middle of the 16-bit sample to
-         * see if we have a 0->1 transition. If so, we move to the SYNCING
-         * state.
-         */
-        if ((sample_bits & 0x1ff8) == 0x00f8)
-        {
-            state = SYNCING;
-            // PORTA = (PORTA & 0xf8) | (state & 0x7);  // DEBUG
-            sample_ctr = 16;
-        }
-    }
-    else
-    {
-        if (--sample_ctr == 0)
-        {
-            uint8_t     m;
-
-            // sbi(PORTA, PA3);    // DEBUG: EOM
-
-            /*
-             * Look for a transition in the middle of the 16-bit sample. A
-             * transition is either 0->1 or 1->0.  To implement a poor man's
-             * PLL, we set the number of bits to sample to try to get the
-             * next transition in the middle of the sample.
-             */
-            if ((m = (sample_bits >> 2) & 0x3) == 1 || m == 2)
-                sample_ctr = 21;
-            else
-            if ((m = (sample_bits >> 3) & 0x3) == 1 || m == 2)
-                sample_ctr = 20;
-            else
-            if ((m = (sample_bits >> 4) & 0x3) == 1 || m == 2)
-                sample_ctr = 19;
-            else
-            if ((m = (sample_bits >> 5) & 0x3) == 1 || m == 2)
-                sample_ctr = 18;
-            else
-            if ((m = (sample_bits >> 6) & 0x3) == 1 || m == 2)
-                sample_ctr = 17;
-            else
-            if ((m = (sample_bits >> 7) & 0x3) == 1 || m == 2)
-                sample_ctr = 16;
-            else
-            if ((m = (sample_bits >> 8) & 0x3) == 1 || m == 2)
-                sample_ctr = 15;
-            else
-            if ((m = (sample_bits >> 9) & 0x3) == 1 || m == 2)
-                sample_ctr = 14;
-            else
-            if ((m = (sample_bits >> 10) & 0x3) == 1 || m == 2)
-                sample_ctr = 13;
-            else
-            if ((m = (sample_bits >> 11) & 0x3) == 1 || m == 2)
-                sample_ctr = 14;
-            else
-            if ((m = (sample_bits >> 12) & 0x3) == 1 || m == 2)
-                sample_ctr = 15;
-            else
-            {
-                /*
-                 * Didn't find a transition, so go back to the UNSYNC state.
-                 */
-                state = UNSYNC;
-                // sbi(PORTA, PA5);    // DEBUG: lost sync
-                // PORTA = (PORTA & 0xf8) | (state & 0x7);
-            }
-
-            if (state == SYNCING)
-            {
-                /*
-                 * Accumulate the newly-sampled bit into the current byte
-                 * (at the MSB end).
-                 */
-                current_byte = (current_byte >> 1) | (m == 2 ? (1 << 7) : 0);
-
-                /*
-                 * The sync stream of zeroes ends with 2 1-bits.  If we get
-                 * this, then move to the SYNCED state.
-                 */
-                if (current_byte == 0xc0)
-                {
-                    state = SYNCED;
-                    // PORTA = (PORTA & 0xf8) | (state & 0x7);
-                    bit_ctr = 0;
-                }
-            }
-            else
-            if (state != UNSYNC)
-            {
-                /*
-                 * Accumulate the newly-sampled bit into the current byte
-                 * (at the MSB end).
-                 */
-                current_byte = (current_byte >> 1) | (m == 2 ? (1 << 7) : 0);
-                bit_ctr++;
-
-                if (bit_ctr == 8)
-                {
-                    // sbi(PORTA, PA4);    // DEBUG: EOB
-
-                    /*
-                     * We've accepted a complete byte. Use this to manage the
-                     * FSM state.
-                     */
-                    if (state == SYNCED)
-                    {
-                        /*
-                         * First byte in a message is a 0xc4 header byte
-                         */
-                        if (current_byte == 0xc4)
-                        {
-                            state = GOTHDR;
-                            // PORTA = (PORTA & 0xf8) | (state & 0x7);
-                        }
-                    }
-                    else
-                    if (state == GOTHDR)
-                    {
-                        /*
-                         * Second byte in a message is the message length. We
-                         * start to accumulate bytes into a CRC value.
-                         */
-                        msg_length = current_byte;
-                        msg_crc = _crc_ibutton_update(0, current_byte);
-
-                        msg_wrptr = msg_buffer;
-
-                        state = GOTLEN;
-                        // PORTA = (PORTA & 0xf8) | (state & 0x7);
-                    }
-                    else
-                    if (state == GOTLEN)
-                    {
-                        /*
-                         * Include another message byte.
-                         */
-                        *msg_wrptr++ = current_byte;
-                        msg_crc = _crc_ibutton_update(msg_crc, current_byte);
-
-                        if (msg_wrptr >= msg_buffer + msg_length)
-                        {
-                            state = GOTMSG;
-                            // PORTA = (PORTA & 0xf8) | (state & 0x7);
-                        }
-                    }
-                    else
-                    if (state == GOTMSG)
-                    {
-                        /*
-                         * Check the message CRC matches what we have received.
-                         */
-                        if (msg_crc == current_byte)
-                        {
-                            /*
-                             * The CRC check succeeded, so we have successfully
-                             * received a message.
-                             */
-                            *msg_wrptr++ = '\0';
-                            msg_pending = 1;
-                        }
-                        else
-                        {
-                            /*
-                             * The CRC check failed; the message was corrupt
-                             */
-                            msg_error = 1;
-                        }
-
-                        /*
-                         * Reset back to the UNSYNC state.
-                         */
-                        state = UNSYNC;
-                        // PORTA = (PORTA & 0xf8) | (state & 0x7);
-                    }
-
-                    /*
-                     * Reset the current byte
-                     */
-                    current_byte = 0;
-                    bit_ctr = 0;
-                }
-            }
-        }
+        if (lo == WL_FEC_ERROR || hi == WL_FEC_ERROR)
+            return 0;
+
+        lo |= hi << 4;
+
+        if (i == msg_length)
+            return lo == crc;
+
+        msg_buffer[i] = lo;
+        crc = _crc_ibutton_update(crc, lo);
     }
-    // cbi(PORTA, PA7);    // DEBUG: leave interrupt handler
-}
 
+    return 0;
+}
 
 void
 wireless_init(volatile uint8_t *ddr, volatile uint8_t *porto, volatile uint8_t *porti, uint8_t pin)
@@ -322,9 +129,9 @@ wireless_init(volatile uint8_t *ddr, volatile uint8_t *porto, volatile uint8_t *
     cbi(TCCR1A, WGM11);
     cbi(TCCR1A, WGM10);
 
-    // set timer value = 260 = 0x0104
-    OCR1AH = 0x01;
-    OCR1AL = 0x04;
+    // set timer value for 16 samples per bit (259 for 4800 baud at 10MHz)
+    OCR1AH = WL_RX_TIMER_TOP >> 8;
+    OCR1AL = WL_RX_TIMER_TOP & 0xff;
 
     // send interrupt on timeout
     sbi(TIMSK1, OCIE1A);
@@ -0,0 +1,354 @@
+#ifndef __WIRELESS_RX_H__
+#define __WIRELESS_RX_H__
+
+/*
+ * Manchester decoder for the sampling interrupt in wireless.c.
+ *
+ * This is a header so that sensor-t/sim/rxtest.c can feed it synthesized
+ * samples on the host. The includer provides _crc_ibutton_update() (from
+ * <util/crc16.h> on the AVR).
+ */
+#include <stdint.h>
+
+#include "../include/wireless.h"
+#include "../include/wireless_fec.h"
+
+#define MSG_MAX_LENGTH      WL_FRAME_MSG_MAX_SIZE
+
+static volatile uint8_t     msg_crc;
+static volatile char        *msg_wrptr;
+
+/*
+ * FEC frames are stored as received (two codewords per byte, including the
+ * CRC), and decoded by wireless_fec_decode() from the main loop.
+ */
+static char                 fec_buffer[2 * (MSG_MAX_LENGTH + 1)];
+static volatile char        *fec_end;
+static volatile uint8_t     fec_nibble;
+
+char                        msg_buffer[MSG_MAX_LENGTH];
+volatile uint8_t            msg_sync;
+volatile uint8_t            msg_length;
+volatile uint8_t            msg_pending     = 0;
+volatile uint8_t            msg_error       = 0;
+
+/*
+ * Frames ignored because the main loop hadn't taken the last message, and
+ * frames that failed their CRC (or, with FEC, had too many errors), since
+ * reset. The main loop counts FEC failures, with interrupts off.
+ */
+volatile uint16_t           msg_overruns    = 0;
+volatile uint16_t           msg_errors      = 0;
+
+typedef enum
+{
+    UNSYNC       = 0,
+    SYNCING,
+    SYNCED,
+    GOTHDR,
+    GOTLEN,
+    GOTMSG,
+}
+    state_t;
+
+/*
+ * The last 16 sampled bits from the radio receiver
+ */
+static volatile uint16_t    sample_bits;
+
+/*
+ * The receiver FSM state
+ */
+static volatile state_t     state           = UNSYNC;
+
+/*
+ * A counter that tells us how many samples until we should look for
+ * the next bit transition.
+ */
+static volatile uint8_t     sample_ctr;
+
+static volatile uint8_t     current_byte;
+static volatile uint8_t     bit_ctr;
+
+/**
+ * Take the next sample from the radio receiver. This is called at 16 times
+ * the rf signal clock rate so that we can recover the transmission clock
+ * from the Manchester-coded data.
+ *
+ *  @param[in]  level   Non-zero if the receiver's output is high.
+ */
+static inline void
+wireless_rx_sample(uint8_t level)
+{
+    // cbi(PORTA, PA5);    // DEBUG: lost sync
+    // cbi(PORTA, PA4);    // DEBUG: EOB
+    // cbi(PORTA, PA3);    // DEBUG: sampling
+
+    /*
+     * Read in another sample for a bit value.
+     */
+    sample_bits <<= 1;
+    if (level)
+        sample_bits |= 1;
+
+    if (state == UNSYNC)
+    {
+        /*
+         * The initial sync matches a set of 16 bits with a 0->1 (manchester 0)
+         * bit in the middle.
+         *
+         * Here we compare the 10 bits in the middle of the 16-bit sample to
+         * see if we have a 0->1 transition. If so, we move to the SYNCING
+         * state.
+         */
+        if ((sample_bits & 0x1ff8) == 0x00f8)
+        {
+            state = SYNCING;
+            // PORTA = (PORTA & 0xf8) | (state & 0x7);  // DEBUG
+            sample_ctr = 16;
+        }
+    }
+    else
+    {
+        if (--sample_ctr == 0)
+        {
+            uint8_t     m;
+
+            // sbi(PORTA, PA3);    // DEBUG: EOM
+
+            /*
+             * Look for a transition in the middle of the 16-bit sample. A
+             * transition is either 0->1 or 1->0.  To implement a poor man's
+             * PLL, we set the number of bits to sample to try to get the
+             * next transition in the middle of the sample.
+             */
+            if ((m = (sample_bits >> 2) & 0x3) == 1 || m == 2)
+                sample_ctr = 21;
+            else
+            if ((m = (sample_bits >> 3) & 0x3) == 1 || m == 2)
+                sample_ctr = 20;
+            else
+            if ((m = (sample_bits >> 4) & 0x3) == 1 || m == 2)
+                sample_ctr = 19;
+            else
+            if ((m = (sample_bits >> 5) & 0x3) == 1 || m == 2)
+                sample_ctr = 18;
+            else
+            if ((m = (sample_bits >> 6) & 0x3) == 1 || m == 2)
+                sample_ctr = 17;
+            else
+            if ((m = (sample_bits >> 7) & 0x3) == 1 || m == 2)
+                sample_ctr = 16;
+            else
+            if ((m = (sample_bits >> 8) & 0x3) == 1 || m == 2)
+                sample_ctr = 15;
+            else
+            if ((m = (sample_bits >> 9) & 0x3) == 1 || m == 2)
+                sample_ctr = 14;
+            else
+            if ((m = (sample_bits >> 10) & 0x3) == 1 || m == 2)
+                sample_ctr = 13;
+            else
+            if ((m = (sample_bits >> 11) & 0x3) == 1 || m == 2)
+                sample_ctr = 14;
+            else
+            if ((m = (sample_bits >> 12) & 0x3) == 1 || m == 2)
+                sample_ctr = 15;
+            else
+            {
+                /*
+                 * Didn't find a transition, so go back to the UNSYNC state.
+                 */
+                state = UNSYNC;
+                // sbi(PORTA, PA5);    // DEBUG: lost sync
+                // PORTA = (PORTA & 0xf8) | (state & 0x7);
+            }
+
+            if (state == SYNCING)
+            {
+                /*
+                 * Accumulate the newly-sampled bit into the current byte
+                 * (at the MSB end).
+                 */
+                current_byte = (current_byte >> 1) | (m == 2 ? (1 << 7) : 0);
+
+                /*
+                 * The sync stream of zeroes ends with 2 1-bits.  If we get
+                 * this, then move to the SYNCED state.
+                 */
+                if (current_byte == 0xc0)
+                {
+                    state = SYNCED;
+                    // PORTA = (PORTA & 0xf8) | (state & 0x7);
+                    bit_ctr = 0;
+                }
+            }
+            else
+            if (state != UNSYNC)
+            {
+                /*
+                 * Accumulate the newly-sampled bit into the current byte
+                 * (at the MSB end).
+                 */
+                current_byte = (current_byte >> 1) | (m == 2 ? (1 << 7) : 0);
+                bit_ctr++;
+
+                if (bit_ctr == 8)
+                {
+                    // sbi(PORTA, PA4);    // DEBUG: EOB
+
+                    /*
+                     * We've accepted a complete byte. Use this to manage the
+                     * FSM state.
+                     */
+                    if (state == SYNCED)
+                    {
+                        /*
+                         * First byte in a message is a sync byte, which also
+                         * tells us how the message is encoded.
+                         *
+                         * Ignore the frame if the main loop hasn't taken the
+                         * last message out of the buffer yet.
+                         */
+                        if (WL_SYNC_VALID(current_byte) && msg_pending)
+                        {
+                            msg_overruns++;
+                            state = UNSYNC;
+                        }
+                        else
+                        if (WL_SYNC_VALID(current_byte))
+                        {
+                            msg_sync = current_byte;
+                            fec_nibble = WL_FEC_ERROR;
+                            state = GOTHDR;
+                            // PORTA = (PORTA & 0xf8) | (state & 0x7);
+                        }
+                    }
+                    else
+                    if (state == GOTHDR && (msg_sync & WL_SYNC_FLAG_FEC))
+                    {
+                        /*
+                         * With FEC, the length comes as two codewords. Decode
+                         * one per byte, to spread the cost across samples;
+                         * the rest of the frame is decoded later.
+                         */
+                        uint8_t     n   = wl_fec_decode(current_byte);
+
+                        if (n == WL_FEC_ERROR)
+                            state = UNSYNC;
+                        else
+                        if (fec_nibble == WL_FEC_ERROR)
+                            fec_nibble = n;
+                        else
+                        {
+                            n = fec_nibble | (n << 4);
+
+                            if (n == 0 || n > MSG_MAX_LENGTH)
+                                state = UNSYNC;
+                            else
+                            {
+                                msg_length = n;
+                                msg_wrptr = fec_buffer;
+                                fec_end = fec_buffer + 2 * (n + 1);
+
+                                state = GOTLEN;
+                            }
+                        }
+                    }
+                    else
+                    if (state == GOTHDR)
+                    {
+                        /*
+                         * Second byte in a message is the message length. We
+                         * start to accumulate bytes into a CRC value.
+                         *
+                         * The length hasn't been checked by the CRC yet, so
+                         * don't trust it to fit in the buffer.
+                         */
+                        if (current_byte == 0 || current_byte > MSG_MAX_LENGTH)
+                        {
+                            state = UNSYNC;
+                        }
+                        else
+                        {
+                            msg_length = current_byte;
+                            msg_crc = _crc_ibutton_update(0, current_byte);
+
+                            msg_wrptr = msg_buffer;
+
+                            state = GOTLEN;
+                        }
+                        // PORTA = (PORTA & 0xf8) | (state & 0x7);
+                    }
+                    else
+                    if (state == GOTLEN && (msg_sync & WL_SYNC_FLAG_FEC))
+                    {
+                        /*
+                         * Store another FEC codeword. The CRC is the last
+                         * byte, so once we have it, the frame is complete.
+                         */
+                        *msg_wrptr++ = current_byte;
+
+                        if (msg_wrptr >= fec_end)
+                        {
+                            msg_pending = 1;
+                            state = UNSYNC;
+                        }
+                    }
+                    else
+                    if (state == GOTLEN)
+                    {
+                        /*
+                         * Include another message byte.
+                         */
+                        *msg_wrptr++ = current_byte;
+                        msg_crc = _crc_ibutton_update(msg_crc, current_byte);
+
+                        if (msg_wrptr >= msg_buffer + msg_length)
+                        {
+                            state = GOTMSG;
+                            // PORTA = (PORTA & 0xf8) | (state & 0x7);
+                        }
+                    }
+                    else
+                    if (state == GOTMSG)
+                    {
+                        /*
+                         * Check the message CRC matches what we have received.
+                         */
+                        if (msg_crc == current_byte)
+                        {
+                            /*
+                             * The CRC check succeeded, so we have successfully
+                             * received a message.
+                             */
+                            msg_pending = 1;
+                        }
+                        else
+                        {
+                            /*
+                             * The CRC check failed; the message was corrupt
+                             */
+                            msg_error = 1;
+                            msg_errors++;
+                        }
+
+                        /*
+                         * Reset back to the UNSYNC state.
+                         */
+                        state = UNSYNC;
+                        // PORTA = (PORTA & 0xf8) | (state & 0x7);
+                    }
+
+                    /*
+                     * Reset the current byte
+                     */
+                    current_byte = 0;
+                    bit_ctr = 0;
+                }
+            }
+        }
+    }
+}
+
+#endif /* __WIRELESS_RX_H__ */
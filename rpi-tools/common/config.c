@@ -0,0 +1,598 @@
+/*
+ * Reader for the runtime configuration file (see config.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "wireless.h"
+#include "derived.h"
+#include "config.h"
+
+typedef enum
+{
+    CONFIG_STRING,
+    CONFIG_INT,
+    CONFIG_INT16,
+    CONFIG_INT32,
+    CONFIG_NAME,        /* int: index of the value in names[] */
+    CONFIG_SENSOR,      /* int: sensor type, by name or number */
+    CONFIG_FLAGS        /* int: bit mask of comma separated names[] */
+}
+    config_kind_t;
+
+/**
+ * A configuration setting: where it lives in the file and in config_t
+ * (or config_alert_t, for the "alert" section).
+ */
+typedef struct
+{
+    const char          *section;
+    const char          *key;
+    config_kind_t       kind;
+    size_t              offset;
+    long                min;
+    long                max;
+    const char *const   *names;
+}
+    config_item_t;
+
+/**
+ * Sensor type names, indexed by WL_SENSOR_TYPE_*
+ */
+static const char *const    sensor_names[]  =
+{
+    "invalid", "temperature", "pressure", "counter", "light", "humidity", "battery", NULL
+};
+
+/**
+ * Derived type names, from DERIVED_TYPE_MIN
+ */
+static const char *const    derived_names[] =
+{
+    "pressure_msl", "dew_point", "battery_level", NULL
+};
+
+/**
+ * Alert rule kind names, indexed by ALERT_KIND_*
+ */
+static const char *const    alert_kinds[]   =
+{
+    "below", "above", "rate", "stale", "gap", NULL
+};
+
+/**
+ * Alert sink names, by bit number of ALERT_SINK_*
+ */
+static const char *const    alert_sinks[]   =
+{
+    "syslog", "socket", "webhook", NULL
+};
+
+static const config_item_t  config_items[] =
+{
+    { "receiver",   "device",           CONFIG_STRING,
+        offsetof(config_t, i2c_device),             0,  0       },
+    { "receiver",   "address",          CONFIG_INT,
+        offsetof(config_t, i2c_address),            0x03, 0x77  },
+    { "database",   "host",             CONFIG_STRING,
+        offsetof(config_t, db_host),                0,  0       },
+    { "database",   "name",             CONFIG_STRING,
+        offsetof(config_t, db_name),                0,  0       },
+    { "database",   "user",             CONFIG_STRING,
+        offsetof(config_t, db_user),                0,  0       },
+    { "sensord",    "poll_interval",    CONFIG_INT,
+        offsetof(config_t, poll_interval),          1,  3600    },
+    { "sensord",    "station_dead",     CONFIG_INT16,
+        offsetof(config_t, station_dead_threshold), 1,  INT16_MAX },
+    { "sensord",    "battery_low",      CONFIG_INT16,
+        offsetof(config_t, battery_low_threshold),  0,  INT16_MAX },
+    { "sensord",    "battery_ok",       CONFIG_INT16,
+        offsetof(config_t, battery_ok_threshold),   0,  INT16_MAX },
+    { "sensord",    "altitude",         CONFIG_INT16,
+        offsetof(config_t, altitude),               -500, 9000  },
+    { "sensord",    "trace_file",       CONFIG_STRING,
+        offsetof(config_t, trace_file),             0,  0       },
+    { "sensord",    "control_socket",   CONFIG_STRING,
+        offsetof(config_t, control_socket),         0,  0       },
+    { "sensord",    "shared_state",     CONFIG_STRING,
+        offsetof(config_t, shared_state),           0,  0       },
+    { "sensord",    "heartbeat",        CONFIG_INT,
+        offsetof(config_t, heartbeat),              0,  604800  },
+    { "sensord",    "diagnostics",      CONFIG_INT,
+        offsetof(config_t, diagnostics),            0,  86400   },
+    { "sensord",    "spike_threshold",  CONFIG_INT,
+        offsetof(config_t, spike_threshold),        0,  1000    },
+    { "alerts",     "socket",           CONFIG_STRING,
+        offsetof(config_t, alert_socket),           0,  0       },
+    { "alerts",     "webhook",          CONFIG_STRING,
+        offsetof(config_t, alert_webhook),          0,  0       },
+
+    { "alert",      "station",          CONFIG_INT,
+        offsetof(config_alert_t, station),          0,  254     },
+    { "alert",      "sensor",           CONFIG_SENSOR,
+        offsetof(config_alert_t, sensor),           1,  255     },
+    { "alert",      "kind",             CONFIG_NAME,
+        offsetof(config_alert_t, kind),             0,  0,      alert_kinds },
+    { "alert",      "threshold",        CONFIG_INT32,
+        offsetof(config_alert_t, threshold),        INT32_MIN, INT32_MAX },
+    { "alert",      "clear",            CONFIG_INT32,
+        offsetof(config_alert_t, clear),            INT32_MIN, INT32_MAX },
+    { "alert",      "holdoff",          CONFIG_INT,
+        offsetof(config_alert_t, holdoff),          0,  604800  },
+    { "alert",      "sinks",            CONFIG_FLAGS,
+        offsetof(config_alert_t, sinks),            0,  0,      alert_sinks },
+
+    { "station",    "altitude",         CONFIG_INT16,
+        0,                                          -500, 9000  },
+};
+
+#define N_CONFIG_ITEMS  (sizeof(config_items) / sizeof(config_items[0]))
+
+/**
+ * Fill in the default configuration.
+ *
+ * @param[out]  cfg     The configuration.
+ */
+void
+config_defaults(config_t *cfg)
+{
+    int     i;
+
+    memset(cfg, 0, sizeof(*cfg));
+
+    strcpy(cfg->i2c_device, "/dev/i2c-0");
+    cfg->i2c_address = 0x41;
+    cfg->poll_interval = 45;    /* sensors send every 64 seconds */
+
+    strcpy(cfg->db_host, "moonbase");
+    strcpy(cfg->db_name, "sensors");
+    strcpy(cfg->db_user, "sensord");
+
+    cfg->station_dead_threshold = WL_STATION_DEAD_THRESHOLD;
+    cfg->battery_low_threshold = 26;
+    cfg->battery_ok_threshold = 28;
+
+    strcpy(cfg->trace_file, "/var/tmp/sensord.trace");
+    strcpy(cfg->control_socket, "/run/sensord/control");
+    strcpy(cfg->shared_state, "/sensord");
+    cfg->diagnostics = 300;
+    cfg->spike_threshold = 6;
+
+    strcpy(cfg->alert_socket, "/run/sensord/alerts");
+    strcpy(cfg->alert_webhook, "/var/spool/sensord/alerts");
+
+    for (i = 0; i < 256; i++)
+        cfg->station_altitude[i] = CONFIG_ALTITUDE_UNSET;
+}
+
+/**
+ * Return the name of a sensor type.
+ *
+ * @param[in]   type    The sensor type (WL_SENSOR_TYPE_* or DERIVED_TYPE_*).
+ *
+ * @return      the name, or "unknown".
+ */
+const char *
+config_sensor_name(int type)
+{
+    if (type >= 0 && type <= WL_SENSOR_TYPE_MAX)
+        return sensor_names[type];
+
+    if (type >= DERIVED_TYPE_MIN && type <= DERIVED_TYPE_MAX)
+        return derived_names[type - DERIVED_TYPE_MIN];
+
+    return "unknown";
+}
+
+/**
+ * Return the altitude of a station.
+ *
+ * @param[in]   cfg         The configuration.
+ * @param[in]   station     The station ID.
+ *
+ * @return      the altitude in metres.
+ */
+int
+config_altitude(const config_t *cfg, int station)
+{
+    if (cfg->station_altitude[station & 0xff] != CONFIG_ALTITUDE_UNSET)
+        return cfg->station_altitude[station & 0xff];
+
+    return cfg->altitude;
+}
+
+/**
+ * Find a name in a list.
+ *
+ * @param[in]   names   The NULL terminated list of names.
+ * @param[in]   name    The name to find.
+ * @param[in]   length  The length of the name.
+ *
+ * @return      the index of the name, or -1 if not found.
+ */
+static int
+find_name(const char *const *names, const char *name, size_t length)
+{
+    int     i;
+
+    for (i = 0; names[i] != NULL; i++)
+    {
+        if (strlen(names[i]) == length && strncmp(names[i], name, length) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * Strip leading and trailing white space from a string, in place.
+ *
+ * @param[in]   s       The string.
+ *
+ * @return      the start of the stripped string.
+ */
+static char *
+strip(char *s)
+{
+    char    *end;
+
+    while (isspace((unsigned char)*s))
+        s++;
+
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+
+    return s;
+}
+
+/**
+ * Set a configuration item from its value in the file.
+ *
+ * @param[in]   item    The item.
+ * @param[in]   value   The value, as text.
+ * @param[out]  base    The config_t (or config_alert_t) to set it in.
+ *
+ * @return      zero for success, non-zero if the value is not valid.
+ */
+static int
+config_set(const config_item_t *item, const char *value, void *base)
+{
+    char        *p      = (char *)base + item->offset;
+    const char  *word;
+    size_t      length;
+    char        *end;
+    long        n;
+    int         i;
+
+    if (item->kind == CONFIG_STRING)
+    {
+        if (*value == '\0' || strlen(value) >= CONFIG_MAX_STRING)
+            return 1;
+
+        strcpy(p, value);
+        return 0;
+    }
+
+    if (item->kind == CONFIG_FLAGS)
+    {
+        n = 0;
+
+        for (word = value; *word != '\0'; word += length)
+        {
+            while (*word == ',' || isspace((unsigned char)*word))
+                word++;
+
+            for (length = 0; word[length] != '\0' && word[length] != ','
+                    && !isspace((unsigned char)word[length]); length++)
+                ;
+
+            if (length == 0)
+                continue;
+
+            if ((i = find_name(item->names, word, length)) < 0)
+                return 1;
+
+            n |= 1 << i;
+        }
+
+        *(int *)p = (int)n;
+        return 0;
+    }
+
+    if (item->kind == CONFIG_NAME)
+    {
+        if ((i = find_name(item->names, value, strlen(value))) < 0)
+            return 1;
+
+        *(int *)p = i;
+        return 0;
+    }
+
+    if (item->kind == CONFIG_SENSOR)
+    {
+        if ((i = find_name(sensor_names, value, strlen(value))) >= 0)
+        {
+            *(int *)p = i;
+            return 0;
+        }
+
+        if ((i = find_name(derived_names, value, strlen(value))) >= 0)
+        {
+            *(int *)p = DERIVED_TYPE_MIN + i;
+            return 0;
+        }
+    }
+
+    errno = 0;
+    n = strtol(value, &end, 0);     /* allow 0x41 for addresses */
+
+    if (errno != 0 || end == value || *end != '\0' || n < item->min || n > item->max)
+        return 1;
+
+    if (item->kind == CONFIG_INT16)
+        *(int16_t *)p = (int16_t)n;
+    else
+    if (item->kind == CONFIG_INT32)
+        *(int32_t *)p = (int32_t)n;
+    else
+        *(int *)p = (int)n;
+
+    return 0;
+}
+
+/**
+ * Start a new alert rule, with its defaults.
+ *
+ * @param[in,out]   cfg     The configuration.
+ * @param[in]       name    The rule name.
+ *
+ * @return      the rule, or NULL if there are too many rules or the name
+ *              is already in use.
+ */
+static config_alert_t *
+alert_start(config_t *cfg, const char *name)
+{
+    config_alert_t  *rule;
+    int             i;
+
+    /*
+     * Names go into JSON alerts, so keep them simple
+     */
+    if
+    (
+        cfg->nalerts == CONFIG_MAX_ALERTS
+        ||
+        *name == '\0'
+        ||
+        strlen(name) >= CONFIG_MAX_STRING
+        ||
+        strpbrk(name, "\"\\") != NULL
+    )
+        return NULL;
+
+    for (i = 0; i < cfg->nalerts; i++)
+    {
+        if (strcmp(cfg->alerts[i].name, name) == 0)
+            return NULL;
+    }
+
+    rule = &cfg->alerts[cfg->nalerts++];
+
+    memset(rule, 0, sizeof(*rule));
+    strcpy(rule->name, name);
+    rule->kind = -1;
+    rule->clear = INT32_MIN;    /* not set */
+    rule->holdoff = 3600;
+    rule->sinks = ALERT_SINK_SYSLOG;
+
+    return rule;
+}
+
+/**
+ * Check an alert rule once its section has been read, and fill in the
+ * settings that depend on its kind.
+ *
+ * @param[in,out]   rule    The rule.
+ *
+ * @return      zero for success, non-zero if the rule is not valid.
+ */
+static int
+alert_finish(config_alert_t *rule)
+{
+    if (rule->kind < 0)
+        return 1;
+
+    if (rule->kind == ALERT_KIND_STALE)
+        rule->sensor = WL_SENSOR_TYPE_INVALID;
+    else
+    if (rule->kind == ALERT_KIND_GAP)
+        rule->sensor = WL_SENSOR_TYPE_COUNTER;
+    else
+    if (rule->sensor == WL_SENSOR_TYPE_INVALID)
+        return 1;
+
+    if (rule->clear == INT32_MIN)
+        rule->clear = rule->threshold;
+
+    /*
+     * The clear level must be on the safe side of the threshold
+     */
+    if (rule->kind == ALERT_KIND_BELOW ? rule->clear < rule->threshold : rule->clear > rule->threshold)
+        return 1;
+
+    return 0;
+}
+
+/**
+ * Read a configuration file. Settings not in the file are left unchanged,
+ * apart from the alert rules, which are replaced by those in the file.
+ * Nothing is changed if the file has an error, so cfg should hold the
+ * defaults (or the previous configuration) beforehand.
+ *
+ * @param[in]       path    The configuration file.
+ * @param[in,out]   cfg     The configuration.
+ *
+ * @return      zero for success, -1 if the file can't be read (see errno),
+ *              or the number of the first line in error.
+ */
+int
+config_load(const char *path, config_t *cfg)
+{
+    FILE            *f;
+    config_t        new_cfg     = *cfg;
+    config_alert_t  *rule       = NULL;
+    int             rule_line   = 0;
+    int16_t         *altitude   = NULL;
+    void            *base;
+    char            *end;
+    long            station;
+    char            line[256];
+    char            section[CONFIG_MAX_STRING]  = "";
+    char            *p;
+    char            *value;
+    int             lineno      = 0;
+    int             known;
+    int             status      = 0;
+    size_t          i;
+
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+
+    /*
+     * Rules and station settings come only from the file
+     */
+    new_cfg.nalerts = 0;
+    for (i = 0; i < 256; i++)
+        new_cfg.station_altitude[i] = CONFIG_ALTITUDE_UNSET;
+
+    while (status == 0 && fgets(line, sizeof(line), f) != NULL)
+    {
+        lineno++;
+
+        if (strchr(line, '\n') == NULL && !feof(f))
+        {
+            status = lineno;    /* line too long */
+            break;
+        }
+
+        p = strip(line);
+
+        if (*p == '\0' || *p == '#' || *p == ';')
+            continue;
+
+        if (*p == '[')
+        {
+            if (p[strlen(p) - 1] != ']' || strlen(p) - 2 >= sizeof(section))
+            {
+                status = lineno;
+                break;
+            }
+
+            if (rule != NULL && alert_finish(rule) != 0)
+            {
+                status = rule_line;
+                break;
+            }
+
+            p[strlen(p) - 1] = '\0';
+            strcpy(section, strip(p + 1));
+            rule = NULL;
+            altitude = NULL;
+
+            /*
+             * Each [station N] section holds a station's settings
+             */
+            if (strncmp(section, "station", 7) == 0 && isspace((unsigned char)section[7]))
+            {
+                station = strtol(section + 7, &end, 10);
+
+                if (*end == '\0' && station >= 1 && station <= 254)
+                {
+                    altitude = &new_cfg.station_altitude[station];
+                    strcpy(section, "station");
+                }
+            }
+
+            /*
+             * Each [alert NAME] section is a rule
+             */
+            if (strncmp(section, "alert", 5) == 0 && (section[5] == '\0' || isspace((unsigned char)section[5])))
+            {
+                if ((rule = alert_start(&new_cfg, strip(section + 5))) == NULL)
+                {
+                    status = lineno;
+                    break;
+                }
+
+                rule_line = lineno;
+                strcpy(section, "alert");
+            }
+
+            continue;
+        }
+
+        if ((value = strchr(p, '=')) == NULL)
+        {
+            status = lineno;
+            break;
+        }
+
+        *value++ = '\0';
+        p = strip(p);
+        value = strip(value);
+
+        /*
+         * Only check the sections we own; the rest belong to the scripts
+         */
+        known = 0;
+        for (i = 0; i < N_CONFIG_ITEMS; i++)
+        {
+            if (strcmp(section, config_items[i].section) != 0)
+                continue;
+
+            known = 1;
+
+            if (strcmp(p, config_items[i].key) == 0)
+                break;
+        }
+
+        if (!known)
+            continue;
+
+        /*
+         * Station sections also hold settings for the scripts
+         */
+        if (i == N_CONFIG_ITEMS && altitude != NULL)
+            continue;
+
+        if (rule != NULL)
+            base = rule;
+        else
+        if (altitude != NULL)
+            base = altitude;
+        else
+            base = &new_cfg;
+
+        if (i == N_CONFIG_ITEMS || config_set(&config_items[i], value, base) != 0)
+            status = lineno;
+    }
+
+    if (status == 0 && ferror(f))
+        status = lineno + 1;
+
+    if (status == 0 && rule != NULL && alert_finish(rule) != 0)
+        status = rule_line;
+
+    fclose(f);
+
+    if (status == 0)
+        *cfg = new_cfg;
+
+    return status;
+}
@@ -0,0 +1,179 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <stdint.h>
+
+/*
+ * Runtime configuration, shared by sensord, query and the monitor scripts.
+ *
+ * The file is in INI format:
+ *
+ *  # comment
+ *  [section]
+ *  key = value
+ *
+ * The C tools read the [receiver], [database], [sensord] and [alerts]
+ * sections, and the [alert NAME] rule sections, and reject unknown keys in
+ * them. From the per-station [station N] sections they only read the
+ * altitude; the rest of those, and other sections such as [monitor], are
+ * for the monitor scripts and are skipped. Anything not given in the file
+ * keeps its default.
+ */
+#define CONFIG_PATH         "/etc/sensors.conf"
+
+/*
+ * The longest string value, including the terminating NUL
+ */
+#define CONFIG_MAX_STRING   64
+
+/*
+ * The most alert rules
+ */
+#define CONFIG_MAX_ALERTS   32
+
+/*
+ * Station altitude not given
+ */
+#define CONFIG_ALTITUDE_UNSET   INT16_MIN
+
+/*
+ * Alert rule kinds
+ */
+#define ALERT_KIND_BELOW    0   /* value below threshold */
+#define ALERT_KIND_ABOVE    1   /* value above threshold */
+#define ALERT_KIND_RATE     2   /* value changing faster than threshold per hour */
+#define ALERT_KIND_STALE    3   /* no message for more than threshold seconds */
+#define ALERT_KIND_GAP      4   /* more than threshold messages missed */
+
+/*
+ * Alert sinks (a bit mask)
+ */
+#define ALERT_SINK_SYSLOG   0x01
+#define ALERT_SINK_SOCKET   0x02
+#define ALERT_SINK_WEBHOOK  0x04
+
+/*
+ * An alert rule, from an [alert NAME] section:
+ *
+ *  station     station ID, or 0 (the default) for all stations
+ *  sensor      sensor type, by name or number, including the derived
+ *              types (derived.h) (not used by stale and gap
+ *              rules, which apply to the station and its counter)
+ *  kind        below, above, rate, stale or gap
+ *  threshold   the alert is raised when the value goes below this (below
+ *              rules) or above it (the rest)
+ *  clear       the alert is cleared when the value gets back to this
+ *              (default: the threshold)
+ *  holdoff     raise the alert at most once in this many seconds
+ *  sinks       comma separated list of syslog, socket and webhook
+ *
+ * Thresholds are in the sensor's raw units (for example 0.1V for battery).
+ */
+typedef struct
+{
+    /** rule name */
+    char                name[CONFIG_MAX_STRING];
+
+    /** station ID, or 0 for all stations */
+    int                 station;
+
+    /** sensor type (WL_SENSOR_TYPE_*) */
+    int                 sensor;
+
+    /** ALERT_KIND_* */
+    int                 kind;
+
+    /** level at which the alert is raised */
+    int32_t             threshold;
+
+    /** level at which the alert is cleared */
+    int32_t             clear;
+
+    /** minimum seconds between raising the alert for a station */
+    int                 holdoff;
+
+    /** ALERT_SINK_* */
+    int                 sinks;
+}
+    config_alert_t;
+
+typedef struct
+{
+    /** I2C device the receiver is attached to */
+    char                i2c_device[CONFIG_MAX_STRING];
+
+    /** receiver I2C slave address */
+    int                 i2c_address;
+
+    /** seconds between polls of the receiver */
+    int                 poll_interval;
+
+    /** host where the MySQL database resides */
+    char                db_host[CONFIG_MAX_STRING];
+
+    /** name of the database */
+    char                db_name[CONFIG_MAX_STRING];
+
+    /** user to connect to the database as (no password) */
+    char                db_user[CONFIG_MAX_STRING];
+
+    /** seconds without a message before a station is regarded as dead */
+    int16_t             station_dead_threshold;
+
+    /** battery level at or below which a warning is logged (0.1V units) */
+    int16_t             battery_low_threshold;
+
+    /** battery level at or above which the warning is cleared (0.1V units) */
+    int16_t             battery_ok_threshold;
+
+    /** local datagram socket for the socket alert sink */
+    char                alert_socket[CONFIG_MAX_STRING];
+
+    /** spool file for the webhook alert sink */
+    char                alert_webhook[CONFIG_MAX_STRING];
+
+    /** station altitude in metres, for stations without their own */
+    int16_t             altitude;
+
+    /** file sensord's event trace is written to on SIGUSR1 */
+    char                trace_file[CONFIG_MAX_STRING];
+
+    /** sensord's control socket */
+    char                control_socket[CONFIG_MAX_STRING];
+
+    /** name of the shared memory segment of station states (livestate.h) */
+    char                shared_state[CONFIG_MAX_STRING];
+
+    /**
+     * if non-zero, only store a reading that repeats the last value stored
+     * for the sensor when that is at least this many seconds old
+     */
+    int                 heartbeat;
+
+    /** seconds between reads of the receiver's diagnostics (0: never) */
+    int                 diagnostics;
+
+    /**
+     * readings further than this many median absolute deviations from the
+     * median of the sensor's recent readings are quarantined (0: never;
+     * see spike.h)
+     */
+    int                 spike_threshold;
+
+    /** altitude in metres by station ID, or CONFIG_ALTITUDE_UNSET */
+    int16_t             station_altitude[256];
+
+    /** alert rules; if there are none, sensord uses its built-in rules */
+    config_alert_t      alerts[CONFIG_MAX_ALERTS];
+
+    /** number of entries in alerts[] */
+    int                 nalerts;
+}
+    config_t;
+
+extern void         config_defaults(config_t *cfg);
+extern int          config_load(const char *path, config_t *cfg);
+extern const char   *config_sensor_name(int type);
+extern int          config_altitude(const config_t *cfg, int station);
+
+#endif /* __CONFIG_H__ */
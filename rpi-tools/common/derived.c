@@ -0,0 +1,155 @@
+/*
+ * Values derived from station readings.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "wireless.h"
+#include "snapshot.h"
+#include "derived.h"
+
+/**
+ * Battery level in percent, by voltage in 0.1V units from BATTERY_LUT_MIN
+ * up. This is a rough discharge curve for a pair of alkaline cells.
+ */
+#define BATTERY_LUT_MIN     20
+
+static const uint8_t    battery_lut[]   =
+{
+    0, 2, 5, 9, 14, 20, 28, 38, 50, 64, 80, 92, 100
+};
+
+#define BATTERY_LUT_ENTRIES (sizeof(battery_lut) / sizeof(battery_lut[0]))
+
+/**
+ * Convert station pressure to sea level pressure, using the barometric
+ * formula for an isothermal atmosphere at the station temperature.
+ * http://hyperphysics.phy-astr.gsu.edu/hbase/kinetic/barfor.html
+ *
+ * @param[in]   pressure        Station pressure (0.1 hPa).
+ * @param[in]   temperature     Station temperature (0.1 C).
+ * @param[in]   altitude        Station altitude (metres).
+ *
+ * @return      the sea level pressure (0.1 hPa).
+ */
+static int32_t
+pressure_msl(int32_t pressure, int32_t temperature, int altitude)
+{
+    const double    m   = 29.0 * 1.66054e-27;   /* mass of an air molecule (29 amu) */
+    const double    g   = 9.8;
+    const double    k   = 1.38066e-23;          /* Boltzmann constant */
+    double          t   = 273.15 + temperature / 10.0;
+
+    return (int32_t)lround(pressure * exp(m * g * altitude / k / t));
+}
+
+/**
+ * Work out the dew point with the Magnus formula.
+ *
+ * @param[in]   temperature     Temperature (0.1 C).
+ * @param[in]   humidity        Relative humidity (0.1 %).
+ *
+ * @return      the dew point (0.1 C).
+ */
+static int32_t
+dew_point(int32_t temperature, int32_t humidity)
+{
+    const double    b   = 17.62;
+    const double    c   = 243.12;
+    double          t   = temperature / 10.0;
+    double          gamma;
+
+    gamma = log(humidity / 1000.0) + b * t / (c + t);
+
+    return (int32_t)lround(10.0 * c * gamma / (b - gamma));
+}
+
+/**
+ * Work out the battery level from its voltage.
+ *
+ * @param[in]   battery     Battery voltage (0.1V).
+ *
+ * @return      the battery level (percent).
+ */
+static int32_t
+battery_level(int32_t battery)
+{
+    if (battery < BATTERY_LUT_MIN)
+        return 0;
+
+    if (battery - BATTERY_LUT_MIN >= (int32_t)BATTERY_LUT_ENTRIES)
+        return 100;
+
+    return battery_lut[battery - BATTERY_LUT_MIN];
+}
+
+/**
+ * Derive values from a set of readings from a station. Each value is only
+ * derived if the readings it needs are all in the set.
+ *
+ * @param[in]   values      The station's readings.
+ * @param[in]   nvalues     The number of readings.
+ * @param[in]   altitude    The station altitude (metres).
+ * @param[out]  derived     The derived values (DERIVED_MAX_VALUES entries).
+ *
+ * @return      the number of derived values.
+ */
+int
+derived_values
+(
+    const snapshot_value_t  *values,
+    int                     nvalues,
+    int                     altitude,
+    snapshot_value_t        *derived
+)
+{
+    const snapshot_value_t  *temperature    = NULL;
+    const snapshot_value_t  *pressure       = NULL;
+    const snapshot_value_t  *humidity       = NULL;
+    const snapshot_value_t  *battery        = NULL;
+    int                     n               = 0;
+    int                     i;
+
+    for (i = 0; i < nvalues; i++)
+    {
+        switch (values[i].type)
+        {
+        case WL_SENSOR_TYPE_TEMPERATURE:
+            temperature = &values[i];
+            break;
+        case WL_SENSOR_TYPE_PRESSURE:
+            pressure = &values[i];
+            break;
+        case WL_SENSOR_TYPE_HUMIDITY:
+            humidity = &values[i];
+            break;
+        case WL_SENSOR_TYPE_BATTERY:
+            battery = &values[i];
+            break;
+        }
+    }
+
+    if (pressure != NULL && temperature != NULL)
+    {
+        derived[n].type = DERIVED_TYPE_PRESSURE_MSL;
+        derived[n].value = pressure_msl(pressure->value, temperature->value, altitude);
+        n++;
+    }
+
+    if (humidity != NULL && temperature != NULL && humidity->value > 0)
+    {
+        derived[n].type = DERIVED_TYPE_DEW_POINT;
+        derived[n].value = dew_point(temperature->value, humidity->value);
+        n++;
+    }
+
+    if (battery != NULL)
+    {
+        derived[n].type = DERIVED_TYPE_BATTERY_LEVEL;
+        derived[n].value = battery_level(battery->value);
+        n++;
+    }
+
+    return n;
+}
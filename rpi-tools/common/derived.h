@@ -0,0 +1,40 @@
+#ifndef __DERIVED_H__
+#define __DERIVED_H__
+
+#include <stdint.h>
+
+#include "wireless.h"
+#include "snapshot.h"
+
+/*
+ * Values derived from a station's readings, rather than sent by it. They
+ * are stored by sensord alongside the raw readings, with sensor types
+ * that can't clash with WL_SENSOR_TYPE_*.
+ */
+#define DERIVED_TYPE_MIN                128
+#define DERIVED_TYPE_PRESSURE_MSL       128     /* 0.1 hPa, at sea level */
+#define DERIVED_TYPE_DEW_POINT          129     /* 0.1 C */
+#define DERIVED_TYPE_BATTERY_LEVEL      130     /* percent */
+#define DERIVED_TYPE_MAX                130
+
+/*
+ * The most derived values from a station's readings
+ */
+#define DERIVED_MAX_VALUES              (DERIVED_TYPE_MAX - DERIVED_TYPE_MIN + 1)
+
+/*
+ * Divisor to convert a value of any type to its natural units
+ */
+#define SENSOR_TYPE_SCALE(TYPE)         \
+    ((TYPE) < DERIVED_TYPE_MIN ? WL_SENSOR_TYPE_SCALE(TYPE) \
+     : (TYPE) == DERIVED_TYPE_BATTERY_LEVEL ? 1 : 10)
+
+extern int  derived_values
+            (
+                const snapshot_value_t  *values,
+                int                     nvalues,
+                int                     altitude,
+                snapshot_value_t        *derived
+            );
+
+#endif /* __DERIVED_H__ */
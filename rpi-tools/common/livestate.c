@@ -0,0 +1,283 @@
+/*
+ * The shared memory segment of station states (see livestate.h).
+ */
+
+#define _POSIX_C_SOURCE 200112L /* for shm_open */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "livestate.h"
+
+/**
+ * How many times a reader tries for a consistent copy before giving up
+ * (sensord would have to be stuck part way through an update)
+ */
+#define LIVESTATE_RETRIES   100000
+
+/**
+ * Create the segment, or take over the one left by an earlier sensord,
+ * and clear it.
+ *
+ * @param[in]   name        The segment name ("/name").
+ *
+ * @return      the segment, or NULL on error (see errno).
+ */
+livestate_t *
+livestate_create(const char *name)
+{
+    livestate_t     *live;
+    int             fd;
+    int             saved_errno;
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT, 0644)) < 0)
+        return NULL;
+
+    if (ftruncate(fd, sizeof(livestate_t)) < 0)
+    {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    live = mmap(NULL, sizeof(livestate_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    saved_errno = errno;
+    close(fd);
+
+    if (live == MAP_FAILED)
+    {
+        errno = saved_errno;
+        return NULL;
+    }
+
+    /*
+     * Readers may have the old contents mapped, so clear it as an update
+     */
+    livestate_begin(live);
+
+    memset((char *)live + offsetof(livestate_t, updated), 0,
+        sizeof(livestate_t) - offsetof(livestate_t, updated));
+
+    live->magic = LIVESTATE_MAGIC;
+    live->version = LIVESTATE_VERSION;
+    live->size = sizeof(livestate_t);
+
+    livestate_end(live);
+
+    return live;
+}
+
+/**
+ * Start an update: readers wait or try again until livestate_end().
+ *
+ * @param[in,out]   live        The segment.
+ */
+void
+livestate_begin(livestate_t *live)
+{
+    __atomic_store_n(&live->seq, live->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Finish an update.
+ *
+ * @param[in,out]   live        The segment.
+ */
+void
+livestate_end(livestate_t *live)
+{
+    __atomic_store_n(&live->seq, live->seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Set a station's latest value for a sensor (between livestate_begin()
+ * and livestate_end()).
+ *
+ * @param[in,out]   station     The station's state.
+ * @param[in]       type        The sensor type.
+ * @param[in]       value       The value.
+ */
+void
+livestate_set(livestate_station_t *station, uint8_t type, int32_t value)
+{
+    int     i;
+
+    for (i = 0; i < station->nvalues; i++)
+    {
+        if (station->values[i].type == type)
+        {
+            station->values[i].value = value;
+            return;
+        }
+    }
+
+    if (station->nvalues < LIVESTATE_MAX_VALUES)
+    {
+        station->values[station->nvalues].type = type;
+        station->values[station->nvalues].value = value;
+        station->nvalues++;
+    }
+}
+
+/**
+ * Unmap the segment and remove it, so readers know sensord has stopped.
+ *
+ * @param[in]   live        The segment, or NULL.
+ * @param[in]   name        The segment name.
+ */
+void
+livestate_remove(livestate_t *live, const char *name)
+{
+    if (live == NULL)
+        return;
+
+    munmap(live, sizeof(livestate_t));
+    shm_unlink(name);
+}
+
+/**
+ * Map the segment for reading.
+ *
+ * @param[in]   name        The segment name ("/name").
+ *
+ * @return      the segment, or NULL on error (see errno; ENOENT if sensord
+ *              hasn't started or has stopped, EPROTO if the segment is a
+ *              different version).
+ */
+const livestate_t *
+livestate_open(const char *name)
+{
+    const livestate_t   *live;
+    struct stat         st;
+    int                 fd;
+    int                 saved_errno;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0)
+    {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    if (st.st_size < (off_t)sizeof(livestate_t))
+    {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    live = mmap(NULL, sizeof(livestate_t), PROT_READ, MAP_SHARED, fd, 0);
+    saved_errno = errno;
+    close(fd);
+
+    if (live == MAP_FAILED)
+    {
+        errno = saved_errno;
+        return NULL;
+    }
+
+    if
+    (
+        live->magic != LIVESTATE_MAGIC
+        ||
+        live->version != LIVESTATE_VERSION
+        ||
+        live->size != sizeof(livestate_t)
+    )
+    {
+        livestate_close(live);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    return live;
+}
+
+/**
+ * Copy part of the segment, consistently.
+ *
+ * @param[in]   live        The segment.
+ * @param[in]   from        The part to copy.
+ * @param[out]  to          Where to copy it.
+ * @param[in]   length      The size of the part.
+ *
+ * @return      true for success, false if sensord seems stuck in an update
+ *              (errno is EAGAIN).
+ */
+static bool
+livestate_copy(const livestate_t *live, const void *from, void *to, size_t length)
+{
+    uint32_t    seq;
+    int         i;
+
+    for (i = 0; i < LIVESTATE_RETRIES; i++)
+    {
+        seq = __atomic_load_n(&live->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+
+        memcpy(to, from, length);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&live->seq, __ATOMIC_RELAXED) == seq)
+            return true;
+    }
+
+    errno = EAGAIN;
+    return false;
+}
+
+/**
+ * Take a consistent copy of the whole segment.
+ *
+ * @param[in]   live        The segment.
+ * @param[out]  copy        The copy.
+ *
+ * @return      true for success, false if sensord seems stuck in an update.
+ */
+bool
+livestate_read(const livestate_t *live, livestate_t *copy)
+{
+    return livestate_copy(live, live, copy, sizeof(livestate_t));
+}
+
+/**
+ * Take a consistent copy of one station's state.
+ *
+ * @param[in]   live        The segment.
+ * @param[in]   id          The station ID.
+ * @param[out]  copy        The copy.
+ *
+ * @return      true for success, false if sensord seems stuck in an update.
+ */
+bool
+livestate_station(const livestate_t *live, int id, livestate_station_t *copy)
+{
+    return livestate_copy(live, &live->stations[id & 0xff], copy, sizeof(livestate_station_t));
+}
+
+/**
+ * Unmap the segment.
+ *
+ * @param[in]   live        The segment, or NULL.
+ */
+void
+livestate_close(const livestate_t *live)
+{
+    if (live != NULL)
+        munmap((void *)live, sizeof(livestate_t));
+}
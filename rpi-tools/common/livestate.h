@@ -0,0 +1,132 @@
+#ifndef __LIVESTATE_H__
+#define __LIVESTATE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "snapshot.h"
+#include "derived.h"
+
+/*
+ * The current state of every station, published by sensord in a POSIX
+ * shared memory segment (shared_state in the configuration), so local
+ * readers can have it without going to the receiver or the database.
+ *
+ * sensord rewrites the segment after each poll under a seqlock: seq is odd
+ * while an update is in progress, and goes up by two for each update. A
+ * reader copies what it wants, and tries again if seq was odd or changed
+ * meanwhile (livestate_read() and livestate_station() do this). The
+ * segment is only written by sensord; readers map it read only.
+ *
+ * The layout is fixed for a given LIVESTATE_VERSION.
+ */
+#define LIVESTATE_MAGIC         0x53534652  /* "RFSS" */
+#define LIVESTATE_VERSION       1
+
+/*
+ * The most values kept for a station: its readings and the values derived
+ * from them
+ */
+#define LIVESTATE_MAX_VALUES    (SNAPSHOT_MAX_VALUES + DERIVED_MAX_VALUES)
+
+/*
+ * Station flags
+ */
+#define LIVESTATE_STALE         0x01    /* no message for station_dead seconds */
+#define LIVESTATE_BATTERY_LOW   0x02    /* battery at or below battery_low */
+
+typedef struct
+{
+    /** sensor type (WL_SENSOR_TYPE_* or DERIVED_TYPE_*) */
+    uint8_t             type;
+
+    uint8_t             reserved[3];
+
+    /** sensor value, in the sensor's raw units */
+    int32_t             value;
+}
+    livestate_value_t;
+
+typedef struct
+{
+    /** set once a message has been seen from the station */
+    uint8_t             valid;
+
+    /** LIVESTATE_* flags */
+    uint8_t             flags;
+
+    /** number of entries in values[] */
+    uint8_t             nvalues;
+
+    uint8_t             reserved;
+
+    /** the station's message counter, or -1 if it doesn't send one */
+    int32_t             seqno;
+
+    /** when the last message was received (ms since the epoch) */
+    int64_t             received;
+
+    /** messages received since sensord started */
+    uint32_t            messages;
+
+    /** messages missed, from gaps in the counter */
+    uint32_t            missed;
+
+    /** the latest value of each sensor, in the order first seen */
+    livestate_value_t   values[LIVESTATE_MAX_VALUES];
+}
+    livestate_station_t;
+
+typedef struct
+{
+    /** LIVESTATE_MAGIC */
+    uint32_t            magic;
+
+    /** LIVESTATE_VERSION */
+    uint32_t            version;
+
+    /** sizeof(livestate_t) */
+    uint32_t            size;
+
+    /** the seqlock sequence number: odd while being updated */
+    uint32_t            seq;
+
+    /** when the receiver was last polled (ms since the epoch) */
+    int64_t             updated;
+
+    /** receiver polls since sensord started */
+    uint32_t            polls;
+
+    /** the receiver's clock at the last poll, in ticks */
+    uint32_t            rx_clock;
+
+    /** the measured length of a receiver clock tick, in nanoseconds */
+    double              tick_ns;
+
+    /** station states, indexed by station ID */
+    livestate_station_t stations[256];
+}
+    livestate_t;
+
+extern livestate_t          *livestate_create(const char *name);
+extern void                 livestate_begin(livestate_t *live);
+extern void                 livestate_end(livestate_t *live);
+extern void                 livestate_set
+                            (
+                                livestate_station_t *station,
+                                uint8_t             type,
+                                int32_t             value
+                            );
+extern void                 livestate_remove(livestate_t *live, const char *name);
+
+extern const livestate_t    *livestate_open(const char *name);
+extern bool                 livestate_read(const livestate_t *live, livestate_t *copy);
+extern bool                 livestate_station
+                            (
+                                const livestate_t   *live,
+                                int                 id,
+                                livestate_station_t *copy
+                            );
+extern void                 livestate_close(const livestate_t *live);
+
+#endif /* __LIVESTATE_H__ */
@@ -0,0 +1,259 @@
+/*
+ * Reading snapshots from the receiver (see receiver.h).
+ */
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "receiver.h"
+
+/**
+ * How many times to read an older receiver's snapshot again, if it grew
+ * between reading the header and the rest of it.
+ */
+#define RECEIVER_RETRIES        3
+
+/**
+ * Get a little-endian 16-bit integer.
+ */
+static uint16_t
+get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/**
+ * Get a little-endian 32-bit integer.
+ */
+static uint32_t
+get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Open the I2C connection to the receiver.
+ *
+ * @param[in]   cfg     The configuration.
+ *
+ * @return      the file descriptor, or -1 on error (see errno).
+ */
+int
+receiver_open(const config_t *cfg)
+{
+    int     fd;
+    int     saved_errno;
+
+    if ((fd = open(cfg->i2c_device, O_RDWR)) < 0)
+        return -1;
+
+    if (ioctl(fd, I2C_SLAVE, (long)cfg->i2c_address) < 0)
+    {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Send the receiver a command byte, then read from it, as one transaction
+ * (so nothing else on the bus can come between the two).
+ *
+ * @param[in]   fd          The I2C file descriptor.
+ * @param[in]   address     The receiver's I2C address.
+ * @param[in]   command     The command (RECEIVER_CMD_*).
+ * @param[out]  data        Where to put the bytes read.
+ * @param[in]   length      The number of bytes to read.
+ *
+ * @return      0 for success, or -1 on error (see errno).
+ */
+static int
+receiver_transfer(int fd, int address, uint8_t command, uint8_t *data, int length)
+{
+    struct i2c_msg              msgs[2];
+    struct i2c_rdwr_ioctl_data  transfer;
+
+    msgs[0].addr = address;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &command;
+
+    msgs[1].addr = address;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = length;
+    msgs[1].buf = data;
+
+    transfer.msgs = msgs;
+    transfer.nmsgs = 2;
+
+    return ioctl(fd, I2C_RDWR, &transfer) < 0 ? -1 : 0;
+}
+
+/**
+ * Work out the length of a snapshot from its header.
+ *
+ * @param[in]   header      The first RECEIVER_HEADER_LEN bytes of the snapshot.
+ *
+ * @return      the length of the snapshot, or 0 if the type isn't recognised.
+ */
+static int
+receiver_length(const uint8_t *header)
+{
+    switch (header[0])
+    {
+    case SNAPSHOT_TYPE_V0:
+        return 2 + header[1];
+
+    case SNAPSHOT_TYPE_V1:
+    case SNAPSHOT_TYPE_V2:
+        return 3 + (header[1] | (header[2] << 8));
+
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Read a snapshot from the receiver: the header, then exactly the rest of
+ * the snapshot.
+ *
+ * @param[in]   fd          The I2C file descriptor (see receiver_open()).
+ * @param[in]   address     The receiver's I2C address.
+ * @param[out]  snapshot    Where to put the snapshot.
+ * @param[in]   size        The size of snapshot[]; at least RECEIVER_HEADER_LEN.
+ *
+ * @return      the length of the snapshot, or -1 on error (see errno;
+ *              EMSGSIZE if the snapshot is too big for snapshot[], EAGAIN
+ *              if it kept changing). An unrecognised snapshot is returned
+ *              as just its header.
+ */
+int
+receiver_read(int fd, int address, void *snapshot, int size)
+{
+    uint8_t     *data = snapshot;
+    uint8_t     header[RECEIVER_HEADER_LEN];
+    int         length;
+    int         retries;
+    int         n;
+
+    if (receiver_transfer(fd, address, RECEIVER_CMD_SNAPSHOT, data, RECEIVER_HEADER_LEN) < 0)
+        return -1;
+
+    if ((length = receiver_length(data)) == 0)
+        return RECEIVER_HEADER_LEN;
+
+    for (retries = 0; ; retries++)
+    {
+        if (length > size)
+        {
+            errno = EMSGSIZE;
+            return -1;
+        }
+
+        if (length <= RECEIVER_HEADER_LEN)
+            return length;
+
+        /*
+         * The receiver carries on from the end of the header, after
+         * repeating the length. If it sends a new snapshot instead (it gave
+         * up waiting, or reset), read that in full.
+         */
+        if (data[0] == SNAPSHOT_TYPE_V2 && retries == 0)
+        {
+            memcpy(header, data, RECEIVER_HEADER_LEN);
+
+            if
+            (
+                receiver_transfer(fd, address, RECEIVER_CMD_CONTINUE,
+                    data, length) < 0
+            )
+                return -1;
+
+            if
+            (
+                data[0] == RECEIVER_RESUME_TYPE
+                &&
+                data[1] == header[1]
+                &&
+                data[2] == header[2]
+            )
+            {
+                data[0] = header[0];
+                return length;
+            }
+        }
+
+        /*
+         * Older receivers start a new snapshot on every read, so read it
+         * all again. It may have grown in the meantime.
+         */
+        if (receiver_transfer(fd, address, RECEIVER_CMD_SNAPSHOT, data, length) < 0)
+            return -1;
+
+        if ((n = receiver_length(data)) == 0)
+            return length;
+
+        if (n <= length)
+            return n;
+
+        if (retries == RECEIVER_RETRIES)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        length = n;
+    }
+}
+
+/**
+ * Read the receiver's diagnostics.
+ *
+ * @param[in]   fd          The I2C file descriptor (see receiver_open()).
+ * @param[in]   address     The receiver's I2C address.
+ * @param[out]  diag        The diagnostics.
+ *
+ * @return      0 for success, or -1 on error (see errno; ENOTSUP if the
+ *              receiver doesn't send diagnostics).
+ */
+int
+receiver_diagnostics(int fd, int address, receiver_diag_t *diag)
+{
+    uint8_t     data[RECEIVER_DIAG_LEN];
+
+    if (receiver_transfer(fd, address, RECEIVER_CMD_DIAGNOSTICS, data, sizeof(data)) < 0)
+        return -1;
+
+    if (data[0] != RECEIVER_DIAG_TYPE)
+    {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if ((data[1] | (data[2] << 8)) != RECEIVER_DIAG_LEN - 3)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    diag->clock = get_u32(data + 3);
+    diag->reset_cause = data[7];
+    diag->watchdog_timeouts = get_u16(data + 8);
+    diag->uptime = get_u32(data + 10);
+    diag->overruns = get_u16(data + 14);
+    diag->errors = get_u16(data + 16);
+    diag->dropped = get_u16(data + 18);
+    diag->sram_free = get_u16(data + 20);
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef __RECEIVER_H__
+#define __RECEIVER_H__
+
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Reading snapshots from the receiver over I2C. A snapshot is read in two
+ * parts: its header, to find how long it is, then the rest of it, so only
+ * as many bytes as it holds cross the bus.
+ *
+ * Each read is a combined write/read transaction. The byte written tells
+ * the receiver whether to start a new snapshot or carry on with the one
+ * already part read (receivers sending SNAPSHOT_TYPE_V2 snapshots; older
+ * receivers start again from the top on every read).
+ */
+#define RECEIVER_CMD_SNAPSHOT   0x01    /* start a new snapshot */
+#define RECEIVER_CMD_CONTINUE   0x02    /* carry on with the current snapshot */
+#define RECEIVER_CMD_DIAGNOSTICS 0x03   /* read the diagnostics instead */
+
+/*
+ * Enough to find the length of any snapshot type
+ */
+#define RECEIVER_HEADER_LEN     3
+
+/*
+ * A read carrying on with a snapshot starts with RECEIVER_RESUME_TYPE and
+ * the snapshot's length again (RECEIVER_HEADER_LEN bytes in all), so that
+ * it can't be mistaken for the start of a new snapshot.
+ */
+#define RECEIVER_RESUME_TYPE    0x06
+
+/*
+ * The receiver's diagnostics (see rpi-receiver/main.c for the message).
+ * Receivers from before they were added send a snapshot instead.
+ */
+#define RECEIVER_DIAG_TYPE      0x05
+#define RECEIVER_DIAG_LEN       22
+
+/*
+ * Reset causes (the receiver's MCUSR)
+ */
+#define RECEIVER_RESET_POWER    0x01
+#define RECEIVER_RESET_EXTERNAL 0x02
+#define RECEIVER_RESET_BROWNOUT 0x04
+#define RECEIVER_RESET_WATCHDOG 0x08
+
+typedef struct
+{
+    uint32_t    clock;              /* the receiver's clock, in ticks */
+    uint8_t     reset_cause;        /* RECEIVER_RESET_* bits */
+    uint16_t    watchdog_timeouts;  /* ever */
+    uint32_t    uptime;             /* seconds since reset */
+    uint16_t    overruns;           /* frames ignored while a message waited */
+    uint16_t    errors;             /* frames with a bad CRC */
+    uint16_t    dropped;            /* messages with no station slot free */
+    uint16_t    sram_free;          /* least free SRAM since reset, in bytes */
+}
+    receiver_diag_t;
+
+extern int  receiver_open(const config_t *cfg);
+
+extern int  receiver_read(int fd, int address, void *snapshot, int size);
+
+extern int  receiver_diagnostics(int fd, int address, receiver_diag_t *diag);
+
+#endif /* __RECEIVER_H__ */
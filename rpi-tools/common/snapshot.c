@@ -0,0 +1,225 @@
+/*
+ * Parser for snapshots read from the RPi receiver.
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "wireless.h"
+#include "snapshot.h"
+
+/**
+ * Work out how much of a read actually holds the snapshot. The I2C read
+ * returns however many bytes were asked for, and the rest is padding.
+ *
+ * @param[in]   snapshot        The snapshot data.
+ * @param[in]   length          The number of bytes read.
+ *
+ * @return      the length of the snapshot, or length if the snapshot isn't
+ *              recognised or claims to be longer than the read.
+ */
+int
+snapshot_length(const uint8_t *snapshot, int length)
+{
+    int     n;
+
+    if (length >= 2 && snapshot[0] == SNAPSHOT_TYPE_V0)
+        n = 2 + snapshot[1];
+    else
+    if
+    (
+        length >= 3
+        &&
+        (snapshot[0] == SNAPSHOT_TYPE_V1 || snapshot[0] == SNAPSHOT_TYPE_V2)
+    )
+        n = 3 + (snapshot[1] | (snapshot[2] << 8));
+    else
+        return length;
+
+    return n <= length ? n : length;
+}
+
+/**
+ * Get the receiver's clock from a snapshot, for working out how the
+ * receiver's clock is running against ours.
+ *
+ * @param[in]   snapshot        The snapshot data.
+ * @param[in]   length          The number of bytes read.
+ * @param[out]  clock           The receiver's clock, in ticks.
+ *
+ * @return      1 if the snapshot holds the receiver's clock, 0 if not
+ *              (older snapshot formats don't).
+ */
+int
+snapshot_clock(const uint8_t *snapshot, int length, uint32_t *clock)
+{
+    if (length < 7 || snapshot[0] != SNAPSHOT_TYPE_V2)
+        return 0;
+
+    *clock = (uint32_t)snapshot[3]
+            | ((uint32_t)snapshot[4] << 8)
+            | ((uint32_t)snapshot[5] << 16)
+            | ((uint32_t)snapshot[6] << 24);
+
+    return 1;
+}
+
+/**
+ * Work out how many messages a station sent that were missed between two
+ * of its COUNTER values. The counter wraps at WL_COUNTER_MASK, so a wrap
+ * is a small step forward; a step of more than half the counter's range
+ * is taken as the station having reset (a backwards jump to near 0), and
+ * only the messages it sent since the reset are counted as missed.
+ *
+ * @param[in]   seqno           The new counter value.
+ * @param[in]   last            The previous counter value.
+ *
+ * @return      the number of messages missed.
+ */
+int32_t
+snapshot_missed(int32_t seqno, int32_t last)
+{
+    int32_t     step    = (seqno - last) & WL_COUNTER_MASK;
+
+    if (step == 0)
+        return 0;
+
+    if (step > WL_COUNTER_MASK / 2)
+        return seqno & WL_COUNTER_MASK;
+
+    return step - 1;
+}
+
+/**
+ * Parse a snapshot of the receiver's station table.
+ *
+ * The current (SNAPSHOT_TYPE_V2) and the older (SNAPSHOT_TYPE_V1 and
+ * SNAPSHOT_TYPE_V0) snapshot formats are accepted. Ages are given both in
+ * seconds and in receiver clock ticks, whichever the snapshot holds.
+ * Nothing is read beyond the end of the snapshot, or beyond the length it
+ * claims for itself.
+ *
+ * @param[in]   snapshot        The snapshot data.
+ * @param[in]   length          The number of bytes read.
+ * @param[out]  stations        The parsed stations.
+ * @param[in]   max_stations    The number of entries in stations[].
+ *
+ * @return      the number of stations, or -1 if the snapshot is malformed.
+ */
+int
+snapshot_parse
+(
+    const uint8_t       *snapshot,
+    int                 length,
+    snapshot_station_t  *stations,
+    int                 max_stations
+)
+{
+    const uint8_t   *p;
+    const uint8_t   *end;
+    int             n_stations;
+    int             claimed;
+    int             age_len;
+    uint64_t        secs;
+    uint8_t         version;
+    uint8_t         i;
+    int             n;
+
+    if (length < 3)
+        return -1;
+
+    if (snapshot[0] == SNAPSHOT_TYPE_V0)
+    {
+        claimed = snapshot[1];
+        p = snapshot + 2;
+    }
+    else
+    if (snapshot[0] == SNAPSHOT_TYPE_V1 && length >= 4)
+    {
+        claimed = snapshot[1] | (snapshot[2] << 8);
+        p = snapshot + 3;
+    }
+    else
+    if (snapshot[0] == SNAPSHOT_TYPE_V2 && length >= 8)
+    {
+        claimed = snapshot[1] | (snapshot[2] << 8);
+        p = snapshot + 3;
+    }
+    else
+        return -1;
+
+    /*
+     * The length covers the clock, the station count and the stations
+     */
+    if (claimed < 1 || p + claimed > snapshot + length)
+        return -1;
+
+    end = p + claimed;
+
+    if (snapshot[0] == SNAPSHOT_TYPE_V2)
+    {
+        if (claimed < 5)
+            return -1;
+
+        p += 4;
+        age_len = 4;
+    }
+    else
+        age_len = 2;
+    n_stations = *p++;
+
+    if (n_stations > max_stations)
+        return -1;
+
+    for (n = 0; n < n_stations; n++)
+    {
+        snapshot_station_t  *st = &stations[n];
+
+        if (end - p < WL_SENSOR_MSG_HDR_LEN)
+            return -1;
+
+        st->id = p[0];
+        st->nvalues = WL_SENSOR_MSG_COUNT(p);
+        version = WL_SENSOR_MSG_VERSION(p);
+        p += WL_SENSOR_MSG_HDR_LEN;
+
+        if
+        (
+            version > WL_SENSOR_MSG_VERSION_1
+            ||
+            (snapshot[0] == SNAPSHOT_TYPE_V0 && version != WL_SENSOR_MSG_VERSION_0)
+        )
+            return -1;
+
+        for (i = 0; i < st->nvalues; i++)
+        {
+            p = wl_sensor_get_value(p, end, version,
+                    &st->values[i].type, &st->values[i].value);
+
+            if (p == NULL)
+                return -1;
+        }
+
+        if (end - p < age_len)
+            return -1;
+
+        if (age_len == 4)
+        {
+            st->age_ticks = (uint32_t)p[0]
+                        | ((uint32_t)p[1] << 8)
+                        | ((uint32_t)p[2] << 16)
+                        | ((uint32_t)p[3] << 24);
+
+            secs = (uint64_t)st->age_ticks * SNAPSHOT_TICK_NS / 1000000000;
+            st->age = secs > UINT16_MAX ? UINT16_MAX : (uint16_t)secs;
+        }
+        else
+        {
+            st->age = p[0] | (p[1] << 8);
+            st->age_ticks = (uint32_t)((uint64_t)st->age * 1000000000 / SNAPSHOT_TICK_NS);
+        }
+
+        p += age_len;
+    }
+
+    return n_stations;
+}
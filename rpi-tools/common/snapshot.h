@@ -0,0 +1,88 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdint.h>
+
+/*
+ * Snapshots of the receiver's station table, as read over I2C
+ * (integers are LSB first):
+ *
+ *  1   snapshot type (SNAPSHOT_TYPE_*)
+ *  1/2 length of the rest of the snapshot (1 byte for SNAPSHOT_TYPE_V0)
+ *  4   the receiver's clock, in ticks (SNAPSHOT_TYPE_V2 only)
+ *  1   number of stations
+ *
+ *  per station:
+ *  1   station id
+ *  1   message version and number of sensors (see wireless.h)
+ *  n   sensor type and value, per sensor
+ *  2/4 age of the message, in seconds (SNAPSHOT_TYPE_V0/V1) or in receiver
+ *      clock ticks (4 bytes, SNAPSHOT_TYPE_V2)
+ *
+ * SNAPSHOT_TYPE_V0 snapshots come from older receivers, and only carry
+ * version 0 messages.
+ */
+#define SNAPSHOT_TYPE_V0        0x01
+#define SNAPSHOT_TYPE_V1        0x03
+#define SNAPSHOT_TYPE_V2        0x04
+
+/*
+ * The nominal length of a receiver clock tick, in nanoseconds (1024 cycles
+ * of the receiver's 10MHz crystal). The clock is 32 bits, and wraps.
+ */
+#define SNAPSHOT_TICK_NS        102400
+
+/*
+ * The most values a station can report (the message count is 4 bits)
+ */
+#define SNAPSHOT_MAX_VALUES     15
+
+/*
+ * The most stations in a snapshot
+ */
+#define SNAPSHOT_MAX_STATIONS   255
+
+typedef struct
+{
+    /** sensor type (WL_SENSOR_TYPE_*) */
+    uint8_t             type;
+
+    /** sensor value */
+    int32_t             value;
+}
+    snapshot_value_t;
+
+typedef struct
+{
+    /** station ID */
+    uint8_t             id;
+
+    /** number of entries in values[] */
+    uint8_t             nvalues;
+
+    /** sensor values */
+    snapshot_value_t    values[SNAPSHOT_MAX_VALUES];
+
+    /** age of the station's last message, in seconds */
+    uint16_t            age;
+
+    /** age of the station's last message, in receiver clock ticks */
+    uint32_t            age_ticks;
+}
+    snapshot_station_t;
+
+extern int  snapshot_length(const uint8_t *snapshot, int length);
+
+extern int  snapshot_clock(const uint8_t *snapshot, int length, uint32_t *clock);
+
+extern int32_t  snapshot_missed(int32_t seqno, int32_t last);
+
+extern int  snapshot_parse
+            (
+                const uint8_t       *snapshot,
+                int                 length,
+                snapshot_station_t  *stations,
+                int                 max_stations
+            );
+
+#endif /* __SNAPSHOT_H__ */
@@ -0,0 +1,1279 @@
+/*
+ * Bulk export and import of the sensor table.
+ *
+ * An export splits a time range into chunks and reads them over several
+ * database connections at once, each through a server-side cursor, into a
+ * compact dump file. An import loads a dump file the same way, each
+ * connection inserting whole chunks in multi-row batches.
+ *
+ * gcc -Wall -I../../include -I../common -o dbcopy dbcopy.c ../common/config.c -L/usr/lib64/mysql -lmysqlclient -lpthread
+ *
+ * The dump file is an 8-byte header ("RFSD", version, three zero bytes),
+ * then one block per chunk, in the order the chunks were read:
+ *
+ *  int64_t     start       Start of the chunk (ms since the epoch, UTC)
+ *  int64_t     end         End of the chunk (ms, exclusive)
+ *  uint32_t    rows        Number of rows
+ *  uint32_t    length      Length of the data that follows
+ *
+ *  uint8_t     station[rows]
+ *  uint8_t     sensor[rows]
+ *  varint      timestamp[rows] Each less the one before (the first less start)
+ *  varint      value[rows]     Zigzag encoded
+ *
+ * Integers are little endian, and varints are base-128 with the low groups
+ * first. Rows take around 6 bytes rather than the 14 of their fields.
+ *
+ * Both directions set the session time zone to UTC, so a datetime is
+ * copied unchanged whatever the zone of either server; the times in a dump
+ * (and those given with -s and -t) are the stored times read as UTC.
+ */
+
+#define _DEFAULT_SOURCE     /* for timegm */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <mysql/mysql.h>
+
+#include "config.h"
+
+#define DUMP_MAGIC          "RFSD"
+#define DUMP_VERSION        1
+#define DUMP_HDR_LEN        8
+#define BLOCK_HDR_LEN       24
+
+/**
+ * The longest a row's data can be: station, sensor, and the varints
+ */
+#define BLOCK_ROW_MAX       (1 + 1 + 10 + 5)
+
+/**
+ * The most connections used at once
+ */
+#define COPY_MAX_JOBS       32
+
+/**
+ * Rows per insert statement on import
+ */
+#define IMPORT_BATCH        1000
+
+/**
+ * The longest a row can be in an insert statement:
+ * "('YYYY-MM-DD HH:MM:SS.mmm',255,255,-2147483648),"
+ */
+#define IMPORT_ROW_MAX      64
+
+/**
+ * Rows the export cursor fetches from the server at a time
+ */
+#define EXPORT_PREFETCH     4096
+
+/**
+ * The text of the export query. Rows come in timestamp order, which keeps
+ * the timestamp deltas small (and never negative).
+ */
+static const char   *SQL_EXPORT     = "select cast(unix_timestamp(timestamp) * 1000 as signed), station, sensor, value"
+                                        " from sensor"
+                                        " where timestamp >= from_unixtime(? / 1000) and timestamp < from_unixtime(? / 1000)"
+                                        " order by timestamp";
+
+/**
+ * The text of the query for the range of the table, if none is given.
+ */
+static const char   *SQL_RANGE      = "select cast(unix_timestamp(min(timestamp)) * 1000 as signed),"
+                                        " cast(unix_timestamp(max(timestamp)) * 1000 as signed)"
+                                        " from sensor";
+
+static const char   *SQL_INSERT     = "insert into sensor (timestamp, station, sensor, value) values ";
+
+/**
+ * The rows of a chunk, one array per column, and its encoded block.
+ */
+typedef struct
+{
+    int64_t         *timestamp;
+    uint8_t         *station;
+    uint8_t         *sensor;
+    int32_t         *value;
+    uint32_t        rows;
+    uint32_t        size;           /* rows the arrays have room for */
+    uint8_t         *data;          /* the block, header first */
+    size_t          data_size;
+} columns_t;
+
+/**
+ * Where a block is in a dump file being imported.
+ */
+typedef struct
+{
+    off_t           offset;         /* of the block's data */
+    uint32_t        rows;
+    uint32_t        length;
+    int64_t         start;
+    int64_t         end;
+} block_t;
+
+/**
+ * The state shared by the threads of an export or import.
+ */
+typedef struct
+{
+    const config_t  *cfg;
+    pthread_mutex_t lock;
+    FILE            *out;           /* export: the dump file */
+    int             fd;             /* import: the dump file */
+    int64_t         start;          /* export: the range, and its chunks */
+    int64_t         end;
+    int64_t         span;
+    int             nchunks;
+    block_t         *blocks;        /* import: the blocks in the file */
+    int             next;           /* the next chunk or block to do */
+    unsigned long   rows;
+    uint64_t        bytes;
+    bool            failed;
+} copy_t;
+
+static const char   *prog;
+
+/**
+ * Get a little-endian 32-bit integer.
+ */
+static uint32_t
+get_u32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * Get a little-endian 64-bit integer.
+ */
+static uint64_t
+get_u64(const uint8_t *p)
+{
+    return get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+/**
+ * Put a little-endian 32-bit integer.
+ */
+static void
+put_u32(uint8_t *p, uint32_t v)
+{
+    int         i;
+
+    for (i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+/**
+ * Put a little-endian 64-bit integer.
+ */
+static void
+put_u64(uint8_t *p, uint64_t v)
+{
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+/**
+ * Put a varint.
+ *
+ * @return      the address after it.
+ */
+static uint8_t *
+put_varint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+
+    *p++ = (uint8_t)v;
+
+    return p;
+}
+
+/**
+ * Get a varint.
+ *
+ * @param[in]   p       The varint.
+ * @param[in]   end     The end of the data it is in.
+ * @param[out]  v       The value.
+ *
+ * @return      the address after it, or NULL if it is cut short or too long.
+ */
+static const uint8_t *
+get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    int         shift   = 0;
+
+    *v = 0;
+
+    while (p < end && shift < 64)
+    {
+        *v |= (uint64_t)(*p & 0x7f) << shift;
+
+        if ((*p++ & 0x80) == 0)
+            return p;
+
+        shift += 7;
+    }
+
+    return NULL;
+}
+
+/**
+ * Get the time now, in seconds, for the throughput figures.
+ */
+static double
+elapsed_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Parse a time as "YYYY-MM-DD[ HH:MM[:SS]]", taken as UTC (see above).
+ *
+ * @param[in]   s       The time.
+ * @param[out]  ms      The time, in milliseconds since the epoch.
+ *
+ * @return      true if the time is valid.
+ */
+static bool
+parse_time(const char *s, int64_t *ms)
+{
+    struct tm   tm;
+    int         n;
+
+    memset(&tm, 0, sizeof(tm));
+
+    n = sscanf(s, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+            &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+
+    if (n != 3 && n != 5 && n != 6)
+        return false;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+
+    *ms = (int64_t)timegm(&tm) * 1000;
+
+    return true;
+}
+
+/**
+ * Connect to the database, with the session time zone set to UTC.
+ *
+ * @param[in]   cfg     The configuration (for the database connection).
+ *
+ * @return      the connection, or NULL on failure.
+ */
+static MYSQL *
+copy_connect(const config_t *cfg)
+{
+    MYSQL       *inst;
+
+    if ((inst = mysql_init(NULL)) == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", prog);
+        return NULL;
+    }
+
+    if
+    (
+        mysql_real_connect(inst, cfg->db_host, cfg->db_user, NULL, cfg->db_name, 0, NULL, 0) == NULL
+        ||
+        mysql_query(inst, "set time_zone = '+00:00'") != 0
+    )
+    {
+        fprintf(stderr, "%s: connecting to %s: %s\n", prog, cfg->db_host, mysql_error(inst));
+        mysql_close(inst);
+        return NULL;
+    }
+
+    return inst;
+}
+
+/**
+ * Record that a thread has failed, so that the others stop.
+ */
+static void
+copy_fail(copy_t *copy)
+{
+    pthread_mutex_lock(&copy->lock);
+    copy->failed = true;
+    pthread_mutex_unlock(&copy->lock);
+}
+
+/**
+ * Take the next chunk (export) or block (import) to do.
+ *
+ * @param[in]   copy    The export or import.
+ * @param[in]   rows    The rows done with the last one.
+ * @param[in]   bytes   The bytes written or read for the last one.
+ *
+ * @return      its index, or -1 if there are none left or a thread has failed.
+ */
+static int
+copy_next(copy_t *copy, uint32_t rows, uint32_t bytes)
+{
+    int         next    = -1;
+
+    pthread_mutex_lock(&copy->lock);
+
+    copy->rows += rows;
+    copy->bytes += bytes;
+
+    if (!copy->failed && copy->next < copy->nchunks)
+        next = copy->next++;
+
+    pthread_mutex_unlock(&copy->lock);
+
+    return next;
+}
+
+/**
+ * Make room for another row in a chunk's columns.
+ *
+ * @return      false if out of memory.
+ */
+static bool
+columns_grow(columns_t *cols)
+{
+    uint32_t    size    = cols->size ? cols->size * 2 : 4096;
+    void        *p;
+
+    if ((p = realloc(cols->timestamp, size * sizeof(int64_t))) == NULL)
+        return false;
+    cols->timestamp = p;
+
+    if ((p = realloc(cols->station, size)) == NULL)
+        return false;
+    cols->station = p;
+
+    if ((p = realloc(cols->sensor, size)) == NULL)
+        return false;
+    cols->sensor = p;
+
+    if ((p = realloc(cols->value, size * sizeof(int32_t))) == NULL)
+        return false;
+    cols->value = p;
+
+    cols->size = size;
+
+    return true;
+}
+
+/**
+ * Make sure a chunk's block buffer can hold a block of a given size.
+ *
+ * @return      false if out of memory.
+ */
+static bool
+columns_reserve(columns_t *cols, size_t size)
+{
+    void        *p;
+
+    if (size <= cols->data_size)
+        return true;
+
+    if ((p = realloc(cols->data, size)) == NULL)
+        return false;
+
+    cols->data = p;
+    cols->data_size = size;
+
+    return true;
+}
+
+static void
+columns_free(columns_t *cols)
+{
+    free(cols->timestamp);
+    free(cols->station);
+    free(cols->sensor);
+    free(cols->value);
+    free(cols->data);
+}
+
+/**
+ * Encode a chunk's rows as a block.
+ *
+ * @param[in]   cols    The rows (with room in data for the block).
+ * @param[in]   start   The start of the chunk.
+ * @param[in]   end     The end of the chunk.
+ *
+ * @return      the length of the block, including its header.
+ */
+static size_t
+block_encode(columns_t *cols, int64_t start, int64_t end)
+{
+    uint8_t     *p      = cols->data + BLOCK_HDR_LEN;
+    int64_t     last    = start;
+    uint32_t    i;
+
+    memcpy(p, cols->station, cols->rows);
+    p += cols->rows;
+    memcpy(p, cols->sensor, cols->rows);
+    p += cols->rows;
+
+    for (i = 0; i < cols->rows; i++)
+    {
+        p = put_varint(p, (uint64_t)(cols->timestamp[i] - last));
+        last = cols->timestamp[i];
+    }
+
+    for (i = 0; i < cols->rows; i++)
+        p = put_varint(p, ((uint32_t)cols->value[i] << 1) ^ (uint32_t)(cols->value[i] >> 31));
+
+    put_u64(cols->data, (uint64_t)start);
+    put_u64(cols->data + 8, (uint64_t)end);
+    put_u32(cols->data + 16, cols->rows);
+    put_u32(cols->data + 20, (uint32_t)(p - cols->data - BLOCK_HDR_LEN));
+
+    return p - cols->data;
+}
+
+/**
+ * Decode a block's data into its rows.
+ *
+ * @param[in]   block   The block.
+ * @param[in]   cols    The columns (with room for the rows), and the data.
+ *
+ * @return      true if the data is valid.
+ */
+static bool
+block_decode(const block_t *block, columns_t *cols)
+{
+    const uint8_t   *p      = cols->data;
+    const uint8_t   *end    = cols->data + block->length;
+    int64_t         last    = block->start;
+    uint64_t        v;
+    uint32_t        i;
+
+    if (block->length < 2 * (size_t)block->rows)
+        return false;
+
+    memcpy(cols->station, p, block->rows);
+    p += block->rows;
+    memcpy(cols->sensor, p, block->rows);
+    p += block->rows;
+
+    for (i = 0; i < block->rows; i++)
+    {
+        if ((p = get_varint(p, end, &v)) == NULL)
+            return false;
+
+        last += (int64_t)v;
+        if (last >= block->end)
+            return false;
+
+        cols->timestamp[i] = last;
+    }
+
+    for (i = 0; i < block->rows; i++)
+    {
+        if ((p = get_varint(p, end, &v)) == NULL || v > UINT32_MAX)
+            return false;
+
+        cols->value[i] = (int32_t)((uint32_t)v >> 1 ^ -(uint32_t)(v & 1));
+    }
+
+    cols->rows = block->rows;
+
+    return p == end;
+}
+
+/**
+ * Prepare the export query, with a read-only cursor so that the server
+ * keeps the result and hands it over a batch at a time.
+ *
+ * @param[in]   inst    The connection.
+ *
+ * @return      the statement, or NULL on failure.
+ */
+static MYSQL_STMT *
+export_prepare(MYSQL *inst)
+{
+    MYSQL_STMT      *stmt;
+    unsigned long   cursor      = CURSOR_TYPE_READ_ONLY;
+    unsigned long   prefetch    = EXPORT_PREFETCH;
+
+    if ((stmt = mysql_stmt_init(inst)) == NULL)
+    {
+        fprintf(stderr, "%s: preparing export: %s\n", prog, mysql_error(inst));
+        return NULL;
+    }
+
+    if
+    (
+        mysql_stmt_prepare(stmt, SQL_EXPORT, strlen(SQL_EXPORT)) != 0
+        ||
+        mysql_stmt_attr_set(stmt, STMT_ATTR_CURSOR_TYPE, &cursor) != 0
+        ||
+        mysql_stmt_attr_set(stmt, STMT_ATTR_PREFETCH_ROWS, &prefetch) != 0
+    )
+    {
+        fprintf(stderr, "%s: preparing export: %s\n", prog, mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+
+    return stmt;
+}
+
+/**
+ * Read one chunk into its columns.
+ *
+ * @param[in]   stmt    The export query.
+ * @param[in]   range   The start and end of the chunk.
+ * @param[out]  cols    The rows.
+ *
+ * @return      true for success.
+ */
+static bool
+export_chunk(MYSQL_STMT *stmt, int64_t range[2], columns_t *cols)
+{
+    MYSQL_BIND      params[2];
+    MYSQL_BIND      result[4];
+    int64_t         timestamp;
+    uint8_t         station;
+    uint8_t         sensor;
+    int32_t         value;
+    int             status;
+
+    memset(params, 0, sizeof(params));
+    params[0].buffer_type = MYSQL_TYPE_LONGLONG;
+    params[0].buffer = &range[0];
+    params[1].buffer_type = MYSQL_TYPE_LONGLONG;
+    params[1].buffer = &range[1];
+
+    memset(result, 0, sizeof(result));
+    result[0].buffer_type = MYSQL_TYPE_LONGLONG;
+    result[0].buffer = &timestamp;
+    result[1].buffer_type = MYSQL_TYPE_TINY;
+    result[1].buffer = &station;
+    result[1].is_unsigned = 1;
+    result[2].buffer_type = MYSQL_TYPE_TINY;
+    result[2].buffer = &sensor;
+    result[2].is_unsigned = 1;
+    result[3].buffer_type = MYSQL_TYPE_LONG;
+    result[3].buffer = &value;
+
+    if
+    (
+        mysql_stmt_bind_param(stmt, params) != 0
+        ||
+        mysql_stmt_execute(stmt) != 0
+        ||
+        mysql_stmt_bind_result(stmt, result) != 0
+    )
+    {
+        fprintf(stderr, "%s: export: %s\n", prog, mysql_stmt_error(stmt));
+        return false;
+    }
+
+    cols->rows = 0;
+
+    while ((status = mysql_stmt_fetch(stmt)) == 0)
+    {
+        if (cols->rows == cols->size && !columns_grow(cols))
+            break;
+
+        cols->timestamp[cols->rows] = timestamp;
+        cols->station[cols->rows] = station;
+        cols->sensor[cols->rows] = sensor;
+        cols->value[cols->rows] = value;
+        cols->rows++;
+    }
+
+    mysql_stmt_free_result(stmt);
+
+    if (status != MYSQL_NO_DATA)
+    {
+        fprintf(stderr, "%s: export: %s\n", prog,
+            status == 0 ? "out of memory" : mysql_stmt_error(stmt));
+        return false;
+    }
+
+    if (!columns_reserve(cols, BLOCK_HDR_LEN + (size_t)cols->rows * BLOCK_ROW_MAX))
+    {
+        fprintf(stderr, "%s: export: out of memory\n", prog);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * An export thread: read chunks over its own connection, and append their
+ * blocks to the dump file.
+ */
+static void *
+export_worker(void *arg)
+{
+    copy_t          *copy   = arg;
+    columns_t       cols;
+    MYSQL           *inst;
+    MYSQL_STMT      *stmt   = NULL;
+    int64_t         range[2];
+    size_t          length  = 0;
+    uint32_t        rows    = 0;
+    bool            status;
+    int             chunk;
+
+    memset(&cols, 0, sizeof(cols));
+    mysql_thread_init();
+
+    if ((inst = copy_connect(copy->cfg)) == NULL || (stmt = export_prepare(inst)) == NULL)
+        copy_fail(copy);
+
+    while (stmt != NULL && (chunk = copy_next(copy, rows, (uint32_t)length)) >= 0)
+    {
+        range[0] = copy->start + chunk * copy->span;
+        range[1] = copy->end - range[0] > copy->span ? range[0] + copy->span : copy->end;
+
+        if (!export_chunk(stmt, range, &cols))
+        {
+            copy_fail(copy);
+            break;
+        }
+
+        length = block_encode(&cols, range[0], range[1]);
+        rows = cols.rows;
+
+        pthread_mutex_lock(&copy->lock);
+        status = fwrite(cols.data, length, 1, copy->out) == 1;
+        pthread_mutex_unlock(&copy->lock);
+
+        if (!status)
+        {
+            fprintf(stderr, "%s: writing dump: %s\n", prog, strerror(errno));
+            copy_fail(copy);
+            break;
+        }
+    }
+
+    if (stmt != NULL)
+        mysql_stmt_close(stmt);
+    if (inst != NULL)
+        mysql_close(inst);
+    mysql_thread_end();
+    columns_free(&cols);
+
+    return NULL;
+}
+
+/**
+ * Insert rows with one multi-row statement.
+ *
+ * @param[in]   inst    The connection.
+ * @param[in]   cols    The rows.
+ * @param[in]   first   The first row to insert.
+ * @param[in]   n       The number of rows to insert (up to IMPORT_BATCH).
+ * @param[in]   sql     A buffer for the statement.
+ *
+ * @return      true for success.
+ */
+static bool
+import_insert(MYSQL *inst, const columns_t *cols, uint32_t first, uint32_t n, char *sql)
+{
+    char        *p      = sql;
+    struct tm   tm;
+    time_t      secs;
+    int         ms;
+    uint32_t    i;
+
+    p += sprintf(p, "%s", SQL_INSERT);
+
+    for (i = first; i < first + n; i++)
+    {
+        secs = (time_t)(cols->timestamp[i] / 1000);
+        ms = (int)(cols->timestamp[i] % 1000);
+
+        if (ms < 0)
+        {
+            secs--;
+            ms += 1000;
+        }
+
+        gmtime_r(&secs, &tm);
+
+        p += sprintf(p, "%s('%04d-%02d-%02d %02d:%02d:%02d.%03d',%u,%u,%ld)",
+                i == first ? "" : ",",
+                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                tm.tm_hour, tm.tm_min, tm.tm_sec, ms,
+                cols->station[i], cols->sensor[i], (long)cols->value[i]);
+    }
+
+    if (mysql_real_query(inst, sql, p - sql) != 0)
+    {
+        fprintf(stderr, "%s: import: %s\n", prog, mysql_error(inst));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Read and decode one block of the dump file.
+ *
+ * @param[in]   copy    The import.
+ * @param[in]   block   The block.
+ * @param[out]  cols    The rows.
+ *
+ * @return      true for success.
+ */
+static bool
+import_block(copy_t *copy, const block_t *block, columns_t *cols)
+{
+    ssize_t     n;
+
+    while (cols->size < block->rows)
+    {
+        if (!columns_grow(cols))
+        {
+            fprintf(stderr, "%s: import: out of memory\n", prog);
+            return false;
+        }
+    }
+
+    if (!columns_reserve(cols, block->length ? block->length : 1))
+    {
+        fprintf(stderr, "%s: import: out of memory\n", prog);
+        return false;
+    }
+
+    if ((n = pread(copy->fd, cols->data, block->length, block->offset)) != (ssize_t)block->length)
+    {
+        fprintf(stderr, "%s: reading dump: %s\n", prog, n < 0 ? strerror(errno) : "file truncated");
+        return false;
+    }
+
+    if (!block_decode(block, cols))
+    {
+        fprintf(stderr, "%s: dump block at offset %ld is not valid\n", prog, (long)block->offset);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * An import thread: read blocks from the dump file, and insert their rows
+ * over its own connection.
+ */
+static void *
+import_worker(void *arg)
+{
+    copy_t          *copy   = arg;
+    columns_t       cols;
+    MYSQL           *inst;
+    char            *sql;
+    uint32_t        length  = 0;
+    uint32_t        rows    = 0;
+    uint32_t        first;
+    uint32_t        n;
+    int             i;
+
+    memset(&cols, 0, sizeof(cols));
+    mysql_thread_init();
+
+    if ((sql = malloc(strlen(SQL_INSERT) + IMPORT_BATCH * IMPORT_ROW_MAX)) == NULL)
+        fprintf(stderr, "%s: out of memory\n", prog);
+
+    if (sql == NULL || (inst = copy_connect(copy->cfg)) == NULL)
+    {
+        copy_fail(copy);
+        inst = NULL;
+    }
+
+    while (inst != NULL && (i = copy_next(copy, rows, length)) >= 0)
+    {
+        if (!import_block(copy, &copy->blocks[i], &cols))
+        {
+            copy_fail(copy);
+            break;
+        }
+
+        for (first = 0; first < cols.rows; first += n)
+        {
+            n = cols.rows - first < IMPORT_BATCH ? cols.rows - first : IMPORT_BATCH;
+
+            if (!import_insert(inst, &cols, first, n, sql))
+                break;
+        }
+
+        if (first < cols.rows)
+        {
+            copy_fail(copy);
+            break;
+        }
+
+        rows = cols.rows;
+        length = BLOCK_HDR_LEN + copy->blocks[i].length;
+    }
+
+    if (inst != NULL)
+        mysql_close(inst);
+    mysql_thread_end();
+    columns_free(&cols);
+    free(sql);
+
+    return NULL;
+}
+
+/**
+ * Find the blocks in a dump file.
+ *
+ * @param[in]   copy    The import (with the file open).
+ *
+ * @return      true if the file is a valid dump.
+ */
+static bool
+import_index(copy_t *copy)
+{
+    uint8_t     hdr[BLOCK_HDR_LEN];
+    struct stat st;
+    block_t     *blocks;
+    block_t     *block;
+    off_t       offset  = DUMP_HDR_LEN;
+    ssize_t     n;
+
+    if (fstat(copy->fd, &st) != 0)
+        return false;
+
+    if
+    (
+        pread(copy->fd, hdr, DUMP_HDR_LEN, 0) != DUMP_HDR_LEN
+        ||
+        memcmp(hdr, DUMP_MAGIC, 4) != 0
+        ||
+        hdr[4] != DUMP_VERSION
+    )
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    while ((n = pread(copy->fd, hdr, BLOCK_HDR_LEN, offset)) != 0)
+    {
+        if ((blocks = realloc(copy->blocks, (copy->nchunks + 1) * sizeof(block_t))) == NULL)
+            return false;
+
+        copy->blocks = blocks;
+        block = &blocks[copy->nchunks];
+
+        block->offset = offset + BLOCK_HDR_LEN;
+        block->start = (int64_t)get_u64(hdr);
+        block->end = (int64_t)get_u64(hdr + 8);
+        block->rows = get_u32(hdr + 16);
+        block->length = get_u32(hdr + 20);
+
+        if
+        (
+            n != BLOCK_HDR_LEN
+            ||
+            block->end < block->start
+            ||
+            block->length > (uint64_t)block->rows * BLOCK_ROW_MAX
+            ||
+            block->offset + block->length > st.st_size
+        )
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        offset = block->offset + block->length;
+        copy->nchunks++;
+    }
+
+    return true;
+}
+
+/**
+ * Run the export or import threads, and wait for them all.
+ *
+ * @param[in]   copy    The export or import.
+ * @param[in]   worker  The thread function.
+ * @param[in]   jobs    The number of threads.
+ *
+ * @return      true if they all succeeded.
+ */
+static bool
+copy_run(copy_t *copy, void *(*worker)(void *), int jobs)
+{
+    pthread_t   threads[COPY_MAX_JOBS];
+    int         started;
+
+    for (started = 0; started < jobs; started++)
+    {
+        if (pthread_create(&threads[started], NULL, worker, copy) != 0)
+        {
+            fprintf(stderr, "%s: failed to start a thread\n", prog);
+            copy_fail(copy);
+            break;
+        }
+    }
+
+    while (started > 0)
+        pthread_join(threads[--started], NULL);
+
+    return !copy->failed;
+}
+
+/**
+ * Find the range of the sensor table.
+ *
+ * @param[in]   cfg     The configuration.
+ * @param[out]  start   The first timestamp.
+ * @param[out]  end     The last timestamp, plus one.
+ *
+ * @return      true for success (an empty table gives an empty range).
+ */
+static bool
+export_range(const config_t *cfg, int64_t *start, int64_t *end)
+{
+    MYSQL       *inst;
+    MYSQL_RES   *res    = NULL;
+    MYSQL_ROW   row;
+
+    if ((inst = copy_connect(cfg)) == NULL)
+        return false;
+
+    if
+    (
+        mysql_query(inst, SQL_RANGE) != 0
+        ||
+        (res = mysql_store_result(inst)) == NULL
+        ||
+        (row = mysql_fetch_row(res)) == NULL
+    )
+    {
+        fprintf(stderr, "%s: finding range: %s\n", prog, mysql_error(inst));
+        if (res != NULL)
+            mysql_free_result(res);
+        mysql_close(inst);
+        return false;
+    }
+
+    if (row[0] == NULL || row[1] == NULL)
+    {
+        *start = 0;
+        *end = 0;
+    }
+    else
+    {
+        *start = strtoll(row[0], NULL, 10);
+        *end = strtoll(row[1], NULL, 10) + 1;
+    }
+
+    mysql_free_result(res);
+    mysql_close(inst);
+
+    return true;
+}
+
+/**
+ * Export a range of the sensor table to a dump file.
+ *
+ * @param[in]   copy    The export (with the range and chunk span set).
+ * @param[in]   path    The dump file.
+ * @param[in]   jobs    The number of connections to use.
+ *
+ * @return      true for success.
+ */
+static bool
+do_export(copy_t *copy, const char *path, int jobs)
+{
+    uint8_t     hdr[DUMP_HDR_LEN];
+    double      start   = elapsed_now();
+    double      elapsed;
+    bool        status;
+
+    if ((copy->out = fopen(path, "wb")) == NULL)
+    {
+        fprintf(stderr, "%s: failed to create %s: %s\n", prog, path, strerror(errno));
+        return false;
+    }
+
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, DUMP_MAGIC, 4);
+    hdr[4] = DUMP_VERSION;
+
+    copy->bytes = sizeof(hdr);
+    copy->nchunks = copy->end > copy->start
+        ? (int)((copy->end - copy->start + copy->span - 1) / copy->span) : 0;
+
+    if (fwrite(hdr, sizeof(hdr), 1, copy->out) != 1)
+    {
+        fprintf(stderr, "%s: writing dump: %s\n", prog, strerror(errno));
+        copy->failed = true;
+    }
+
+    status = !copy->failed && copy_run(copy, export_worker, jobs);
+
+    if (fclose(copy->out) != 0 && status)
+    {
+        fprintf(stderr, "%s: writing dump: %s\n", prog, strerror(errno));
+        status = false;
+    }
+
+    if (!status)
+    {
+        unlink(path);
+        return false;
+    }
+
+    elapsed = elapsed_now() - start;
+
+    fprintf(stderr, "%s: exported %lu rows in %d chunks to %s (%llu bytes, %.1f per row)\n",
+        prog, copy->rows, copy->nchunks, path, (unsigned long long)copy->bytes,
+        copy->rows ? (double)copy->bytes / copy->rows : 0.0);
+    fprintf(stderr, "%s: %.3f s, %.0f rows/s\n",
+        prog, elapsed, elapsed > 0 ? copy->rows / elapsed : 0.0);
+
+    return true;
+}
+
+/**
+ * Import a dump file into the sensor table.
+ *
+ * @param[in]   copy            The import.
+ * @param[in]   path            The dump file.
+ * @param[in]   jobs            The number of connections to use.
+ * @param[in]   disable_keys    Whether to disable the table's indexes while
+ *                              importing (quicker into a new table).
+ *
+ * @return      true for success.
+ */
+static bool
+do_import(copy_t *copy, const char *path, int jobs, bool disable_keys)
+{
+    MYSQL       *inst   = NULL;
+    double      start   = elapsed_now();
+    double      elapsed;
+    bool        status;
+
+    if ((copy->fd = open(path, O_RDONLY)) < 0)
+    {
+        fprintf(stderr, "%s: failed to open %s: %s\n", prog, path, strerror(errno));
+        return false;
+    }
+
+    if (!import_index(copy))
+    {
+        fprintf(stderr, "%s: %s: %s\n", prog, path,
+            errno == EINVAL ? "not a valid dump file" : strerror(errno));
+        close(copy->fd);
+        return false;
+    }
+
+    if (disable_keys)
+    {
+        if ((inst = copy_connect(copy->cfg)) == NULL)
+        {
+            close(copy->fd);
+            return false;
+        }
+
+        if (mysql_query(inst, "alter table sensor disable keys") != 0)
+        {
+            fprintf(stderr, "%s: disabling keys: %s\n", prog, mysql_error(inst));
+            mysql_close(inst);
+            close(copy->fd);
+            return false;
+        }
+    }
+
+    status = copy_run(copy, import_worker, jobs);
+
+    if (inst != NULL)
+    {
+        if (mysql_query(inst, "alter table sensor enable keys") != 0)
+        {
+            fprintf(stderr, "%s: enabling keys: %s\n", prog, mysql_error(inst));
+            status = false;
+        }
+
+        mysql_close(inst);
+    }
+
+    close(copy->fd);
+
+    if (!status)
+        return false;
+
+    elapsed = elapsed_now() - start;
+
+    fprintf(stderr, "%s: imported %lu rows in %d chunks from %s\n",
+        prog, copy->rows, copy->nchunks, path);
+    fprintf(stderr, "%s: %.3f s, %.0f rows/s\n",
+        prog, elapsed, elapsed > 0 ? copy->rows / elapsed : 0.0);
+
+    return true;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: %s [-f config] [-j jobs] [-d days] [-s start] [-t end] -e file\n", prog);
+    fprintf(stderr, "       %s [-f config] [-j jobs] [-k] -i file\n", prog);
+    fprintf(stderr, "\t-e\tExport the sensor table to a dump file\n");
+    fprintf(stderr, "\t-i\tImport a dump file into the sensor table\n");
+    fprintf(stderr, "\t-f\tConfiguration file (default %s)\n", CONFIG_PATH);
+    fprintf(stderr, "\t-j\tDatabase connections to use at once (1-%d, default 4)\n", COPY_MAX_JOBS);
+    fprintf(stderr, "\t-d\tDays per chunk (default 7)\n");
+    fprintf(stderr, "\t-s\tStart of the range (\"YYYY-MM-DD[ HH:MM[:SS]]\", default the first row)\n");
+    fprintf(stderr, "\t-t\tEnd of the range (exclusive, default after the last row)\n");
+    fprintf(stderr, "\t-k\tDisable the table's indexes during the import\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    config_t    cfg;
+    copy_t      copy;
+    const char  *config_path    = CONFIG_PATH;
+    int         config_required = 0;
+    const char  *export_path    = NULL;
+    const char  *import_path    = NULL;
+    const char  *start          = NULL;
+    const char  *end            = NULL;
+    int         jobs            = 4;
+    int         days            = 7;
+    bool        disable_keys    = false;
+    bool        status          = true;
+    int         cfg_status;
+    int         opt;
+
+    prog = argv[0];
+
+    while ((opt = getopt(argc, argv, "e:i:f:j:d:s:t:kh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'e':
+            export_path = optarg;
+            break;
+        case 'i':
+            import_path = optarg;
+            break;
+        case 'f':
+            config_path = optarg;
+            config_required = 1;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'd':
+            days = atoi(optarg);
+            break;
+        case 's':
+            start = optarg;
+            break;
+        case 't':
+            end = optarg;
+            break;
+        case 'k':
+            disable_keys = true;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    memset(&copy, 0, sizeof(copy));
+
+    if
+    (
+        (export_path == NULL) == (import_path == NULL)
+        ||
+        optind != argc
+        ||
+        jobs < 1 || jobs > COPY_MAX_JOBS
+        ||
+        days < 1
+        ||
+        (start != NULL && !parse_time(start, &copy.start))
+        ||
+        (end != NULL && !parse_time(end, &copy.end))
+    )
+    {
+        usage();
+        return 1;
+    }
+
+    /*
+     * The default configuration file is optional
+     */
+    config_defaults(&cfg);
+    cfg_status = config_load(config_path, &cfg);
+
+    if (cfg_status > 0)
+    {
+        fprintf(stderr, "%s: %s: error at line %d\n", prog, config_path, cfg_status);
+        return 1;
+    }
+
+    if (cfg_status < 0 && (config_required || errno != ENOENT))
+    {
+        fprintf(stderr, "%s: failed to read %s: %s\n", prog, config_path, strerror(errno));
+        return 1;
+    }
+
+    copy.cfg = &cfg;
+    copy.span = (int64_t)days * 86400 * 1000;
+    pthread_mutex_init(&copy.lock, NULL);
+
+    if (mysql_library_init(0, NULL, NULL) != 0)
+    {
+        fprintf(stderr, "%s: failed to initialise the MySQL library\n", prog);
+        return 1;
+    }
+
+    if (export_path != NULL)
+    {
+        int64_t     first   = 0;
+        int64_t     last    = 0;
+
+        if (start == NULL || end == NULL)
+        {
+            status = export_range(&cfg, &first, &last);
+
+            if (start == NULL)
+                copy.start = first;
+            if (end == NULL)
+                copy.end = last;
+        }
+
+        status = status && do_export(&copy, export_path, jobs);
+    }
+    else
+    {
+        status = do_import(&copy, import_path, jobs, disable_keys);
+    }
+
+    free(copy.blocks);
+    pthread_mutex_destroy(&copy.lock);
+    mysql_library_end();
+
+    return status ? 0 : 1;
+}
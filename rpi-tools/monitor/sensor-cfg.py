@@ -1,19 +1,57 @@
 #
-# Define the list of known sensors
+# Load the list of known sensors, and other monitor settings, from the
+# shared configuration file (see ../sensors.conf).
 #
 
-sensors = {
-    '2':    { 'location': 'Lounge',
-                'area': 'inside', 'sort': 15, 'temp': True },
-    '3':    { 'location': 'Roof cavity (lower)',
-                'area': 'outside', 'sort': 20, 'temp': True },
-    '4':    { 'location': 'Roof cavity (upper)',
-                'area': 'outside', 'sort': 21, 'temp': True },
-    '10':   { 'location': 'Bedroom',
-                'area': 'inside', 'sort': 2, 'temp': True },
-    '21':   { 'location': 'Outside',
-                'area': 'outside', 'sort': 1, 'temp': True, 'pres': True },
-}
-
-rrddir = '/home/pi/sensors'
+import os
 
+try:
+    import ConfigParser as configparser
+except ImportError:
+    import configparser
+
+config_file = os.environ.get('SENSORS_CONF', '/etc/sensors.conf')
+
+_cfg = configparser.RawConfigParser()
+if not _cfg.read(config_file):
+    raise IOError("cannot read %s" % config_file)
+
+#
+# Station settings, from the [station N] sections
+#
+_types = { 'sort': int, 'temp': bool, 'pres': bool }
+
+sensors = {}
+
+for section in _cfg.sections():
+    words = section.split()
+    if len(words) != 2 or words[0] != 'station':
+        continue
+    attr = {}
+    for (k, v) in _cfg.items(section):
+        if _types.get(k) is int:
+            attr[k] = _cfg.getint(section, k)
+        elif _types.get(k) is bool:
+            attr[k] = _cfg.getboolean(section, k)
+        else:
+            attr[k] = v
+    sensors[words[1]] = attr
+
+def _get(section, key, default):
+    if _cfg.has_option(section, key):
+        return _cfg.get(section, key)
+    return default
+
+rrddir = _get('monitor', 'rrddir', '/home/pi/sensors')
+query = _get('monitor', 'query', '/home/pi/sensors/query')
+station_dead = int(_get('sensord', 'station_dead', 600))
+
+def readings():
+    """The latest readings from each station, as wlsensor.Station records:
+    from sensord's shared state, or from the receiver if sensord isn't
+    running (see ../python/wlsensor.c)."""
+    import wlsensor
+    try:
+        return wlsensor.state(config_file)
+    except IOError:
+        return wlsensor.read(config_file)
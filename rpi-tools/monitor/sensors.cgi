@@ -9,9 +9,7 @@ import cgi
 import urlparse
 import urllib
 import cgitb
-import subprocess
 import imp
-import math
 
 class Url(object):
     def __init__(self, url):
@@ -27,20 +25,22 @@ class Url(object):
 
 cgitb.enable()
 
-QUERY = "/home/pi/sensors/query"
-
 #
 # Load sensor configuration
 #
 (file, path, desc) = imp.find_module("sensor-cfg", [ ".", "/etc", ])
 cfg = imp.load_module("sensors", file, path, desc)
 
+#
+# The same threshold as sensord's; stations that report on change can
+# legitimately be silent for several minutes.
+#
+STATION_DEAD_THRESHOLD = cfg.station_dead
+
 u = Url(os.environ['REQUEST_URI'])
 if not u.args.has_key('period'):
     u.args['period'] = '1d'
 
-p = subprocess.Popen([QUERY, "-c"], shell=False, stdout=subprocess.PIPE).stdout
-
 print "Content-Type: text.html"
 print
 print """<!DOCTYPE HTML PUBLIC "-//W3C//DTD HTML 4.0 Transitional//EN" "http://www.w3.org/TR/REC-html40/loose.dtd">
@@ -63,28 +63,14 @@ print """<!DOCTYPE HTML PUBLIC "-//W3C//DTD HTML 4.0 Transitional//EN" "http://w
 <th class="status">Status</th>
 </tr>"""
 
-for line in p.readlines():
-	line = line.rstrip()
-	fields = line.split(",")
-	(station, age, s1, s2, s3, s4, s5, junk) = fields
-
-        if s1:
-            temperature = float(s1) / 10
-
-        if s2:
-            pressure = float(s2) / 10
-
-            #
-            # Convert to sea level pressure.
-            # http://hyperphysics.phy-astr.gsu.edu/hbase/kinetic/barfor.html
-            #
-            m = 29.0 * 1.66054e-27      # 29 amu
-            g = 9.8                     # G
-            h = 210                     # height above sea level
-            k = 1.38066e-23             # Boltzmann constant
-            T = 273.15 + temperature    # temperature in Kelvin
+for st in cfg.readings():
+	station = str(st.id)
 
-            pressure_msl = pressure / math.exp(-m * g * h / k / T);
+	#
+	# Sea level pressure is worked out from the station altitude
+	#
+	temperature = st.values.get('temperature')
+	pressure_msl = st.values.get('pressure_msl')
 
 	print """<tr>
 <td class="id">%s</td>
@@ -95,9 +81,9 @@ for line in p.readlines():
 </tr>""" % (
 	station,
 	cfg.sensors[station]['location'],
-	("%.1f" % temperature if s1 else ""),
-	("%.1f" % pressure_msl if s2 else ""),
-	("offline" if (float(age) > 300) else "OK")
+	("%.1f" % temperature if temperature is not None else ""),
+	("%.1f" % pressure_msl if pressure_msl is not None else ""),
+	("offline" if st.age > STATION_DEAD_THRESHOLD else "OK")
 )
 
 print """</table>
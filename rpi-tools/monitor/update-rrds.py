@@ -6,8 +6,6 @@ import sys
 import argparse
 import rrdtool
 import imp
-import subprocess
-import math
 
 #
 # Load sensor configuration
@@ -16,37 +14,20 @@ import math
     [ ".", "/etc", ])
 cfg = imp.load_module("sensors", file, path, desc)
 
-cmd = "/home/pi/sensors/query -c"
+for st in cfg.readings():
 
-p = subprocess.Popen(cmd, shell=True, stdout=subprocess.PIPE)
+    print st
 
-for l in p.stdout.readlines():
+    id = str(st.id)
+    age = int(st.age)
 
-    f = l.strip().split(',')
+    temperature = st.values.get('temperature', '')
 
-    print f
-
-    (id, age, temperature, pressure, count, light, humidity, junk) = f
-
-    age = int(age)
-
-    if temperature:
-        temperature = float(temperature) / 10
-
-    if pressure:
-        pressure = float(pressure) / 10
-
-        #
-        # Convert to sea level pressure.
-        # http://hyperphysics.phy-astr.gsu.edu/hbase/kinetic/barfor.html
-        #
-        m = 29.0 * 1.66054e-27      # 29 amu
-        g = 9.8                     # G
-        h = 210                     # height above sea level
-        k = 1.38066e-23             # Boltzmann constant
-        T = 273.15 + temperature    # temperature in Kelvin
-
-        pressure_msl = pressure / math.exp(-m * g * h / k / T);
+    #
+    # Sea level pressure is worked out from the station altitude in
+    # sensors.conf
+    #
+    pressure_msl = st.values.get('pressure_msl', '')
 
     rrdfile = "%s/station%s.rrd" % (cfg.rrddir, id)
 
@@ -62,7 +43,7 @@ for l in p.stdout.readlines():
 
     if cfg.sensors[id].has_key('pres') and cfg.sensors[id]['pres']:
         metrics.append('pres')
-        if pressure != '':
+        if pressure_msl != '':
             values.append(str(pressure_msl))
         else:
             values.append('U')
@@ -6,7 +6,6 @@ import sys
 import argparse
 import rrdtool
 import imp
-import subprocess
 
 #
 # Load sensor configuration
@@ -15,34 +14,34 @@ import subprocess
     [ ".", "/etc", ])
 cfg = imp.load_module("sensors", file, path, desc)
 
-cmd = "/home/pi/sensors/query -c"
+for st in cfg.readings():
 
-p = subprocess.Popen(cmd, shell=True, stdout=subprocess.PIPE)
+    id = str(st.id)
+    age = int(st.age)
 
-for l in p.stdout.readlines():
+    temperature = st.values.get('temperature', '')
 
-    f = l.strip().split(',')
-    (id, age, temp, pressure, count, light, humidity, junk) = f
-
-    age = int(age)
+    #
+    # Sea level pressure is worked out from the station altitude in
+    # sensors.conf
+    #
+    pressure_msl = st.values.get('pressure_msl', '')
 
     rrdfile = "%s/station%s.rrd" % (cfg.rrddir, id)
 
     metrics = []
     values = []
 
-    if cfg.sensors[id]['temp']:
+    if cfg.sensors[id].has_key('temp') and cfg.sensors[id]['temp']:
         metrics.append('temp')
-        if temp != '':
-            temp = float(temp) / 10
-            values.append(str(temp))
+        if temperature != '':
+            values.append(str(temperature))
         else:
             values.append('U')
-    elif cfg.sensors[id]['pres']:
+    elif cfg.sensors[id].has_key('pres') and cfg.sensors[id]['pres']:
         metrics.append('pres')
-        if pres != '':
-            pressure = float(pressure) / 10
-            values.append(str(pressure))
+        if pressure_msl != '':
+            values.append(str(pressure_msl))
         else:
             values.append('U')
 
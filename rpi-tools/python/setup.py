@@ -0,0 +1,27 @@
+#
+# Build the wlsensor extension module (see wlsensor.c):
+#
+#   python setup.py build_ext --inplace
+#
+# Needs setuptools, and the numpy and MySQL client headers.
+#
+
+from setuptools import setup, Extension
+import numpy
+
+wlsensor = Extension('wlsensor',
+    sources = [
+        'wlsensor.c',
+        '../common/snapshot.c',
+        '../common/derived.c',
+        '../common/config.c',
+        '../common/receiver.c',
+        '../common/livestate.c',
+    ],
+    include_dirs = [ '../../include', '../common', numpy.get_include() ],
+    libraries = [ 'mysqlclient', 'rt', 'm' ])
+
+setup(name = 'wlsensor',
+    version = '1.0',
+    description = 'Wireless sensor readings, from the receiver, sensord or the database',
+    ext_modules = [ wlsensor ])
@@ -0,0 +1,651 @@
+/*
+ * Python extension module for the monitor scripts, so they can have the
+ * station readings as Python values rather than running query and
+ * splitting its CSV output.
+ *
+ *  wlsensor.parse(snapshot, config=None)   parse a raw receiver snapshot
+ *  wlsensor.read(config=None)              read the receiver
+ *  wlsensor.state(config=None)             sensord's shared station states
+ *  wlsensor.history(station, sensor, start, end, config=None)
+ *                                          readings from the database
+ *
+ * parse(), read() and state() return a list of wlsensor.Station records:
+ *
+ *  id          station ID
+ *  age         seconds since the station's last message
+ *  seqno       the message counter, or None
+ *  flags       LIVESTATE_* flags (state() only; 0 otherwise)
+ *  messages    messages received since sensord started (state() only)
+ *  missed      messages missed, from the counter (state() only)
+ *  values      {sensor name: value in natural units}, including the
+ *              derived values (for example "temperature", "pressure_msl")
+ *  raw         {sensor type: raw value}
+ *
+ * history() returns a tuple of two numpy float64 arrays: the times of the
+ * readings (seconds since the epoch, to the millisecond) and their values
+ * in natural units. start and end are seconds since the epoch; sensor is a
+ * type number or name.
+ *
+ * config is the configuration file (default /etc/sensors.conf, which is
+ * optional), for the receiver, database, shared state and station
+ * altitudes. Builds for Python 2 and 3 (see setup.py).
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structseq.h>
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include <mysql/mysql.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "wireless.h"
+#include "snapshot.h"
+#include "derived.h"
+#include "config.h"
+#include "receiver.h"
+#include "livestate.h"
+
+#if PY_MAJOR_VERSION >= 3
+#define PyInt_FromLong      PyLong_FromLong
+#define BYTES_FORMAT        "y#"
+#else
+#define BYTES_FORMAT        "s#"
+#endif
+
+/**
+ * The biggest snapshot read from the receiver
+ */
+#define WLSENSOR_MAX_SNAPSHOT   1024
+
+static PyTypeObject             station_type;
+
+static PyStructSequence_Field   station_fields[] =
+{
+    { "id",         "station ID" },
+    { "age",        "seconds since the station's last message" },
+    { "seqno",      "message counter, or None" },
+    { "flags",      "LIVESTATE_* flags" },
+    { "messages",   "messages received since sensord started" },
+    { "missed",     "messages missed" },
+    { "values",     "{sensor name: value in natural units}" },
+    { "raw",        "{sensor type: raw value}" },
+    { NULL }
+};
+
+static PyStructSequence_Desc    station_desc =
+{
+    "wlsensor.Station",
+    "The latest readings from a station",
+    station_fields,
+    8
+};
+
+/**
+ * Load the configuration, as query does: the default file is optional.
+ *
+ * @param[in]   path        The configuration file, or NULL for the default.
+ * @param[out]  cfg         The configuration.
+ *
+ * @return      0 for success, or -1 with a Python exception set.
+ */
+static int
+load_config(const char *path, config_t *cfg)
+{
+    int     status;
+
+    config_defaults(cfg);
+    status = config_load(path != NULL ? path : CONFIG_PATH, cfg);
+
+    if (status > 0)
+    {
+        PyErr_Format(PyExc_ValueError, "%s: error at line %d",
+            path != NULL ? path : CONFIG_PATH, status);
+        return -1;
+    }
+
+    if (status < 0 && (path != NULL || errno != ENOENT))
+    {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, path != NULL ? path : CONFIG_PATH);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Add a value to a station's values and raw dictionaries.
+ *
+ * @return      0 for success, or -1 with a Python exception set.
+ */
+static int
+add_value(PyObject *values, PyObject *raw, int type, int32_t value)
+{
+    PyObject    *key;
+    PyObject    *item;
+    int         status;
+
+    if ((item = PyFloat_FromDouble((double)value / SENSOR_TYPE_SCALE(type))) == NULL)
+        return -1;
+
+    status = PyDict_SetItemString(values, config_sensor_name(type), item);
+    Py_DECREF(item);
+
+    if (status < 0)
+        return -1;
+
+    if ((key = PyInt_FromLong(type)) == NULL)
+        return -1;
+
+    if ((item = PyInt_FromLong(value)) == NULL)
+    {
+        Py_DECREF(key);
+        return -1;
+    }
+
+    status = PyDict_SetItem(raw, key, item);
+    Py_DECREF(key);
+    Py_DECREF(item);
+
+    return status;
+}
+
+/**
+ * Make a Station record.
+ *
+ * @param[in]   id          The station ID.
+ * @param[in]   age         Seconds since the station's last message.
+ * @param[in]   seqno       The message counter, or -1.
+ * @param[in]   flags       LIVESTATE_* flags.
+ * @param[in]   messages    Messages received.
+ * @param[in]   missed      Messages missed.
+ * @param[in]   values      The readings and derived values.
+ * @param[in]   nvalues     The number of values.
+ *
+ * @return      the record, or NULL with a Python exception set.
+ */
+static PyObject *
+make_station
+(
+    int                     id,
+    double                  age,
+    int32_t                 seqno,
+    int                     flags,
+    unsigned long           messages,
+    unsigned long           missed,
+    const snapshot_value_t  *values,
+    int                     nvalues
+)
+{
+    PyObject    *station;
+    PyObject    *value_dict;
+    PyObject    *raw_dict;
+    int         i;
+
+    if ((station = PyStructSequence_New(&station_type)) == NULL)
+        return NULL;
+
+    value_dict = PyDict_New();
+    raw_dict = PyDict_New();
+
+    PyStructSequence_SET_ITEM(station, 0, PyInt_FromLong(id));
+    PyStructSequence_SET_ITEM(station, 1, PyFloat_FromDouble(age));
+
+    if (seqno != -1)
+        PyStructSequence_SET_ITEM(station, 2, PyInt_FromLong(seqno));
+    else
+    {
+        Py_INCREF(Py_None);
+        PyStructSequence_SET_ITEM(station, 2, Py_None);
+    }
+
+    PyStructSequence_SET_ITEM(station, 3, PyInt_FromLong(flags));
+    PyStructSequence_SET_ITEM(station, 4, PyLong_FromUnsignedLong(messages));
+    PyStructSequence_SET_ITEM(station, 5, PyLong_FromUnsignedLong(missed));
+    PyStructSequence_SET_ITEM(station, 6, value_dict);
+    PyStructSequence_SET_ITEM(station, 7, raw_dict);
+
+    if (PyErr_Occurred() || value_dict == NULL || raw_dict == NULL)
+    {
+        Py_DECREF(station);
+        return NULL;
+    }
+
+    for (i = 0; i < nvalues; i++)
+    {
+        if (values[i].type == WL_SENSOR_TYPE_COUNTER || values[i].type == WL_SENSOR_TYPE_INVALID)
+            continue;
+
+        if (add_value(value_dict, raw_dict, values[i].type, values[i].value) < 0)
+        {
+            Py_DECREF(station);
+            return NULL;
+        }
+    }
+
+    return station;
+}
+
+/**
+ * Parse a snapshot into a list of Station records, adding the derived
+ * values as query and sensord do.
+ *
+ * @return      the list, or NULL with a Python exception set.
+ */
+static PyObject *
+parse_snapshot(const uint8_t *snapshot, int length, const config_t *cfg)
+{
+    static snapshot_station_t   stations[SNAPSHOT_MAX_STATIONS];
+    snapshot_value_t            values[SNAPSHOT_MAX_VALUES + DERIVED_MAX_VALUES];
+    PyObject                    *list;
+    PyObject                    *station;
+    int                         n_stations;
+    int                         nvalues;
+    int32_t                     seqno;
+    int                         i;
+    int                         j;
+
+    if ((n_stations = snapshot_parse(snapshot, length, stations, SNAPSHOT_MAX_STATIONS)) < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "malformed snapshot");
+        return NULL;
+    }
+
+    if ((list = PyList_New(0)) == NULL)
+        return NULL;
+
+    for (i = 0; i < n_stations; i++)
+    {
+        seqno = -1;
+        for (j = 0; j < stations[i].nvalues; j++)
+        {
+            values[j] = stations[i].values[j];
+            if (values[j].type == WL_SENSOR_TYPE_COUNTER)
+                seqno = values[j].value;
+        }
+
+        nvalues = stations[i].nvalues;
+        nvalues += derived_values(stations[i].values, stations[i].nvalues,
+                        config_altitude(cfg, stations[i].id), values + nvalues);
+
+        station = make_station(stations[i].id,
+                    (double)stations[i].age_ticks * SNAPSHOT_TICK_NS / 1e9,
+                    seqno, 0, 0, 0, values, nvalues);
+
+        if (station == NULL || PyList_Append(list, station) < 0)
+        {
+            Py_XDECREF(station);
+            Py_DECREF(list);
+            return NULL;
+        }
+
+        Py_DECREF(station);
+    }
+
+    return list;
+}
+
+static PyObject *
+wlsensor_parse(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char     *keywords[] = { "snapshot", "config", NULL };
+    const char      *snapshot;
+    Py_ssize_t      length;
+    const char      *config_path    = NULL;
+    config_t        cfg;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, BYTES_FORMAT "|z", keywords,
+            &snapshot, &length, &config_path))
+        return NULL;
+
+    if (load_config(config_path, &cfg) < 0)
+        return NULL;
+
+    return parse_snapshot((const uint8_t *)snapshot, (int)length, &cfg);
+}
+
+static PyObject *
+wlsensor_read(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char     *keywords[] = { "config", NULL };
+    const char      *config_path    = NULL;
+    uint8_t         snapshot[WLSENSOR_MAX_SNAPSHOT];
+    config_t        cfg;
+    int             dev;
+    int             n               = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|z", keywords, &config_path))
+        return NULL;
+
+    if (load_config(config_path, &cfg) < 0)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    if ((dev = receiver_open(&cfg)) >= 0)
+    {
+        n = receiver_read(dev, cfg.i2c_address, snapshot, sizeof(snapshot));
+        close(dev);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (dev < 0 || n < 0)
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, cfg.i2c_device);
+
+    return parse_snapshot(snapshot, n, &cfg);
+}
+
+static PyObject *
+wlsensor_state(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char         *keywords[] = { "config", NULL };
+    const char          *config_path    = NULL;
+    config_t            cfg;
+    const livestate_t   *shared;
+    livestate_t         *live;
+    livestate_station_t *st;
+    snapshot_value_t    values[LIVESTATE_MAX_VALUES];
+    PyObject            *list;
+    PyObject            *station;
+    struct timespec     ts;
+    int64_t             now;
+    int                 i;
+    int                 j;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|z", keywords, &config_path))
+        return NULL;
+
+    if (load_config(config_path, &cfg) < 0)
+        return NULL;
+
+    if ((live = PyMem_Malloc(sizeof(livestate_t))) == NULL)
+        return PyErr_NoMemory();
+
+    if ((shared = livestate_open(cfg.shared_state)) == NULL || !livestate_read(shared, live))
+    {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, cfg.shared_state);
+        livestate_close(shared);
+        PyMem_Free(live);
+        return NULL;
+    }
+
+    livestate_close(shared);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    if ((list = PyList_New(0)) == NULL)
+    {
+        PyMem_Free(live);
+        return NULL;
+    }
+
+    for (i = 1; i < 255; i++)
+    {
+        st = &live->stations[i];
+        if (!st->valid)
+            continue;
+
+        for (j = 0; j < st->nvalues; j++)
+        {
+            values[j].type = st->values[j].type;
+            values[j].value = st->values[j].value;
+        }
+
+        station = make_station(i, (now - st->received) / 1e3, st->seqno, st->flags,
+                    st->messages, st->missed, values, st->nvalues);
+
+        if (station == NULL || PyList_Append(list, station) < 0)
+        {
+            Py_XDECREF(station);
+            Py_DECREF(list);
+            PyMem_Free(live);
+            return NULL;
+        }
+
+        Py_DECREF(station);
+    }
+
+    PyMem_Free(live);
+
+    return list;
+}
+
+/**
+ * Work out a sensor type from a number or a name.
+ *
+ * @return      the type, or -1 with a Python exception set.
+ */
+static int
+sensor_type(PyObject *sensor)
+{
+    PyObject    *ascii;
+    const char  *name;
+    long        type;
+    int         i;
+
+    if (PyNumber_Check(sensor))
+    {
+        if ((type = PyLong_AsLong(sensor)) == -1 && PyErr_Occurred())
+            return -1;
+
+        if (type >= 0 && type <= 255)
+            return (int)type;
+    }
+    else
+    {
+        if (PyUnicode_Check(sensor))
+            ascii = PyUnicode_AsASCIIString(sensor);
+        else
+        {
+            Py_INCREF(sensor);
+            ascii = sensor;
+        }
+
+        if (ascii != NULL && PyBytes_Check(ascii))
+        {
+            name = PyBytes_AsString(ascii);
+
+            for (i = 0; i < 256; i++)
+            {
+                if (strcmp(config_sensor_name(i), name) == 0)
+                {
+                    Py_DECREF(ascii);
+                    return i;
+                }
+            }
+        }
+
+        Py_XDECREF(ascii);
+    }
+
+    PyErr_Clear();
+    PyErr_SetString(PyExc_ValueError, "unknown sensor type");
+    return -1;
+}
+
+static PyObject *
+wlsensor_history(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char     *keywords[] = { "station", "sensor", "start", "end", "config", NULL };
+    int             station;
+    PyObject        *sensor;
+    double          start;
+    double          end;
+    const char      *config_path    = NULL;
+    config_t        cfg;
+    char            sql[512];
+    MYSQL           *mysql;
+    MYSQL_RES       *result         = NULL;
+    MYSQL_ROW       row;
+    PyObject        *times;
+    PyObject        *values;
+    npy_intp        n               = 0;
+    npy_intp        i;
+    double          *t;
+    double          *v;
+    int             type;
+    int             scale;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iOdd|z", keywords,
+            &station, &sensor, &start, &end, &config_path))
+        return NULL;
+
+    if ((type = sensor_type(sensor)) < 0 || load_config(config_path, &cfg) < 0)
+        return NULL;
+
+    snprintf(sql, sizeof(sql),
+        "select unix_timestamp(timestamp), value from sensor"
+        " where station = %d and sensor = %d"
+        " and timestamp >= from_unixtime(%.3f) and timestamp < from_unixtime(%.3f)"
+        " order by timestamp",
+        station, type, start, end);
+
+    /*
+     * The whole result is fetched, so the arrays can be made the right size
+     */
+    Py_BEGIN_ALLOW_THREADS
+    if ((mysql = mysql_init(NULL)) != NULL)
+    {
+        if
+        (
+            mysql_real_connect(mysql, cfg.db_host, cfg.db_user, NULL, cfg.db_name, 0, NULL, 0) != NULL
+            &&
+            mysql_query(mysql, sql) == 0
+        )
+            result = mysql_store_result(mysql);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (result == NULL)
+    {
+        PyErr_Format(PyExc_IOError, "database query failed: %s",
+            mysql != NULL ? mysql_error(mysql) : "out of memory");
+        if (mysql != NULL)
+            mysql_close(mysql);
+        return NULL;
+    }
+
+    n = (npy_intp)mysql_num_rows(result);
+    times = PyArray_SimpleNew(1, &n, NPY_DOUBLE);
+    values = PyArray_SimpleNew(1, &n, NPY_DOUBLE);
+
+    if (times == NULL || values == NULL)
+    {
+        Py_XDECREF(times);
+        Py_XDECREF(values);
+        mysql_free_result(result);
+        mysql_close(mysql);
+        return NULL;
+    }
+
+    t = (double *)PyArray_DATA((PyArrayObject *)times);
+    v = (double *)PyArray_DATA((PyArrayObject *)values);
+    scale = SENSOR_TYPE_SCALE(type);
+
+    for (i = 0; i < n && (row = mysql_fetch_row(result)) != NULL; i++)
+    {
+        t[i] = strtod(row[0], NULL);
+        v[i] = (double)strtol(row[1], NULL, 10) / scale;
+    }
+
+    mysql_free_result(result);
+    mysql_close(mysql);
+
+    return Py_BuildValue("NN", times, values);
+}
+
+static PyMethodDef  wlsensor_methods[] =
+{
+    { "parse",      (PyCFunction)wlsensor_parse,    METH_VARARGS | METH_KEYWORDS,
+        "parse(snapshot, config=None): parse a raw receiver snapshot" },
+    { "read",       (PyCFunction)wlsensor_read,     METH_VARARGS | METH_KEYWORDS,
+        "read(config=None): read the receiver" },
+    { "state",      (PyCFunction)wlsensor_state,    METH_VARARGS | METH_KEYWORDS,
+        "state(config=None): sensord's shared station states" },
+    { "history",    (PyCFunction)wlsensor_history,  METH_VARARGS | METH_KEYWORDS,
+        "history(station, sensor, start, end, config=None): (times, values) from the database" },
+    { NULL }
+};
+
+/**
+ * Fill in the module: the Station type and the flag constants.
+ *
+ * @return      0 for success, or -1 with a Python exception set.
+ */
+static int
+wlsensor_setup(PyObject *module)
+{
+    if (module == NULL)
+        return -1;
+
+    if (station_type.tp_name == NULL)
+        PyStructSequence_InitType(&station_type, &station_desc);
+
+    Py_INCREF(&station_type);
+
+    if
+    (
+        PyModule_AddObject(module, "Station", (PyObject *)&station_type) < 0
+        ||
+        PyModule_AddIntConstant(module, "STALE", LIVESTATE_STALE) < 0
+        ||
+        PyModule_AddIntConstant(module, "BATTERY_LOW", LIVESTATE_BATTERY_LOW) < 0
+    )
+        return -1;
+
+    return 0;
+}
+
+#if PY_MAJOR_VERSION >= 3
+
+static struct PyModuleDef   wlsensor_module =
+{
+    PyModuleDef_HEAD_INIT,
+    "wlsensor",
+    "Wireless sensor readings, from the receiver, sensord or the database",
+    -1,
+    wlsensor_methods
+};
+
+PyMODINIT_FUNC
+PyInit_wlsensor(void)
+{
+    PyObject    *module;
+
+    import_array();
+
+    module = PyModule_Create(&wlsensor_module);
+
+    if (wlsensor_setup(module) < 0)
+    {
+        Py_XDECREF(module);
+        return NULL;
+    }
+
+    return module;
+}
+
+#else
+
+PyMODINIT_FUNC
+initwlsensor(void)
+{
+    PyObject    *module;
+
+    import_array();
+
+    module = Py_InitModule3("wlsensor", wlsensor_methods,
+                "Wireless sensor readings, from the receiver, sensord or the database");
+
+    wlsensor_setup(module);
+}
+
+#endif
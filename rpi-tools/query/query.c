@@ -2,174 +2,349 @@
  * Wireless Receiver for Raspberry Pi
  *
  * Copyright: Rolfe Bozier, rolfe@pobox.com, 2012
+ *
+ * gcc -Wall -I../../include -I../common -o query query.c ../common/receiver.c ../common/livestate.c ../common/snapshot.c ../common/config.c ../common/derived.c -lrt -lm
  */
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 
-#define I2C_DEVICE          "/dev/i2c-0"
-#define I2C_SLAVE_ADDR      0x41
+#include "wireless.h"
+#include "snapshot.h"
+#include "derived.h"
+#include "config.h"
+#include "receiver.h"
+#include "livestate.h"
 
-#define N_SENSOR_TYPES      6
+#define N_SENSOR_TYPES      WL_SENSOR_TYPE_MAX
 
 struct sensor_t
 {
     int     valid;
-    int     value;
+    long    value;
 };
 
+static snapshot_station_t   stations[SNAPSHOT_MAX_STATIONS];
+
+/*
+ * CSV lines have the station ID and age, the value of each sensor type in
+ * order, then the derived values (DERIVED_TYPE_*) in order.
+ */
 static void
-write_as_csv(char *message, int bytes_read)
+write_csv_station
+(
+    int                     id,
+    long                    age,
+    const snapshot_value_t  *values,
+    int                     nvalues,
+    const snapshot_value_t  *derived,
+    int                     n_derived
+)
 {
-    int             i;
-    int             j;
-    int             n_stations;
-    struct sensor_t sensors[N_SENSOR_TYPES];
-    char            *ptr;
-    
-    ptr = &message[2];
-    n_stations = *ptr++;
+    int                 j;
+    struct sensor_t     sensors[N_SENSOR_TYPES];
+    struct sensor_t     derived_sensors[DERIVED_MAX_VALUES];
 
-    for (i = 0; i < n_stations; i++)
-    {
-        int     station_id;
-        int     n_sensors;
-        int     age_offset;
-        int     age;
+    for (j = 0; j < N_SENSOR_TYPES; j++)
+        sensors[j].valid = 0;
 
-        station_id = *ptr++;
-        n_sensors = *ptr++;
-        age_offset = n_sensors * 3;
-        age = (ptr[age_offset + 1] << 8) + ptr[age_offset];
+    for (j = 0; j < nvalues; j++)
+    {
+        int     type    = values[j].type;
 
-        for (j = 0; j < N_SENSOR_TYPES; j++)
-            sensors[j].valid = 0;
+        if (type < 1 || type > N_SENSOR_TYPES)
+            continue;
 
-        for (j = 0; j < n_sensors; j++)
-        {
-            int     type;
-            int     value;
+        sensors[type - 1].valid = 1;
+        sensors[type - 1].value = values[j].value;
+    }
 
-            type = ptr[0];
-            value = (ptr[2] << 8) + ptr[1];
-            ptr += 3;
+    for (j = 0; j < DERIVED_MAX_VALUES; j++)
+        derived_sensors[j].valid = 0;
 
-            sensors[type - 1].valid = 1;
-            sensors[type - 1].value = value;
-        }
-        ptr += 2;   // age
+    for (j = 0; j < n_derived; j++)
+    {
+        derived_sensors[derived[j].type - DERIVED_TYPE_MIN].valid = 1;
+        derived_sensors[derived[j].type - DERIVED_TYPE_MIN].value = derived[j].value;
+    }
 
-        printf("%d,%d,", station_id, age);
+    printf("%d,%ld,", id, age);
 
-        for (j = 0; j < N_SENSOR_TYPES; j++)
-        {
-            if (j > 0)
-                printf(",");
-            if (sensors[j].valid)
-                printf("%d", sensors[j].value);
-        }
+    for (j = 0; j < N_SENSOR_TYPES; j++)
+    {
+        if (j > 0)
+            printf(",");
+        if (sensors[j].valid)
+            printf("%ld", sensors[j].value);
+    }
 
-        printf("\n");
+    for (j = 0; j < DERIVED_MAX_VALUES; j++)
+    {
+        printf(",");
+        if (derived_sensors[j].valid)
+            printf("%ld", derived_sensors[j].value);
     }
+
+    printf("\n");
 }
 
 static void
-write_as_text(char *message, int bytes_read)
+write_as_csv(char *message, int bytes_read, const config_t *cfg)
 {
-    int     i;
-    int     j;
-    int     n_stations;
-    char    *ptr;
-
-    printf("Message bytes=%d type=%d length=%d\n",
-        bytes_read, message[0], message[1]);
+    int                 i;
+    int                 n_stations;
+    int                 n_derived;
+    snapshot_value_t    derived[DERIVED_MAX_VALUES];
 
-    ptr = &message[2];
-    n_stations = *ptr++;
+    n_stations = snapshot_parse((const uint8_t *)message, bytes_read,
+                    stations, SNAPSHOT_MAX_STATIONS);
 
     for (i = 0; i < n_stations; i++)
     {
-        int     station_id;
-        int     n_sensors;
-        int     sensor_type;
-        int     sensor_value;
-        int     age;
+        n_derived = derived_values(stations[i].values, stations[i].nvalues,
+                        config_altitude(cfg, stations[i].id), derived);
 
-        station_id = *ptr++;
-        n_sensors = *ptr++;
+        write_csv_station(stations[i].id, stations[i].age,
+            stations[i].values, stations[i].nvalues, derived, n_derived);
+    }
+}
 
-        printf("Station [%d]\n", station_id);
-        for (j = 0; j < n_sensors; j++)
-        {
-            sensor_type = ptr[0];
-            sensor_value = (ptr[2] << 8) + ptr[1];
-            ptr += 3;
+static void
+write_text_value(int type, long value)
+{
+    int     scale   = SENSOR_TYPE_SCALE(type);
 
-            printf("    sensor type %d = %d\n", sensor_type, sensor_value);
-        }
+    if (type >= DERIVED_TYPE_MIN)
+    {
+        if (scale == 1)
+            printf("    %s = %ld\n", config_sensor_name(type), value);
+        else
+            printf("    %s = %ld (%g)\n",
+                config_sensor_name(type), value, (double)value / scale);
+    }
+    else
+    {
+        if (scale == 1)
+            printf("    sensor type %d = %ld\n", type, value);
+        else
+            printf("    sensor type %d = %ld (%g)\n",
+                type, value, (double)value / scale);
+    }
+}
+
+static void
+write_as_text(char *message, int bytes_read, const config_t *cfg)
+{
+    int                 i;
+    int                 j;
+    int                 n_stations;
+    int                 n_derived;
+    int                 length;
+    uint32_t            clock;
+    snapshot_value_t    derived[DERIVED_MAX_VALUES];
+
+    printf("Message bytes=%d type=%d\n", bytes_read, message[0]);
+
+    if (snapshot_clock((const uint8_t *)message, bytes_read, &clock))
+        printf("Receiver clock=%lu ticks\n", (unsigned long)clock);
+
+    n_stations = snapshot_parse((const uint8_t *)message, bytes_read,
+                    stations, SNAPSHOT_MAX_STATIONS);
+
+    if (n_stations < 0)
+        printf("Malformed message\n");
+
+    for (i = 0; i < n_stations; i++)
+    {
+        printf("Station [%d]\n", stations[i].id);
+        for (j = 0; j < stations[i].nvalues; j++)
+            write_text_value(stations[i].values[j].type, stations[i].values[j].value);
+
+        n_derived = derived_values(stations[i].values, stations[i].nvalues,
+                        config_altitude(cfg, stations[i].id), derived);
 
-        age = (ptr[1] << 8) + ptr[0];
-        ptr += 2;
+        for (j = 0; j < n_derived; j++)
+            write_text_value(derived[j].type, derived[j].value);
 
-        printf("  [last message: %d secs ago]\n", age);
+        printf("  [last message: %.1f secs ago]\n",
+            (double)stations[i].age_ticks * SNAPSHOT_TICK_NS / 1e9);
         printf("\n");
     }
-        
-    for (i = 0; i < message[1]; i++)
+
+    length = snapshot_length((const uint8_t *)message, bytes_read);
+
+    for (i = 0; i < length; i++)
     {
-        printf("%02x ", message[i+2]);
+        printf("%02x ", (uint8_t)message[i]);
         if (i % 16 == 15)
             printf("\n");
     }
     printf("\n");
 }
 
+/*
+ * Write out sensord's shared station states, in the same form as a
+ * snapshot (see livestate.h).
+ */
+static int
+write_live(const char *prog, const char *name, int csv_mode)
+{
+    static livestate_t  live;
+    const livestate_t   *shared;
+    livestate_station_t *st;
+    snapshot_value_t    values[LIVESTATE_MAX_VALUES];
+    snapshot_value_t    derived[LIVESTATE_MAX_VALUES];
+    int                 nvalues;
+    int                 n_derived;
+    struct timespec     ts;
+    int64_t             now;
+    int                 i;
+    int                 j;
+
+    if ((shared = livestate_open(name)) == NULL || !livestate_read(shared, &live))
+    {
+        fprintf(stderr, "%s: failed to read sensord's shared state %s: %s\n",
+            prog, name, strerror(errno));
+        livestate_close(shared);
+        return 0;
+    }
+
+    livestate_close(shared);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+    if (!csv_mode)
+    {
+        printf("Updated %.1f secs ago, polls=%lu\n",
+            (now - live.updated) / 1e3, (unsigned long)live.polls);
+        printf("Receiver clock=%lu ticks, tick=%.3f ns\n",
+            (unsigned long)live.rx_clock, live.tick_ns);
+    }
+
+    for (i = 1; i < 255; i++)
+    {
+        st = &live.stations[i];
+        if (!st->valid)
+            continue;
+
+        nvalues = 0;
+        n_derived = 0;
+        for (j = 0; j < st->nvalues; j++)
+        {
+            if (st->values[j].type >= DERIVED_TYPE_MIN)
+            {
+                derived[n_derived].type = st->values[j].type;
+                derived[n_derived++].value = st->values[j].value;
+            }
+            else
+            {
+                values[nvalues].type = st->values[j].type;
+                values[nvalues++].value = st->values[j].value;
+            }
+        }
+
+        if (csv_mode)
+        {
+            write_csv_station(i, (long)((now - st->received) / 1000),
+                values, nvalues, derived, n_derived);
+            continue;
+        }
+
+        printf("Station [%d]%s%s\n", i,
+            st->flags & LIVESTATE_STALE ? " stale" : "",
+            st->flags & LIVESTATE_BATTERY_LOW ? " battery-low" : "");
+
+        for (j = 0; j < nvalues; j++)
+            write_text_value(values[j].type, values[j].value);
+
+        for (j = 0; j < n_derived; j++)
+            write_text_value(derived[j].type, derived[j].value);
+
+        printf("  [last message: %.1f secs ago]\n", (now - st->received) / 1e3);
+        printf("  [messages: %lu, missed: %lu]\n",
+            (unsigned long)st->messages, (unsigned long)st->missed);
+        printf("\n");
+    }
+
+    return 1;
+}
+
 int
 main(int argc, char **argv)
 {
-    int     opt;
-    int     csv_mode    = 0;
-    int     dev;
-    char    message[1024];
-    int     n;
+    int         opt;
+    int         csv_mode        = 0;
+    int         live_mode       = 0;
+    int         dev;
+    char        message[1024];
+    int         n;
+    config_t    cfg;
+    const char  *config_path    = CONFIG_PATH;
+    int         config_required = 0;
+    int         status;
 
-    while ((opt = getopt(argc, argv, "hc")) != -1)
+    while ((opt = getopt(argc, argv, "hcmf:")) != -1)
     {
         switch (opt)
         {
         case 'c':
             csv_mode = 1;
             break;
+        case 'm':
+            live_mode = 1;
+            break;
+        case 'f':
+            config_path = optarg;
+            config_required = 1;
+            break;
         default:
-            printf("Usage: %s [-c]\n", argv[0]);
+            printf("Usage: %s [-c] [-m] [-f config]\n", argv[0]);
             printf("\t-c\tWrite output as CSV format\n");
+            printf("\t-m\tRead sensord's shared state instead of the receiver\n");
+            printf("\t-f\tConfiguration file (default %s)\n", CONFIG_PATH);
             return 1;
         }
     }
 
-    if ((dev = open(I2C_DEVICE, O_RDWR)) < 0)
+    /*
+     * The default configuration file is optional
+     */
+    config_defaults(&cfg);
+    status = config_load(config_path, &cfg);
+
+    if (status > 0)
     {
-        fprintf(stderr, "%s: failed to open %s: %s\n",
-            argv[0], I2C_DEVICE, strerror(errno));
+        fprintf(stderr, "%s: %s: error at line %d\n",
+            argv[0], config_path, status);
         return 1;
     }
 
-    if (ioctl(dev, I2C_SLAVE, (long)I2C_SLAVE_ADDR) < 0)
+    if (status < 0 && (config_required || errno != ENOENT))
     {
-        fprintf(stderr, "%s: ioctl(I2C_SLAVE) failed: %s\n",
-            argv[0], strerror(errno));
-        close(dev);
+        fprintf(stderr, "%s: failed to read %s: %s\n",
+            argv[0], config_path, strerror(errno));
+        return 1;
+    }
+
+    if (live_mode)
+        return write_live(argv[0], cfg.shared_state, csv_mode) ? 0 : 1;
+
+    if ((dev = receiver_open(&cfg)) < 0)
+    {
+        fprintf(stderr, "%s: failed to open receiver at %s address 0x%02x: %s\n",
+            argv[0], cfg.i2c_device, cfg.i2c_address, strerror(errno));
         return 1;
     }
 
-    if ((n = read(dev, message, 1024)) < 0)
+    if ((n = receiver_read(dev, cfg.i2c_address, message, sizeof(message))) < 0)
     {
         fprintf(stderr, "%s: message read failed: %s\n",
             argv[0], strerror(errno));
@@ -178,9 +353,9 @@ main(int argc, char **argv)
     }
 
     if (csv_mode)
-        write_as_csv(message, n);
+        write_as_csv(message, n, &cfg);
     else
-        write_as_text(message, n);
+        write_as_text(message, n, &cfg);
 
     close(dev);
 
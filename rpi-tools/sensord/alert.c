@@ -0,0 +1,580 @@
+/*
+ * Alert rules engine.
+ *
+ * Each rule keeps a state per station, so a rule for all stations raises
+ * and clears separately for each of them. A raised alert is only cleared
+ * once the value passes the rule's clear level (hysteresis), and an alert
+ * that is raised again within the rule's holdoff time isn't reported.
+ *
+ * Rules are found through a hash of (station, sensor), with rules for all
+ * stations stored under station 0, so a reading costs two hash lookups and
+ * the rules that apply to it.
+ */
+
+#define _DEFAULT_SOURCE     /* for MSG_DONTWAIT */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "wireless.h"
+#include "snapshot.h"
+#include "derived.h"
+#include "config.h"
+#include "alert.h"
+
+/**
+ * The number of hash buckets for the rule index
+ */
+#define ALERT_HASH_SIZE     64
+
+/**
+ * The state of a rule for one station.
+ */
+typedef struct
+{
+    /** the alert is raised */
+    bool                active;
+
+    /** the alert was reported when it was raised */
+    bool                notified;
+
+    /** last_value and last_time are set */
+    bool                have_last;
+
+    /** previous value (rate and gap rules) */
+    int32_t             last_value;
+
+    /** time of the previous value (rate rules) */
+    time_t              last_time;
+
+    /** time the alert was last reported */
+    time_t              last_raised;
+}
+    alert_state_t;
+
+typedef struct
+{
+    /** the rule, as configured */
+    config_alert_t      def;
+
+    /** state, by station ID */
+    alert_state_t       state[256];
+}
+    alert_rule_t;
+
+/**
+ * An entry in the rule index: the rules for a (station, sensor).
+ */
+typedef struct alert_key_t
+{
+    /** station ID (0 for rules for all stations) and sensor type */
+    uint8_t             station;
+    uint8_t             sensor;
+
+    /** the rules, and the number of them */
+    alert_rule_t        *rules[CONFIG_MAX_ALERTS];
+    int                 nrules;
+
+    /** next entry in the hash bucket */
+    struct alert_key_t  *next;
+}
+    alert_key_t;
+
+struct alert_engine_t
+{
+    alert_rule_t        rules[CONFIG_MAX_ALERTS];
+    int                 nrules;
+
+    alert_key_t         *index[ALERT_HASH_SIZE];
+
+    /** socket sink: datagram socket, or -1 */
+    int                 socket_fd;
+    struct sockaddr_un  socket_addr;
+
+    /** webhook sink: spool file path */
+    char                webhook[CONFIG_MAX_STRING];
+
+    /** alerts are tracked, but not reported (see alert_mute()) */
+    bool                muted;
+};
+
+static unsigned int
+alert_hash(uint8_t station, uint8_t sensor)
+{
+    return (station * 31u + sensor) % ALERT_HASH_SIZE;
+}
+
+/**
+ * Find the index entry for a (station, sensor).
+ *
+ * @param[in]   engine      The alert engine.
+ * @param[in]   station     The station ID, or 0 for rules for all stations.
+ * @param[in]   sensor      The sensor type.
+ *
+ * @return      the entry, or NULL if there are no rules for it.
+ */
+static alert_key_t *
+alert_find(const alert_engine_t *engine, uint8_t station, uint8_t sensor)
+{
+    alert_key_t     *key;
+
+    for (key = engine->index[alert_hash(station, sensor)]; key != NULL; key = key->next)
+    {
+        if (key->station == station && key->sensor == sensor)
+            return key;
+    }
+
+    return NULL;
+}
+
+/**
+ * Add a rule to the index.
+ *
+ * @param[in,out]   engine  The alert engine.
+ * @param[in]       rule    The rule.
+ *
+ * @return      zero for success, non-zero otherwise.
+ */
+static int
+alert_index(alert_engine_t *engine, alert_rule_t *rule)
+{
+    uint8_t         station = (uint8_t)rule->def.station;
+    uint8_t         sensor  = (uint8_t)rule->def.sensor;
+    alert_key_t     *key;
+    unsigned int    h;
+
+    if ((key = alert_find(engine, station, sensor)) == NULL)
+    {
+        if ((key = calloc(1, sizeof(alert_key_t))) == NULL)
+            return 1;
+
+        h = alert_hash(station, sensor);
+        key->station = station;
+        key->sensor = sensor;
+        key->next = engine->index[h];
+        engine->index[h] = key;
+    }
+
+    key->rules[key->nrules++] = rule;
+
+    return 0;
+}
+
+/**
+ * Add a rule to the engine.
+ *
+ * @param[in,out]   engine  The alert engine.
+ * @param[in]       def     The rule.
+ * @param[in]       old     The previous engine, whose state for the same
+ *                          rule is carried over, or NULL.
+ *
+ * @return      zero for success, non-zero otherwise.
+ */
+static int
+alert_add(alert_engine_t *engine, const config_alert_t *def, const alert_engine_t *old)
+{
+    alert_rule_t    *rule   = &engine->rules[engine->nrules++];
+    int             i;
+
+    rule->def = *def;
+
+    for (i = 0; old != NULL && i < old->nrules; i++)
+    {
+        if (memcmp(&old->rules[i].def, def, sizeof(*def)) == 0)
+        {
+            memcpy(rule->state, old->rules[i].state, sizeof(rule->state));
+            break;
+        }
+    }
+
+    return alert_index(engine, rule);
+}
+
+/**
+ * Create an alert engine for the configured rules, or for the built-in
+ * station dead and low battery rules if none are configured.
+ *
+ * @param[in]   cfg     The configuration.
+ * @param[in]   old     The engine being replaced, if the configuration has
+ *                      been reloaded (or NULL). Rules that are unchanged
+ *                      keep their state, so raised alerts stay raised.
+ *
+ * @return      the engine, or NULL on error.
+ */
+alert_engine_t *
+alert_start(const config_t *cfg, const alert_engine_t *old)
+{
+    alert_engine_t  *engine;
+    config_alert_t  def;
+    int             sinks   = 0;
+    int             i;
+
+    if ((engine = calloc(1, sizeof(alert_engine_t))) == NULL)
+        return NULL;
+
+    engine->socket_fd = -1;
+
+    for (i = 0; i < cfg->nalerts; i++)
+    {
+        if (alert_add(engine, &cfg->alerts[i], old) != 0)
+        {
+            alert_end(engine);
+            return NULL;
+        }
+        sinks |= cfg->alerts[i].sinks;
+    }
+
+    if (cfg->nalerts == 0)
+    {
+        memset(&def, 0, sizeof(def));
+        strcpy(def.name, "station-dead");
+        def.kind = ALERT_KIND_STALE;
+        def.sensor = WL_SENSOR_TYPE_INVALID;
+        def.threshold = cfg->station_dead_threshold;
+        def.clear = cfg->station_dead_threshold;
+        def.sinks = ALERT_SINK_SYSLOG;
+
+        if (alert_add(engine, &def, old) != 0)
+        {
+            alert_end(engine);
+            return NULL;
+        }
+
+        memset(&def, 0, sizeof(def));
+        strcpy(def.name, "low-battery");
+        def.kind = ALERT_KIND_BELOW;
+        def.sensor = WL_SENSOR_TYPE_BATTERY;
+        def.threshold = cfg->battery_low_threshold + 1;     /* at or below */
+        def.clear = cfg->battery_ok_threshold;
+        def.sinks = ALERT_SINK_SYSLOG;
+
+        if (alert_add(engine, &def, old) != 0)
+        {
+            alert_end(engine);
+            return NULL;
+        }
+    }
+
+    if (sinks & ALERT_SINK_SOCKET)
+    {
+        engine->socket_addr.sun_family = AF_UNIX;
+        strncpy(engine->socket_addr.sun_path, cfg->alert_socket,
+            sizeof(engine->socket_addr.sun_path) - 1);
+
+        if ((engine->socket_fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+            syslog(LOG_WARNING, "warning: failed to create alert socket: %s", strerror(errno));
+    }
+
+    strcpy(engine->webhook, cfg->alert_webhook);
+
+    return engine;
+}
+
+/**
+ * Stop an alert engine reporting alerts, for replaying old readings. The
+ * rules are still checked, so a replay costs the same.
+ *
+ * @param[in,out]   engine  The alert engine.
+ */
+void
+alert_mute(alert_engine_t *engine)
+{
+    engine->muted = true;
+}
+
+/**
+ * Free an alert engine.
+ *
+ * @param[in]   engine  The alert engine.
+ */
+void
+alert_end(alert_engine_t *engine)
+{
+    alert_key_t     *key;
+    int             i;
+
+    if (engine == NULL)
+        return;
+
+    for (i = 0; i < ALERT_HASH_SIZE; i++)
+    {
+        while ((key = engine->index[i]) != NULL)
+        {
+            engine->index[i] = key->next;
+            free(key);
+        }
+    }
+
+    if (engine->socket_fd >= 0)
+        close(engine->socket_fd);
+
+    free(engine);
+}
+
+/**
+ * Report an alert being raised or cleared to the rule's sinks.
+ *
+ * @param[in]   engine      The alert engine.
+ * @param[in]   rule        The rule.
+ * @param[in]   station     The station ID.
+ * @param[in]   raised      The alert was raised (rather than cleared).
+ * @param[in]   value       The value that was checked.
+ * @param[in]   when        The time of the reading.
+ */
+static void
+alert_notify
+(
+    alert_engine_t      *engine,
+    const alert_rule_t  *rule,
+    uint8_t             station,
+    bool                raised,
+    int64_t             value,
+    time_t              when
+)
+{
+    const config_alert_t    *def    = &rule->def;
+    const char              *sensor = config_sensor_name(def->sensor);
+    char                    what[32];
+    char                    json[256];
+    int                     scale   = 1;
+    int                     fd;
+    int                     n;
+
+    if (engine->muted)
+        return;
+
+    switch (def->kind)
+    {
+    case ALERT_KIND_RATE:
+        snprintf(what, sizeof(what), "%s change per hour", sensor);
+        scale = SENSOR_TYPE_SCALE(def->sensor);
+        break;
+    case ALERT_KIND_STALE:
+        strcpy(what, "seconds since last message");
+        break;
+    case ALERT_KIND_GAP:
+        strcpy(what, "messages missed");
+        break;
+    default:
+        snprintf(what, sizeof(what), "%s", sensor);
+        scale = SENSOR_TYPE_SCALE(def->sensor);
+        break;
+    }
+
+    if (def->sinks & ALERT_SINK_SYSLOG)
+    {
+        if (raised)
+            syslog(LOG_ERR, "error: alert %s: station %d %s %g (threshold %g)",
+                def->name, station, what, (double)value / scale, (double)def->threshold / scale);
+        else
+            syslog(LOG_NOTICE, "alert %s cleared: station %d %s %g",
+                def->name, station, what, (double)value / scale);
+    }
+
+    if ((def->sinks & (ALERT_SINK_SOCKET | ALERT_SINK_WEBHOOK)) == 0)
+        return;
+
+    n = snprintf(json, sizeof(json),
+            "{\"alert\":\"%s\",\"state\":\"%s\",\"time\":%ld,\"station\":%d,"
+            "\"measure\":\"%s\",\"value\":%g,\"threshold\":%g,\"clear\":%g}\n",
+            def->name, raised ? "raised" : "cleared", (long)when, station,
+            what, (double)value / scale, (double)def->threshold / scale,
+            (double)def->clear / scale);
+
+    if (n < 0 || n >= (int)sizeof(json))
+        return;
+
+    /*
+     * Nobody need be listening on the socket, so don't wait or complain
+     */
+    if ((def->sinks & ALERT_SINK_SOCKET) && engine->socket_fd >= 0)
+        sendto(engine->socket_fd, json, n, MSG_DONTWAIT,
+            (const struct sockaddr *)&engine->socket_addr, sizeof(engine->socket_addr));
+
+    /*
+     * Stand-in for a webhook: append to a spool file for a poster to pick up
+     */
+    if (def->sinks & ALERT_SINK_WEBHOOK)
+    {
+        if
+        (
+            (fd = open(engine->webhook, O_WRONLY | O_APPEND | O_CREAT, 0644)) < 0
+            ||
+            write(fd, json, n) != n
+        )
+            syslog(LOG_WARNING, "warning: failed to write alert to %s: %s",
+                engine->webhook, strerror(errno));
+
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+/**
+ * Check a value against a rule for a station, raising or clearing the
+ * alert as needed.
+ *
+ * @param[in,out]   engine      The alert engine.
+ * @param[in,out]   rule        The rule.
+ * @param[in]       station     The station ID.
+ * @param[in]       value       The value to check.
+ * @param[in]       when        The time of the reading.
+ */
+static void
+alert_check
+(
+    alert_engine_t  *engine,
+    alert_rule_t    *rule,
+    uint8_t         station,
+    int64_t         value,
+    time_t          when
+)
+{
+    const config_alert_t    *def    = &rule->def;
+    alert_state_t           *st     = &rule->state[station];
+    bool                    below   = def->kind == ALERT_KIND_BELOW;
+
+    if (!st->active)
+    {
+        if (below ? value < def->threshold : value > def->threshold)
+        {
+            st->active = true;
+            st->notified = st->last_raised == 0 || when - st->last_raised >= def->holdoff;
+
+            if (st->notified)
+            {
+                st->last_raised = when;
+                alert_notify(engine, rule, station, true, value, when);
+            }
+        }
+    }
+    else
+    {
+        if (below ? value >= def->clear : value <= def->clear)
+        {
+            st->active = false;
+
+            if (st->notified)
+                alert_notify(engine, rule, station, false, value, when);
+        }
+    }
+}
+
+/**
+ * Check a reading against a list of rules.
+ *
+ * @param[in,out]   engine      The alert engine.
+ * @param[in]       key         The index entry holding the rules, or NULL.
+ * @param[in]       station     The station ID.
+ * @param[in]       value       The sensor value.
+ * @param[in]       when        The time of the reading.
+ */
+static void
+alert_rules
+(
+    alert_engine_t  *engine,
+    alert_key_t     *key,
+    uint8_t         station,
+    int32_t         value,
+    time_t          when
+)
+{
+    alert_rule_t    *rule;
+    alert_state_t   *st;
+    int64_t         change;
+    int             i;
+
+    for (i = 0; key != NULL && i < key->nrules; i++)
+    {
+        rule = key->rules[i];
+        st = &rule->state[station];
+
+        switch (rule->def.kind)
+        {
+        case ALERT_KIND_RATE:
+            /*
+             * Change per hour since the previous reading
+             */
+            if (st->have_last && when > st->last_time)
+            {
+                change = (int64_t)value - st->last_value;
+                if (change < 0)
+                    change = -change;
+
+                alert_check(engine, rule, station, change * 3600 / (when - st->last_time), when);
+            }
+            break;
+
+        case ALERT_KIND_GAP:
+            /*
+             * The counter advances by one per message, and wraps
+             */
+            if (st->have_last && value != st->last_value)
+                alert_check(engine, rule, station,
+                    snapshot_missed(value, st->last_value), when);
+            break;
+
+        default:
+            alert_check(engine, rule, station, value, when);
+            break;
+        }
+
+        st->have_last = true;
+        st->last_value = value;
+        st->last_time = when;
+    }
+}
+
+/**
+ * Check a new sensor reading against the rules for it.
+ *
+ * @param[in,out]   engine      The alert engine.
+ * @param[in]       station     The station ID.
+ * @param[in]       sensor      The sensor type.
+ * @param[in]       value       The sensor value.
+ * @param[in]       when        The time of the reading.
+ */
+void
+alert_reading
+(
+    alert_engine_t  *engine,
+    uint8_t         station,
+    uint8_t         sensor,
+    int32_t         value,
+    time_t          when
+)
+{
+    alert_rules(engine, alert_find(engine, station, sensor), station, value, when);
+    alert_rules(engine, alert_find(engine, 0, sensor), station, value, when);
+}
+
+/**
+ * Check the age of a station's last message against the staleness rules.
+ *
+ * @param[in,out]   engine      The alert engine.
+ * @param[in]       station     The station ID.
+ * @param[in]       age         The age of the last message, in seconds.
+ * @param[in]       now         The current time.
+ */
+void
+alert_age
+(
+    alert_engine_t  *engine,
+    uint8_t         station,
+    int32_t         age,
+    time_t          now
+)
+{
+    alert_reading(engine, station, WL_SENSOR_TYPE_INVALID, age, now);
+}
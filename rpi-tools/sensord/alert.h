@@ -0,0 +1,34 @@
+#ifndef __ALERT_H__
+#define __ALERT_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include "config.h"
+
+/*
+ * Alert rules engine. Rules (see config.h) are indexed by station and
+ * sensor, so each reading is only checked against the rules for it.
+ */
+typedef struct alert_engine_t   alert_engine_t;
+
+extern alert_engine_t   *alert_start(const config_t *cfg, const alert_engine_t *old);
+extern void             alert_end(alert_engine_t *engine);
+extern void             alert_mute(alert_engine_t *engine);
+extern void             alert_reading
+                        (
+                            alert_engine_t  *engine,
+                            uint8_t         station,
+                            uint8_t         sensor,
+                            int32_t         value,
+                            time_t          when
+                        );
+extern void             alert_age
+                        (
+                            alert_engine_t  *engine,
+                            uint8_t         station,
+                            int32_t         age,
+                            time_t          now
+                        );
+
+#endif /* __ALERT_H__ */
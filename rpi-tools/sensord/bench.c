@@ -0,0 +1,369 @@
+/*
+ * Benchmark for the sensord ingest pipeline.
+ *
+ * Feeds synthetic receiver snapshots through process_message() and reports
+ * the readings processed per second, the latency of each database insert,
+ * and the heap allocations made per reading. Linked with db_fake.c it
+ * measures sensord alone; linked with db.c it includes a real MySQL server.
+ *
+ * Each snapshot holds the given number of stations, each reporting a
+ * counter and the given number of sensors. On each round, the given
+ * percentage of stations have a new reading (their counter advances), and
+ * the rest repeat their previous one.
+ *
+ * Insert latency and allocations are measured by wrapping db_insert() and
+ * malloc() with the linker (see the Makefile). Allocations made inside the
+ * MySQL client library are not counted.
+ */
+
+#define _POSIX_C_SOURCE 200112L     /* for getopt */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+
+#include "wireless.h"
+#include "snapshot.h"
+#include "config.h"
+#include "derived.h"
+#include "capture.h"
+#include "db.h"
+#include "alert.h"
+#include "rxclock.h"
+#include "livestate.h"
+#include "ingest.h"
+
+/**
+ * The sensor types a station can report, besides its counter
+ */
+static const uint8_t    SENSOR_TYPES[]  =
+{
+    WL_SENSOR_TYPE_TEMPERATURE,
+    WL_SENSOR_TYPE_HUMIDITY,
+    WL_SENSOR_TYPE_PRESSURE,
+    WL_SENSOR_TYPE_LIGHT,
+    WL_SENSOR_TYPE_BATTERY
+};
+
+/**
+ * Typical values for each of the above, so that sensord sees no alarms
+ */
+static const int32_t    SENSOR_VALUES[] =
+{
+    215,        /* 21.5C */
+    550,        /* 55.0% */
+    10132,      /* 1013.2hPa */
+    1200,
+    30          /* 3.0V */
+};
+
+#define MAX_SENSORS     (sizeof(SENSOR_TYPES) / sizeof(SENSOR_TYPES[0]))
+
+/**
+ * The most stations in a snapshot (IDs 0 and 255 are not valid)
+ */
+#define MAX_STATIONS    254
+
+/**
+ * The largest synthetic snapshot
+ */
+#define SNAPSHOT_SIZE   \
+    (8 + MAX_STATIONS * (WL_SENSOR_MSG_HDR_LEN + (MAX_SENSORS + 1) \
+        * (1 + WL_SENSOR_VALUE_MAX_WIDTH) + 4))
+
+/**
+ * The time between rounds, as if sensord were polling the receiver
+ */
+#define ROUND_NS        (45 * 1000000000ULL)
+
+/**
+ * The age of every station's message, in receiver clock ticks (30 s)
+ */
+#define AGE_TICKS       (30 * 1000000000ULL / SNAPSHOT_TICK_NS)
+
+/*
+ * Insert latencies, in nanoseconds, and the number of allocations, kept by
+ * the wrappers below.
+ */
+static uint32_t         *latency;
+static unsigned long    nlatency;
+static unsigned long    maxlatency;
+static unsigned long    nalloc;
+
+extern bool             __real_db_insert(db_t *, uint8_t, uint8_t, int32_t, int64_t);
+extern void             *__real_malloc(size_t size);
+
+bool
+__wrap_db_insert
+(
+    db_t        *db,
+    uint8_t     station_id,
+    uint8_t     sensor_type,
+    int32_t     sensor_value,
+    int64_t     timestamp
+)
+{
+    uint64_t    start   = capture_now();
+    bool        status;
+
+    status = __real_db_insert(db, station_id, sensor_type, sensor_value, timestamp);
+
+    if (nlatency < maxlatency)
+        latency[nlatency++] = (uint32_t)(capture_now() - start);
+
+    return status;
+}
+
+void *
+__wrap_malloc(size_t size)
+{
+    nalloc++;
+    return __real_malloc(size);
+}
+
+static int
+compare_latency(const void *a, const void *b)
+{
+    uint32_t    x   = *(const uint32_t *)a;
+    uint32_t    y   = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Build a snapshot for a round of the benchmark.
+ *
+ * @param[out]  buf         The snapshot buffer (SNAPSHOT_SIZE bytes).
+ * @param[in]   round       The round number.
+ * @param[in]   nstations   The number of stations.
+ * @param[in]   nsensors    The number of sensors per station.
+ * @param[in]   change      The percentage of stations with a new reading.
+ *
+ * @return      the length of the snapshot.
+ */
+static int
+make_snapshot(uint8_t *buf, long round, int nstations, int nsensors, int change)
+{
+    uint8_t     *p      = buf + 7;
+    uint32_t    clock   = (uint32_t)(round * ROUND_NS / SNAPSHOT_TICK_NS);
+    int32_t     seqno;
+    int         length;
+    int         i;
+    int         j;
+
+    *p++ = (uint8_t)nstations;
+
+    for (i = 0; i < nstations; i++)
+    {
+        /*
+         * Spread the changing stations evenly over the rounds
+         */
+        seqno = (int32_t)((round * change + i * 37 % 100) / 100);
+
+        *p++ = (uint8_t)(i + 1);
+        *p++ = WL_SENSOR_MSG_NVALUES(WL_SENSOR_MSG_VERSION_1, nsensors + 1);
+        p = wl_sensor_put_value(p, WL_SENSOR_TYPE_COUNTER, seqno);
+
+        for (j = 0; j < nsensors; j++)
+            p = wl_sensor_put_value(p, SENSOR_TYPES[j], SENSOR_VALUES[j] + seqno % 5);
+
+        *p++ = (uint8_t)AGE_TICKS;
+        *p++ = (uint8_t)(AGE_TICKS >> 8);
+        *p++ = (uint8_t)(AGE_TICKS >> 16);
+        *p++ = (uint8_t)(AGE_TICKS >> 24);
+    }
+
+    length = p - buf;
+
+    buf[0] = SNAPSHOT_TYPE_V2;
+    buf[1] = (uint8_t)(length - 3);
+    buf[2] = (uint8_t)((length - 3) >> 8);
+    buf[3] = (uint8_t)clock;
+    buf[4] = (uint8_t)(clock >> 8);
+    buf[5] = (uint8_t)(clock >> 16);
+    buf[6] = (uint8_t)(clock >> 24);
+
+    return length;
+}
+
+/**
+ * Print a usage message.
+ *
+ * @param[in]   prog    The program name.
+ */
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s stations] [-n sensors] [-c change] [-r rounds] [-b heartbeat] [-m shared]\n", prog);
+    fprintf(stderr, "\t-s\tStations per snapshot (1-%d, default 32)\n", MAX_STATIONS);
+    fprintf(stderr, "\t-n\tSensors per station (0-%d, default 3)\n", (int)MAX_SENSORS);
+    fprintf(stderr, "\t-c\tPercentage of stations with a new reading per round (default 100)\n");
+    fprintf(stderr, "\t-r\tNumber of rounds (default 1000)\n");
+    fprintf(stderr, "\t-b\tSeconds between rows for unchanged values (default 0: store all)\n");
+    fprintf(stderr, "\t-m\tPublish station states in this shared memory segment\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    static uint8_t      snapshot[SNAPSHOT_SIZE];
+    alert_engine_t      *alerts;
+    reading_t           *sensor_state   = NULL;
+    rxclock_t           clock;
+    capture_time_t      read_time;
+    db_t                *db;
+    config_t            cfg;
+    int                 nstations       = 32;
+    int                 nsensors        = 3;
+    int                 change          = 100;
+    long                rounds          = 1000;
+    int                 heartbeat       = 0;
+    const char          *shared         = NULL;
+    livestate_t         *live           = NULL;
+    uint64_t            elapsed         = 0;
+    uint64_t            start;
+    unsigned long       readings;
+    long                round;
+    int                 length;
+    int                 opt;
+
+    while ((opt = getopt(argc, argv, "s:n:c:r:b:m:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            nstations = atoi(optarg);
+            break;
+        case 'n':
+            nsensors = atoi(optarg);
+            break;
+        case 'c':
+            change = atoi(optarg);
+            break;
+        case 'r':
+            rounds = atol(optarg);
+            break;
+        case 'b':
+            heartbeat = atoi(optarg);
+            break;
+        case 'm':
+            shared = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if
+    (
+        nstations < 1 || nstations > MAX_STATIONS
+        ||
+        nsensors < 0 || nsensors > (int)MAX_SENSORS
+        ||
+        change < 0 || change > 100
+        ||
+        rounds < 1
+        ||
+        heartbeat < 0
+    )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    openlog("sensord-bench", LOG_PERROR, LOG_LOCAL1);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    /*
+     * At most one insert per sensor and derived value per round, plus the
+     * first round
+     */
+    maxlatency = (unsigned long)(rounds + 1) * nstations * (nsensors + DERIVED_MAX_VALUES);
+    if ((latency = calloc(maxlatency ? maxlatency : 1, sizeof(uint32_t))) == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    config_defaults(&cfg);
+    cfg.heartbeat = heartbeat;
+
+    if (db_start(&db, &cfg) != 0)
+    {
+        fprintf(stderr, "Database initialisation failed\n");
+        return 1;
+    }
+
+    if ((alerts = alert_start(&cfg, NULL)) == NULL)
+    {
+        fprintf(stderr, "Alert initialisation failed\n");
+        return 1;
+    }
+
+    if (shared != NULL && (live = livestate_create(shared)) == NULL)
+    {
+        fprintf(stderr, "Failed to create shared state %s\n", shared);
+        return 1;
+    }
+
+    /*
+     * Round zero fills in the sensor states, and isn't counted
+     */
+    length = make_snapshot(snapshot, 0, nstations, nsensors, change);
+    rxclock_init(&clock);
+    capture_time(&read_time);
+    process_message((const char *)snapshot, length, &read_time, &clock, alerts, &sensor_state, db, live, &cfg);
+
+    nlatency = 0;
+    nalloc = 0;
+
+    for (round = 1; round <= rounds; round++)
+    {
+        length = make_snapshot(snapshot, round, nstations, nsensors, change);
+
+        read_time.monotonic += ROUND_NS;
+        read_time.realtime += ROUND_NS;
+
+        start = capture_now();
+
+        if (!process_message((const char *)snapshot, length, &read_time,
+                &clock, alerts, &sensor_state, db, live, &cfg))
+        {
+            fprintf(stderr, "message process failed\n");
+            return 1;
+        }
+
+        elapsed += capture_now() - start;
+    }
+
+    readings = (unsigned long)rounds * nstations * (nsensors + 1);
+
+    printf("%d stations, %d sensors, %d%% change, %ld rounds\n",
+        nstations, nsensors, change, rounds);
+    printf("readings:     %lu in %.3f s: %.0f readings/s\n",
+        readings, elapsed / 1e9, elapsed ? readings / (elapsed / 1e9) : 0.0);
+    printf("inserts:      %lu\n", nlatency);
+
+    if (nlatency != 0)
+    {
+        qsort(latency, nlatency, sizeof(uint32_t), compare_latency);
+        printf("insert p50:   %.3f us\n", latency[nlatency / 2] / 1e3);
+        printf("insert p99:   %.3f us\n", latency[nlatency * 99 / 100] / 1e3);
+    }
+
+    printf("allocations:  %lu (%.3f per reading)\n", nalloc, (double)nalloc / readings);
+
+    sensor_state_free(&sensor_state);
+    livestate_remove(live, shared);
+    alert_end(alerts);
+    db_end(db);
+    free(latency);
+    closelog();
+
+    return 0;
+}
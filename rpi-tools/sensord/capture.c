@@ -0,0 +1,274 @@
+/*
+ * Capture and replay of raw receiver snapshots.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* for clock_gettime, nanosleep */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "capture.h"
+
+#define CAPTURE_MAGIC       "RFSC"
+#define CAPTURE_HDR_LEN     8
+#define CAPTURE_REC_LEN     18
+#define CAPTURE_REC_LEN_V1  10
+
+/**
+ * The capture file version being read. Files are only read one at a time.
+ */
+static int      capture_read_version;
+
+/**
+ * Get a little-endian 64-bit integer.
+ */
+static uint64_t
+get_u64(const uint8_t *p)
+{
+    uint64_t    v   = 0;
+    int         i;
+
+    for (i = 0; i < 8; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+
+    return v;
+}
+
+/**
+ * Put a little-endian 64-bit integer.
+ */
+static void
+put_u64(uint8_t *p, uint64_t v)
+{
+    int         i;
+
+    for (i = 0; i < 8; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+/**
+ * Open a capture file for appending snapshots to. A new (or empty) file is
+ * given a header; an existing one has its header checked, so a restarted
+ * sensord carries on with the same capture rather than replacing it.
+ *
+ * @param[in]   path    The name of the file.
+ *
+ * @return      the open file, or NULL on failure (errno is EINVAL if the
+ *              file isn't a capture file of the current version).
+ */
+FILE *
+capture_open_write(const char *path)
+{
+    uint8_t     hdr[CAPTURE_HDR_LEN];
+    FILE        *f;
+    long        size;
+
+    if ((f = fopen(path, "a+b")) == NULL)
+        return NULL;
+
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    if (size == 0)
+    {
+        memset(hdr, 0, sizeof(hdr));
+        memcpy(hdr, CAPTURE_MAGIC, 4);
+        hdr[4] = CAPTURE_VERSION;
+
+        if (fwrite(hdr, sizeof(hdr), 1, f) != 1 || fflush(f) != 0)
+        {
+            fclose(f);
+            return NULL;
+        }
+
+        return f;
+    }
+
+    /*
+     * Records are only appended to a file of the same version
+     */
+    rewind(f);
+
+    if
+    (
+        fread(hdr, sizeof(hdr), 1, f) != 1
+        ||
+        memcmp(hdr, CAPTURE_MAGIC, 4) != 0
+        ||
+        hdr[4] != CAPTURE_VERSION
+    )
+    {
+        fclose(f);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    return f;
+}
+
+/**
+ * Append a snapshot to a capture file. The snapshot is flushed straight
+ * away, so a capture is usable up to the last snapshot if sensord dies.
+ *
+ * @param[in]   f           The capture file.
+ * @param[in]   timestamp   The time the snapshot was read (capture_time()).
+ * @param[in]   data        The snapshot data.
+ * @param[in]   length      The length of the snapshot data.
+ *
+ * @return      true for success, false otherwise.
+ */
+bool
+capture_write(FILE *f, const capture_time_t *timestamp, const void *data, int length)
+{
+    uint8_t     rec[CAPTURE_REC_LEN];
+
+    if (length <= 0 || length > CAPTURE_MAX_LENGTH)
+        return false;
+
+    put_u64(rec, timestamp->monotonic);
+    put_u64(rec + 8, timestamp->realtime);
+    rec[16] = (uint8_t)length;
+    rec[17] = (uint8_t)(length >> 8);
+
+    if (fwrite(rec, sizeof(rec), 1, f) != 1)
+        return false;
+
+    if (fwrite(data, length, 1, f) != 1)
+        return false;
+
+    return fflush(f) == 0;
+}
+
+/**
+ * Open a capture file, and check its header. Version 1 files, which don't
+ * have the real time of each snapshot, can still be read.
+ *
+ * @param[in]   path    The name of the file.
+ *
+ * @return      the open file, or NULL on failure.
+ */
+FILE *
+capture_open_read(const char *path)
+{
+    uint8_t     hdr[CAPTURE_HDR_LEN];
+    FILE        *f;
+
+    if ((f = fopen(path, "rb")) == NULL)
+        return NULL;
+
+    if
+    (
+        fread(hdr, sizeof(hdr), 1, f) != 1
+        ||
+        memcmp(hdr, CAPTURE_MAGIC, 4) != 0
+        ||
+        (hdr[4] != CAPTURE_VERSION && hdr[4] != 1)
+    )
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    capture_read_version = hdr[4];
+
+    return f;
+}
+
+/**
+ * Read the next snapshot from a capture file.
+ *
+ * @param[in]   f           The capture file.
+ * @param[out]  timestamp   The time the snapshot was read. The real time is
+ *                          zero for version 1 files.
+ * @param[out]  data        Where to store the snapshot data.
+ * @param[in]   size        The size of data.
+ *
+ * @return      the length of the snapshot, 0 at the end of the file, or
+ *              -1 if the file is truncated or corrupt.
+ */
+int
+capture_read(FILE *f, capture_time_t *timestamp, void *data, int size)
+{
+    uint8_t     rec[CAPTURE_REC_LEN];
+    int         rec_len;
+    int         length;
+
+    rec_len = capture_read_version == 1 ? CAPTURE_REC_LEN_V1 : CAPTURE_REC_LEN;
+
+    if (fread(rec, rec_len, 1, f) != 1)
+        return feof(f) ? 0 : -1;
+
+    timestamp->monotonic = get_u64(rec);
+    timestamp->realtime = rec_len == CAPTURE_REC_LEN ? get_u64(rec + 8) : 0;
+    length = rec[rec_len - 2] | (rec[rec_len - 1] << 8);
+
+    if (length == 0 || length > size)
+        return -1;
+
+    if (fread(data, length, 1, f) != 1)
+        return -1;
+
+    return length;
+}
+
+/**
+ * Return the current CLOCK_MONOTONIC time, in nanoseconds.
+ */
+uint64_t
+capture_now(void)
+{
+    struct timespec     ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Get the current time on both clocks. The monotonic clock is read either
+ * side of the real time clock, and the midpoint taken, so the pair is as
+ * close as we can make it.
+ *
+ * @param[out]  t       The current time.
+ */
+void
+capture_time(capture_time_t *t)
+{
+    struct timespec     ts;
+    uint64_t            before;
+
+    before = capture_now();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    t->monotonic = before + (capture_now() - before) / 2;
+    t->realtime = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Sleep for a number of nanoseconds. An interrupted sleep just returns
+ * early.
+ *
+ * @param[in]   ns      The time to sleep.
+ */
+void
+capture_sleep(uint64_t ns)
+{
+    struct timespec     ts;
+
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+
+    nanosleep(&ts, NULL);
+}
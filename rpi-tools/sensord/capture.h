@@ -0,0 +1,58 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Capture files hold raw receiver snapshots, so that they can be replayed
+ * through sensord later. Snapshots are appended to an existing capture, so
+ * one file can span several runs of sensord (and the monotonic times can
+ * go back where sensord was restarted). All integers are LSB first.
+ *
+ * File header:
+ *  4   "RFSC"
+ *  1   file format version (CAPTURE_VERSION)
+ *  3   reserved (zero)
+ *
+ * Then per snapshot:
+ *  8   CLOCK_MONOTONIC time the snapshot was read, in nanoseconds
+ *  8   CLOCK_REALTIME time the snapshot was read, in nanoseconds since the
+ *      epoch (not in version 1 files)
+ *  2   snapshot length (n)
+ *  n   snapshot data, as read from the receiver
+ */
+#define CAPTURE_VERSION     2
+
+/*
+ * The time a snapshot was read, on both clocks. The monotonic time is for
+ * measuring intervals (it never steps); the real time for timestamping the
+ * readings in the snapshot. The two are read together, so one can be
+ * mapped to the other.
+ */
+typedef struct
+{
+    /** CLOCK_MONOTONIC, in nanoseconds */
+    uint64_t            monotonic;
+
+    /** CLOCK_REALTIME, in nanoseconds since the epoch (0 if not known) */
+    uint64_t            realtime;
+}
+    capture_time_t;
+
+/*
+ * The largest snapshot that can be captured
+ */
+#define CAPTURE_MAX_LENGTH  1024
+
+extern FILE     *capture_open_write(const char *path);
+extern bool     capture_write(FILE *f, const capture_time_t *timestamp, const void *data, int length);
+extern FILE     *capture_open_read(const char *path);
+extern int      capture_read(FILE *f, capture_time_t *timestamp, void *data, int size);
+
+extern uint64_t capture_now(void);
+extern void     capture_time(capture_time_t *t);
+extern void     capture_sleep(uint64_t ns);
+
+#endif /* __CAPTURE_H__ */
@@ -0,0 +1,138 @@
+/*
+ * sensord's control socket.
+ */
+
+#define _DEFAULT_SOURCE     /* for SOCK_NONBLOCK, SOCK_CLOEXEC */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "control.h"
+
+/**
+ * The longest command
+ */
+#define CONTROL_MAX_LENGTH  32
+
+/**
+ * Command names, indexed by CONTROL_*
+ */
+static const char *const    control_commands[]  =
+{
+    NULL, "poll", "reload", "trace"
+};
+
+#define N_CONTROL_COMMANDS  (sizeof(control_commands) / sizeof(control_commands[0]))
+
+/**
+ * Create the control socket. Any old socket left at the path is removed
+ * first.
+ *
+ * @param[in]   path    The socket's path.
+ *
+ * @return      the socket, or -1 on error (see errno).
+ */
+int
+control_open(const char *path)
+{
+    struct sockaddr_un  addr;
+    int                 fd;
+    int                 saved_errno;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+
+    unlink(path);
+
+    if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Read the next command from the control socket, and acknowledge it.
+ *
+ * @param[in]   fd      The control socket.
+ *
+ * @return      the command (CONTROL_*), or CONTROL_NONE if there are no
+ *              more waiting.
+ */
+int
+control_read(int fd)
+{
+    char                buf[CONTROL_MAX_LENGTH + 1];
+    struct sockaddr_un  from;
+    socklen_t           fromlen     = sizeof(from);
+    const char          *reply;
+    ssize_t             n;
+    int                 command;
+
+    if ((n = recvfrom(fd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&from, &fromlen)) < 0)
+        return CONTROL_NONE;
+
+    /*
+     * Allow a trailing newline, as from "echo poll | socat ..."
+     */
+    buf[n] = '\0';
+    if (n > 0 && buf[n - 1] == '\n')
+        buf[--n] = '\0';
+
+    for (command = 1; command < (int)N_CONTROL_COMMANDS; command++)
+    {
+        if (strcmp(buf, control_commands[command]) == 0)
+            break;
+    }
+
+    if (command == (int)N_CONTROL_COMMANDS)
+    {
+        command = CONTROL_UNKNOWN;
+        reply = "error: unknown command\n";
+    }
+    else
+        reply = "ok\n";
+
+    /*
+     * Unbound senders have no address to reply to
+     */
+    if (fromlen > sizeof(from.sun_family))
+        sendto(fd, reply, strlen(reply), MSG_DONTWAIT, (const struct sockaddr *)&from, fromlen);
+
+    return command;
+}
+
+/**
+ * Close the control socket, and remove it.
+ *
+ * @param[in]   fd      The control socket, or -1.
+ * @param[in]   path    The socket's path.
+ */
+void
+control_close(int fd, const char *path)
+{
+    if (fd < 0)
+        return;
+
+    close(fd);
+    unlink(path);
+}
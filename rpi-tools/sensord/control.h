@@ -0,0 +1,22 @@
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+/*
+ * sensord's control socket: a local datagram socket taking one command per
+ * datagram. A sender with an address of its own gets "ok" or an error back.
+ *
+ *  poll        poll the receiver now
+ *  reload      reread the configuration
+ *  trace       write out the event trace
+ */
+#define CONTROL_NONE        0   /* no more commands waiting */
+#define CONTROL_POLL        1
+#define CONTROL_RELOAD      2
+#define CONTROL_TRACE       3
+#define CONTROL_UNKNOWN     4   /* not a command */
+
+extern int              control_open(const char *path);
+extern int              control_read(int fd);
+extern void             control_close(int fd, const char *path);
+
+#endif /* __CONTROL_H__ */
@@ -0,0 +1,333 @@
+/*
+ * Storage of sensor readings in a MySQL database table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <mysql/mysql.h>
+
+#include "config.h"
+#include "db.h"
+
+/**
+ * The text of the SQL insert statement
+ */
+static const char       *SQL_TEXT           = "insert into sensor (timestamp, station, sensor, value)"
+                                                "values(from_unixtime(? / 1000), ?, ?, ?)";
+
+/**
+ * The number of bind parameters in the above statement.
+ */
+static const int        SQL_NBIND           = 4;    /* must match the statement above */
+
+/**
+ * The text of the SQL insert statement for suspect readings
+ */
+static const char       *SQL_QUARANTINE_TEXT = "insert into sensor_quarantine (timestamp, station, sensor, value, median)"
+                                                "values(from_unixtime(? / 1000), ?, ?, ?, ?)";
+
+static const int        SQL_QUARANTINE_NBIND = 5;   /* must match the statement above */
+
+/**
+ * The text of the SQL insert statement for the receiver's diagnostics
+ */
+static const char       *SQL_DIAG_TEXT      = "insert into receiver_diagnostics (timestamp, reset_cause,"
+                                                " watchdog_timeouts, uptime, overruns, errors, dropped, sram_free)"
+                                                "values(from_unixtime(? / 1000), ?, ?, ?, ?, ?, ?, ?)";
+
+static const int        SQL_DIAG_NBIND      = 8;    /* must match the statement above */
+
+/**
+ * A database connection, with the prepared insert statements.
+ */
+struct db_t
+{
+    MYSQL               *inst;
+    MYSQL_STMT          *stmt;
+    MYSQL_STMT          *quarantine_stmt;
+    MYSQL_STMT          *diag_stmt;
+};
+
+/**
+ * Connect to the database and create a prepared insert statement.
+ *
+ * @param[out]  db_p    The address of a database handle pointer.
+ * @param[in]   cfg     The configuration (for the database connection).
+ *
+ * @return      zero for success, non-zero otherwise.
+ */
+int
+db_start(db_t **db_p, const config_t *cfg)
+{
+    MYSQL       *inst;
+    MYSQL_STMT  *stmt;
+    MYSQL_STMT  *quarantine_stmt;
+    MYSQL_STMT  *diag_stmt;
+    db_t        *db;
+
+    if ((inst = mysql_init(NULL)) == NULL)
+        return 1;
+
+    if (mysql_real_connect(inst, cfg->db_host, cfg->db_user, NULL, cfg->db_name, 0, NULL, 0) == NULL)
+    {
+        mysql_close(inst);
+        return 2;
+    }
+
+    if ((stmt = mysql_stmt_init(inst)) == NULL)
+    {
+        mysql_close(inst);
+        return 3;
+    }
+    
+    if (mysql_stmt_prepare(stmt, SQL_TEXT, strlen(SQL_TEXT)) != 0)
+    {
+        mysql_stmt_close(stmt);
+        mysql_close(inst);
+        return 4;
+    }
+
+    if ((quarantine_stmt = mysql_stmt_init(inst)) == NULL)
+    {
+        mysql_stmt_close(stmt);
+        mysql_close(inst);
+        return 3;
+    }
+
+    if (mysql_stmt_prepare(quarantine_stmt, SQL_QUARANTINE_TEXT, strlen(SQL_QUARANTINE_TEXT)) != 0)
+    {
+        mysql_stmt_close(quarantine_stmt);
+        mysql_stmt_close(stmt);
+        mysql_close(inst);
+        return 4;
+    }
+
+    if ((diag_stmt = mysql_stmt_init(inst)) == NULL)
+    {
+        mysql_stmt_close(quarantine_stmt);
+        mysql_stmt_close(stmt);
+        mysql_close(inst);
+        return 3;
+    }
+
+    if (mysql_stmt_prepare(diag_stmt, SQL_DIAG_TEXT, strlen(SQL_DIAG_TEXT)) != 0)
+    {
+        mysql_stmt_close(diag_stmt);
+        mysql_stmt_close(quarantine_stmt);
+        mysql_stmt_close(stmt);
+        mysql_close(inst);
+        return 4;
+    }
+
+    if ((db = malloc(sizeof(db_t))) == NULL)
+    {
+        mysql_stmt_close(diag_stmt);
+        mysql_stmt_close(quarantine_stmt);
+        mysql_stmt_close(stmt);
+        mysql_close(inst);
+        return 5;
+    }
+
+    db->inst = inst;
+    db->stmt = stmt;
+    db->quarantine_stmt = quarantine_stmt;
+    db->diag_stmt = diag_stmt;
+    *db_p = db;
+
+    return 0;
+}
+
+/**
+ * Insert a new row into the database.
+ *
+ * @param[in]   db              The database handle.
+ * @param[in]   station_id      The station ID.
+ * @param[in]   sensor_type     The sensor type.
+ * @param[in]   sensor_value    The sensor value.
+ * @param[in]   timestamp       The time of the sensor reading, in milliseconds
+ *                              since the epoch.
+ */
+bool
+db_insert
+(
+    db_t        *db,
+    uint8_t     station_id,
+    uint8_t     sensor_type,
+    int32_t     sensor_value,
+    int64_t     timestamp
+)
+{
+    MYSQL_BIND  params[SQL_NBIND];
+
+    memset(params, 0, sizeof(params));
+
+    /* timestamp */
+    params[0].buffer_type = MYSQL_TYPE_LONGLONG;
+    params[0].buffer = &timestamp;
+    params[0].buffer_length = sizeof(timestamp);
+    params[0].is_null = (my_bool *)0;
+    params[0].is_unsigned = 0;
+
+    /* station */
+    params[1].buffer_type = MYSQL_TYPE_TINY;
+    params[1].buffer = &station_id;
+    params[1].buffer_length = sizeof(station_id);
+    params[1].is_null = (my_bool *)0;
+    params[1].is_unsigned = 1;
+
+    /* sensor */
+    params[2].buffer_type = MYSQL_TYPE_TINY;
+    params[2].buffer = &sensor_type;
+    params[2].buffer_length = sizeof(sensor_type);
+    params[2].is_null = (my_bool *)0;
+    params[2].is_unsigned = 1;
+
+    /* value */
+    params[3].buffer_type = MYSQL_TYPE_LONG;
+    params[3].buffer = &sensor_value;
+    params[3].buffer_length = sizeof(sensor_value);
+    params[3].is_null = (my_bool *)0;
+    params[3].is_unsigned = 0;
+
+    if (mysql_stmt_bind_param(db->stmt, params))
+        return false;
+
+    if (mysql_stmt_execute(db->stmt))
+        return false;
+
+    return true;
+}
+
+/**
+ * Bind an unsigned integer parameter.
+ */
+static void
+bind_unsigned(MYSQL_BIND *param, enum enum_field_types type, void *value, unsigned long length)
+{
+    param->buffer_type = type;
+    param->buffer = value;
+    param->buffer_length = length;
+    param->is_null = (my_bool *)0;
+    param->is_unsigned = 1;
+}
+
+/**
+ * Insert a suspect reading into the quarantine table, rather than the
+ * sensor table.
+ *
+ * @param[in]   db              The database handle.
+ * @param[in]   station_id      The station ID.
+ * @param[in]   sensor_type     The sensor type.
+ * @param[in]   sensor_value    The sensor value.
+ * @param[in]   median          The median of the sensor's recent readings.
+ * @param[in]   timestamp       The time of the sensor reading, in milliseconds
+ *                              since the epoch.
+ */
+bool
+db_quarantine
+(
+    db_t        *db,
+    uint8_t     station_id,
+    uint8_t     sensor_type,
+    int32_t     sensor_value,
+    int32_t     median,
+    int64_t     timestamp
+)
+{
+    MYSQL_BIND  params[SQL_QUARANTINE_NBIND];
+
+    memset(params, 0, sizeof(params));
+
+    /* timestamp */
+    params[0].buffer_type = MYSQL_TYPE_LONGLONG;
+    params[0].buffer = &timestamp;
+    params[0].buffer_length = sizeof(timestamp);
+    params[0].is_null = (my_bool *)0;
+    params[0].is_unsigned = 0;
+
+    /* station */
+    bind_unsigned(&params[1], MYSQL_TYPE_TINY, &station_id, sizeof(station_id));
+
+    /* sensor */
+    bind_unsigned(&params[2], MYSQL_TYPE_TINY, &sensor_type, sizeof(sensor_type));
+
+    /* value */
+    params[3].buffer_type = MYSQL_TYPE_LONG;
+    params[3].buffer = &sensor_value;
+    params[3].buffer_length = sizeof(sensor_value);
+    params[3].is_null = (my_bool *)0;
+    params[3].is_unsigned = 0;
+
+    /* median */
+    params[4].buffer_type = MYSQL_TYPE_LONG;
+    params[4].buffer = &median;
+    params[4].buffer_length = sizeof(median);
+    params[4].is_null = (my_bool *)0;
+    params[4].is_unsigned = 0;
+
+    if (mysql_stmt_bind_param(db->quarantine_stmt, params))
+        return false;
+
+    if (mysql_stmt_execute(db->quarantine_stmt))
+        return false;
+
+    return true;
+}
+
+/**
+ * Insert a row of the receiver's diagnostics into the database.
+ *
+ * @param[in]   db          The database handle.
+ * @param[in]   diag        The diagnostics.
+ * @param[in]   timestamp   When they were read, in milliseconds since the
+ *                          epoch.
+ */
+bool
+db_insert_diagnostics(db_t *db, const receiver_diag_t *diag, int64_t timestamp)
+{
+    MYSQL_BIND      params[SQL_DIAG_NBIND];
+    receiver_diag_t d   = *diag;
+
+    memset(params, 0, sizeof(params));
+
+    /* timestamp */
+    params[0].buffer_type = MYSQL_TYPE_LONGLONG;
+    params[0].buffer = &timestamp;
+    params[0].buffer_length = sizeof(timestamp);
+    params[0].is_null = (my_bool *)0;
+    params[0].is_unsigned = 0;
+
+    bind_unsigned(&params[1], MYSQL_TYPE_TINY, &d.reset_cause, sizeof(d.reset_cause));
+    bind_unsigned(&params[2], MYSQL_TYPE_SHORT, &d.watchdog_timeouts, sizeof(d.watchdog_timeouts));
+    bind_unsigned(&params[3], MYSQL_TYPE_LONG, &d.uptime, sizeof(d.uptime));
+    bind_unsigned(&params[4], MYSQL_TYPE_SHORT, &d.overruns, sizeof(d.overruns));
+    bind_unsigned(&params[5], MYSQL_TYPE_SHORT, &d.errors, sizeof(d.errors));
+    bind_unsigned(&params[6], MYSQL_TYPE_SHORT, &d.dropped, sizeof(d.dropped));
+    bind_unsigned(&params[7], MYSQL_TYPE_SHORT, &d.sram_free, sizeof(d.sram_free));
+
+    if (mysql_stmt_bind_param(db->diag_stmt, params))
+        return false;
+
+    if (mysql_stmt_execute(db->diag_stmt))
+        return false;
+
+    return true;
+}
+
+/**
+ * Clean up our connection to the MySQL database.
+ *
+ * @param[in]   db      The database handle.
+ */
+void
+db_end(db_t *db)
+{
+    mysql_stmt_close(db->diag_stmt);
+    mysql_stmt_close(db->quarantine_stmt);
+    mysql_stmt_close(db->stmt);
+    mysql_close(db->inst);
+    free(db);
+}
@@ -0,0 +1,43 @@
+#ifndef __DB_H__
+#define __DB_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+#include "receiver.h"
+
+/*
+ * Storage for sensor readings, suspect readings held back from them (see
+ * spike.h), and the receiver's diagnostics. db.c stores them in MySQL;
+ * db_fake.c keeps readings in memory, for benchmarking without a database.
+ */
+typedef struct db_t     db_t;
+
+extern int              db_start(db_t **db_p, const config_t *cfg);
+extern bool             db_insert
+                        (
+                            db_t        *db,
+                            uint8_t     station_id,
+                            uint8_t     sensor_type,
+                            int32_t     sensor_value,
+                            int64_t     timestamp
+                        );
+extern bool             db_quarantine
+                        (
+                            db_t        *db,
+                            uint8_t     station_id,
+                            uint8_t     sensor_type,
+                            int32_t     sensor_value,
+                            int32_t     median,
+                            int64_t     timestamp
+                        );
+extern bool             db_insert_diagnostics
+                        (
+                            db_t                    *db,
+                            const receiver_diag_t   *diag,
+                            int64_t                 timestamp
+                        );
+extern void             db_end(db_t *db);
+
+#endif /* __DB_H__ */
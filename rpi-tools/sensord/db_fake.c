@@ -0,0 +1,136 @@
+/*
+ * An in-memory stand-in for db.c, so that the ingest pipeline can be
+ * benchmarked without a MySQL server. Rows are kept in a fixed ring, so
+ * inserting costs no allocations.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+#include "db.h"
+
+/**
+ * The number of rows kept
+ */
+#define DB_FAKE_ROWS    4096
+
+typedef struct
+{
+    uint8_t             station;
+    uint8_t             sensor;
+    int64_t             timestamp;
+    int32_t             value;
+}
+    db_row_t;
+
+/**
+ * An in-memory "table" of the most recent rows inserted.
+ */
+struct db_t
+{
+    db_row_t            rows[DB_FAKE_ROWS];
+    unsigned long       nrows;
+};
+
+/**
+ * Create an empty in-memory table.
+ *
+ * @param[out]  db_p    The address of a database handle pointer.
+ * @param[in]   cfg     The configuration (unused).
+ *
+ * @return      zero for success, non-zero otherwise.
+ */
+int
+db_start(db_t **db_p, const config_t *cfg)
+{
+    db_t        *db;
+
+    if ((db = calloc(1, sizeof(db_t))) == NULL)
+        return 1;
+
+    *db_p = db;
+
+    return 0;
+}
+
+/**
+ * Insert a new row into the in-memory table.
+ *
+ * @param[in]   db              The database handle.
+ * @param[in]   station_id      The station ID.
+ * @param[in]   sensor_type     The sensor type.
+ * @param[in]   sensor_value    The sensor value.
+ * @param[in]   timestamp       The time of the sensor reading, in milliseconds
+ *                              since the epoch.
+ */
+bool
+db_insert
+(
+    db_t        *db,
+    uint8_t     station_id,
+    uint8_t     sensor_type,
+    int32_t     sensor_value,
+    int64_t     timestamp
+)
+{
+    db_row_t    *row    = &db->rows[db->nrows++ % DB_FAKE_ROWS];
+
+    row->station = station_id;
+    row->sensor = sensor_type;
+    row->value = sensor_value;
+    row->timestamp = timestamp;
+
+    return true;
+}
+
+/**
+ * Discard a suspect reading (the benchmark's readings are all steady).
+ *
+ * @param[in]   db              The database handle.
+ * @param[in]   station_id      The station ID.
+ * @param[in]   sensor_type     The sensor type.
+ * @param[in]   sensor_value    The sensor value.
+ * @param[in]   median          The median of the sensor's recent readings.
+ * @param[in]   timestamp       The time of the sensor reading, in milliseconds
+ *                              since the epoch.
+ */
+bool
+db_quarantine
+(
+    db_t        *db,
+    uint8_t     station_id,
+    uint8_t     sensor_type,
+    int32_t     sensor_value,
+    int32_t     median,
+    int64_t     timestamp
+)
+{
+    return true;
+}
+
+/**
+ * Discard the receiver's diagnostics (the benchmark has no receiver).
+ *
+ * @param[in]   db          The database handle.
+ * @param[in]   diag        The diagnostics.
+ * @param[in]   timestamp   When they were read, in milliseconds since the
+ *                          epoch.
+ */
+bool
+db_insert_diagnostics(db_t *db, const receiver_diag_t *diag, int64_t timestamp)
+{
+    return true;
+}
+
+/**
+ * Free the in-memory table.
+ *
+ * @param[in]   db      The database handle.
+ */
+void
+db_end(db_t *db)
+{
+    free(db);
+}
@@ -0,0 +1,531 @@
+/*
+ * Processing of snapshots from the RPi receiver: work out which readings
+ * are new, hold back any that look like spikes, derive values from the
+ * rest, store them all, and pass them to the alert rules.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "wireless.h"
+#include "snapshot.h"
+#include "derived.h"
+#include "config.h"
+#include "capture.h"
+#include "db.h"
+#include "alert.h"
+#include "rxclock.h"
+#include "livestate.h"
+#include "spike.h"
+#include "trace.h"
+#include "ingest.h"
+
+/**
+ * The seqno of a sensor that hasn't had a reading yet
+ */
+#define SEQNO_NONE          INT32_MIN
+
+/**
+ * A structure to keep track of the most recent sensor readings from
+ * each station.
+ */
+struct reading_t
+{
+    /** station ID */
+    uint8_t             station;
+
+    /** sensor type */
+    uint8_t             sensor;
+
+    /** seqno when we received value */
+    int32_t             seqno;
+
+    /** whether a value has been stored for the sensor */
+    bool                stored;
+
+    /** the last value stored */
+    int32_t             value;
+
+    /** when the last value stored was received (ms since the epoch) */
+    int64_t             stored_at;
+
+    /** next entry in list */
+    reading_t           *next;
+};
+
+/**
+ * Find the state of a station sensor, adding it if it's new.
+ *
+ * @param[in]       station         The station ID.
+ * @param[in]       sensor          The sensor type.
+ * @param[in,out]   sensor_state    List of current sensor states.
+ *
+ * @return the sensor's state, or NULL if there's no memory for it.
+ */
+static reading_t *
+sensor_find
+(
+    uint8_t     station,
+    uint8_t     sensor,
+    reading_t   **sensor_state
+)
+{
+    reading_t   *r;
+
+    for (r = *sensor_state; r != NULL; r = r->next)
+    {
+        if (r->station == station && r->sensor == sensor)
+            return r;
+    }
+
+    if ((r = malloc(sizeof(reading_t))) == NULL)
+        return NULL;
+
+    r->station = station;
+    r->sensor = sensor;
+    r->seqno = SEQNO_NONE;
+    r->stored = false;
+    r->next = *sensor_state;
+    *sensor_state = r;
+
+    return r;
+}
+
+/**
+ * Check to see if this is a new reading from the station sensor.
+ *
+ * @param[in,out]   r               The sensor's state.
+ * @param[in]       seqno           The seqno for the latest sensor value.
+ *
+ * @return true if this is a new sensor value, false otherwise.
+ */
+static bool
+sensor_changed(reading_t *r, int32_t seqno)
+{
+    if (r->seqno == seqno)
+        return false;
+
+    r->seqno = seqno;
+    return true;
+}
+
+/**
+ * Store a sensor value, unless it's the same as the last value stored and
+ * that is less than a heartbeat old. A series stored like this is a run of
+ * unchanged values from each row to the next (see db/sensor-runs.sql).
+ *
+ * @param[in]       db              The database handle.
+ * @param[in]       station         The station ID.
+ * @param[in]       sensor          The sensor type.
+ * @param[in,out]   r               The sensor's state, or NULL to store the
+ *                                  value without keeping track of it.
+ * @param[in]       value           The sensor value.
+ * @param[in]       timestamp       When the value was received (ms since the epoch).
+ * @param[in]       heartbeat       Seconds between rows for an unchanged
+ *                                  value, or 0 to store every value.
+ * @param[in,out]   rows            Count of rows stored.
+ *
+ * @return      true for success (stored or not), false if the insert failed.
+ */
+static bool
+sensor_store
+(
+    db_t        *db,
+    uint8_t     station,
+    uint8_t     sensor,
+    reading_t   *r,
+    int32_t     value,
+    int64_t     timestamp,
+    int         heartbeat,
+    int32_t     *rows
+)
+{
+    if
+    (
+        heartbeat > 0
+        &&
+        r != NULL
+        &&
+        r->stored
+        &&
+        r->value == value
+        &&
+        timestamp - r->stored_at < (int64_t)heartbeat * 1000
+    )
+        return true;
+
+    if (!db_insert(db, station, sensor, value, timestamp))
+    {
+        trace(TRACE_ERROR, TRACE_ERR_DB);
+        return false;
+    }
+
+    if (r != NULL)
+    {
+        r->stored = true;
+        r->value = value;
+        r->stored_at = timestamp;
+    }
+
+    (*rows)++;
+
+    return true;
+}
+
+/**
+ * Update a station's shared state from its latest message.
+ *
+ * @param[in,out]   live            The station's shared state.
+ * @param[in]       st              The station, from the snapshot.
+ * @param[in]       seqno           The message counter, or -1.
+ * @param[in]       timestamp       When the message was received (ms since the epoch).
+ * @param[in]       age             The age of the message, in nanoseconds.
+ * @param[in]       suspect         Bit j set if the station's value j is
+ *                                  suspect (it isn't published).
+ * @param[in]       derived         The values derived from new readings.
+ * @param[in]       n_derived       The number of derived values.
+ * @param[in]       cfg             The configuration (for the thresholds).
+ */
+static void
+live_update
+(
+    livestate_station_t         *live,
+    const snapshot_station_t    *st,
+    int32_t                     seqno,
+    int64_t                     timestamp,
+    uint64_t                    age,
+    uint32_t                    suspect,
+    const snapshot_value_t      *derived,
+    int                         n_derived,
+    const config_t              *cfg
+)
+{
+    int     j;
+
+    /*
+     * The counter advances by one per message, and wraps
+     */
+    if (!live->valid)
+        live->messages = 1;
+    else
+    if (seqno != live->seqno)
+    {
+        live->messages++;
+
+        if (seqno != -1 && live->seqno != -1)
+            live->missed += snapshot_missed(seqno, live->seqno);
+    }
+
+    live->valid = 1;
+    live->seqno = seqno;
+    live->received = timestamp;
+
+    for (j = 0; j < st->nvalues; j++)
+    {
+        if
+        (
+            st->values[j].type == WL_SENSOR_TYPE_COUNTER
+            ||
+            st->values[j].type == WL_SENSOR_TYPE_INVALID
+            ||
+            (suspect & (1u << j)) != 0
+        )
+            continue;
+
+        livestate_set(live, st->values[j].type, st->values[j].value);
+
+        if (st->values[j].type == WL_SENSOR_TYPE_BATTERY)
+        {
+            if (st->values[j].value <= cfg->battery_low_threshold)
+                live->flags |= LIVESTATE_BATTERY_LOW;
+            else
+            if (st->values[j].value >= cfg->battery_ok_threshold)
+                live->flags &= ~LIVESTATE_BATTERY_LOW;
+        }
+    }
+
+    for (j = 0; j < n_derived; j++)
+        livestate_set(live, derived[j].type, derived[j].value);
+
+    if (age / 1000000000 > (uint64_t)cfg->station_dead_threshold)
+        live->flags |= LIVESTATE_STALE;
+    else
+        live->flags &= ~LIVESTATE_STALE;
+}
+
+/**
+ * Process a station from a snapshot.
+ *
+ * @param[in]       st              The station.
+ * @param[in]       read_time       When the snapshot was read.
+ * @param[in]       clock           The receiver clock tracking.
+ * @param[in,out]   alerts          The alert rules engine.
+ * @param[in,out]   sensor_state    List of current sensor states.
+ * @param[in]       db              The database handle.
+ * @param[in,out]   live            The station's shared state, or NULL.
+ * @param[in]       cfg             The configuration.
+ * @param[in,out]   rows            Count of rows stored.
+ *
+ * @return      true for success, false if a database insert failed.
+ */
+static bool
+process_station
+(
+    const snapshot_station_t    *st,
+    const capture_time_t        *read_time,
+    const rxclock_t             *clock,
+    alert_engine_t              *alerts,
+    reading_t                   **sensor_state,
+    db_t                        *db,
+    livestate_station_t         *live,
+    const config_t              *cfg,
+    int32_t                     *rows
+)
+{
+    reading_t                   *r;
+    uint8_t                     station_id  = st->id;
+    uint8_t                     sensor_type;
+    int32_t                     sensor_value;
+    uint64_t                    age;
+    int64_t                     timestamp;
+    time_t                      when;
+    int32_t                     seqno;
+    int32_t                     median;
+    uint32_t                    suspect     = 0;
+    snapshot_value_t            fresh[SNAPSHOT_MAX_VALUES];
+    snapshot_value_t            derived[DERIVED_MAX_VALUES];
+    int                         n_fresh;
+    int                         n_derived;
+    time_t                      now         = read_time->realtime / 1000000000;
+    uint8_t                     j;
+
+    /*
+     * The time the message was received, from the time we read the
+     * snapshot and its age (corrected for the receiver's clock)
+     */
+    age = rxclock_age(clock, st->age_ticks);
+    timestamp = (int64_t)((read_time->realtime - age + 500000) / 1000000);
+    when = (time_t)((timestamp + 500) / 1000);
+
+    alert_age(alerts, station_id, (int32_t)(age / 1000000000), now);
+
+    /*
+     * Extract the message counter.
+     */
+    seqno = -1;
+    for (j = 0; j < st->nvalues; j++)
+    {
+        if (st->values[j].type == WL_SENSOR_TYPE_COUNTER)
+            seqno = st->values[j].value;
+    }
+
+    if (seqno != -1)
+        alert_reading(alerts, station_id, WL_SENSOR_TYPE_COUNTER, seqno, when);
+
+    /*
+     * Process the various sensor values
+     */
+    n_fresh = 0;
+    for (j = 0; j < st->nvalues; j++)
+    {
+        sensor_type     = st->values[j].type;
+        sensor_value    = st->values[j].value;
+
+        if (sensor_type == WL_SENSOR_TYPE_COUNTER || sensor_type == WL_SENSOR_TYPE_INVALID)
+            continue;
+
+        /*
+         * If this sensor is a newer reading from the last time we
+         * checked, then update the database with the new value.
+         */
+        r = sensor_find(station_id, sensor_type, sensor_state);
+
+        if (r != NULL && sensor_changed(r, seqno))
+        {
+            /*
+             * A suspect reading goes to the quarantine table instead, and
+             * nothing is derived from it or alerted on it
+             */
+            if
+            (
+                cfg->spike_threshold > 0
+                &&
+                spike_check(station_id, sensor_type, sensor_value, timestamp,
+                    cfg->spike_threshold, &median)
+            )
+            {
+                if (!db_quarantine(db, station_id, sensor_type, sensor_value, median, timestamp))
+                {
+                    trace(TRACE_ERROR, TRACE_ERR_DB);
+                    return false;
+                }
+
+                trace(TRACE_QUARANTINE, station_id * 256 + sensor_type);
+                syslog(LOG_INFO, "quarantined station %d %s reading %ld (median %ld)",
+                    station_id, config_sensor_name(sensor_type), (long)sensor_value, (long)median);
+
+                suspect |= 1u << j;
+                continue;
+            }
+
+            if (!sensor_store(db, station_id, sensor_type, r, sensor_value,
+                    timestamp, cfg->heartbeat, rows))
+                return false;
+
+            alert_reading(alerts, station_id, sensor_type, sensor_value, when);
+
+            fresh[n_fresh++] = st->values[j];
+        }
+        else
+        if (cfg->spike_threshold > 0 && spike_suspect(station_id, sensor_type))
+        {
+            /*
+             * The receiver still holds the suspect reading
+             */
+            suspect |= 1u << j;
+        }
+    }
+
+    /*
+     * Derive values from the new readings, so that this is done once
+     * per reading.
+     */
+    n_derived = derived_values(fresh, n_fresh,
+                    config_altitude(cfg, station_id), derived);
+
+    for (j = 0; j < n_derived; j++)
+    {
+        /*
+         * Derived values only need tracking to leave out repeats
+         */
+        r = NULL;
+        if (cfg->heartbeat > 0)
+            r = sensor_find(station_id, derived[j].type, sensor_state);
+
+        if
+        (
+            !sensor_store(db, station_id, derived[j].type, r, derived[j].value,
+                timestamp, cfg->heartbeat, rows)
+        )
+            return false;
+
+        alert_reading(alerts, station_id, derived[j].type, derived[j].value, when);
+    }
+
+    if (live != NULL)
+        live_update(live, st, seqno, timestamp, age, suspect, derived, n_derived, cfg);
+
+    return true;
+}
+
+/**
+ * Process a message from the RPi receiver
+ *
+ * @param[in]       message         The message data.
+ * @param[in]       length          The length of the message data.
+ * @param[in]       read_time       When the message was read.
+ * @param[in,out]   clock           The receiver clock tracking.
+ * @param[in,out]   alerts          The alert rules engine.
+ * @param[in,out]   sensor_state    List of current sensor states.
+ * @param[in]       db              The database handle.
+ * @param[in,out]   live            The shared station states, or NULL.
+ * @param[in]       cfg             The configuration (for station altitudes,
+ *                                  the heartbeat and thresholds).
+ *
+ * @return      true for success, false if a database insert failed.
+ */
+bool
+process_message
+(
+    const char      *message,
+    int             length,
+    const capture_time_t *read_time,
+    rxclock_t       *clock,
+    alert_engine_t  *alerts,
+    reading_t       **sensor_state,
+    db_t            *db,
+    livestate_t     *live,
+    const config_t  *cfg
+)
+{
+    static snapshot_station_t   stations[SNAPSHOT_MAX_STATIONS];
+    int                         n_stations;
+    uint8_t                     station_id;
+    uint32_t                    rx_clock;
+    int32_t                     rows        = 0;
+    bool                        status      = true;
+    int                         i;
+
+    /*
+     * See snapshot.h for the message format.
+     */
+    n_stations = snapshot_parse((const uint8_t *)message, length,
+                    stations, SNAPSHOT_MAX_STATIONS);
+
+    trace(TRACE_PARSE, n_stations);
+
+    if (n_stations < 0)
+    {
+        syslog(LOG_WARNING, "warning: ignoring malformed message from receiver");
+        return true;
+    }
+
+    if (snapshot_clock((const uint8_t *)message, length, &rx_clock))
+        rxclock_update(clock, rx_clock, read_time->monotonic);
+    else
+        rx_clock = 0;
+
+    /*
+     * Readers of the shared state see all of this snapshot or none of it
+     */
+    if (live != NULL)
+    {
+        livestate_begin(live);
+
+        live->updated = (int64_t)(read_time->realtime / 1000000);
+        live->polls++;
+        live->rx_clock = rx_clock;
+        live->tick_ns = clock->valid ? clock->tick_ns : SNAPSHOT_TICK_NS;
+    }
+
+    for (i = 0; i < n_stations && status; ++i)
+    {
+        station_id = stations[i].id;
+
+        /*
+         * Only consider valid station IDs
+         */
+        if (station_id != 0 && station_id != 255)
+            status = process_station(&stations[i], read_time, clock, alerts, sensor_state,
+                        db, live != NULL ? &live->stations[station_id] : NULL, cfg, &rows);
+    }
+
+    if (live != NULL)
+        livestate_end(live);
+
+    trace(TRACE_ROWS, rows);
+
+    return status;
+}
+
+/**
+ * Free the list of sensor states.
+ *
+ * @param[in,out]   sensor_state    List of current sensor states.
+ */
+void
+sensor_state_free(reading_t **sensor_state)
+{
+    reading_t   *r;
+
+    while ((r = *sensor_state) != NULL)
+    {
+        *sensor_state = r->next;
+        free(r);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef __INGEST_H__
+#define __INGEST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "config.h"
+#include "capture.h"
+#include "db.h"
+#include "alert.h"
+#include "rxclock.h"
+#include "livestate.h"
+
+/*
+ * The last reading seen from each station sensor
+ */
+typedef struct reading_t    reading_t;
+
+extern bool                 process_message
+                            (
+                                const char      *message,
+                                int             length,
+                                const capture_time_t *read_time,
+                                rxclock_t       *clock,
+                                alert_engine_t  *alerts,
+                                reading_t       **sensor_state,
+                                db_t            *db,
+                                livestate_t     *live,
+                                const config_t  *cfg
+                            );
+extern void                 sensor_state_free(reading_t **sensor_state);
+
+#endif /* __INGEST_H__ */
@@ -0,0 +1,154 @@
+/*
+ * Tracking of the receiver's clock.
+ *
+ * Each snapshot carries the receiver's clock, and is read at a known time
+ * on our (CLOCK_MONOTONIC) clock. Over a long enough span the delay in
+ * reading a snapshot is small next to the time between them, so the
+ * receiver's ticks over the span against our time over the span gives the
+ * length of a tick. The measurement restarts every RXCLOCK_WINDOW, so it
+ * follows the crystal as it warms and cools.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <syslog.h>
+
+#include "snapshot.h"
+#include "rxclock.h"
+#include "trace.h"
+
+/**
+ * The shortest span a tick length is measured over, in nanoseconds
+ */
+#define RXCLOCK_MIN_SPAN    (10 * 60 * 1000000000ULL)
+
+/**
+ * The span after which the measurement starts again, in nanoseconds
+ */
+#define RXCLOCK_WINDOW      (6 * 60 * 60 * 1000000000ULL)
+
+/**
+ * How far the receiver's clock can disagree with ours between snapshots
+ * before we take it that the receiver has reset, in nanoseconds (plus 1%
+ * of the time between snapshots)
+ */
+#define RXCLOCK_TOLERANCE   1000000000LL
+
+/**
+ * How far a measured tick length can be from SNAPSHOT_TICK_NS before it's
+ * treated as bogus, in parts per million. A crystal is good to within a
+ * hundred or so.
+ */
+#define RXCLOCK_MAX_PPM     2000
+
+/**
+ * Start tracking with the nominal tick length.
+ *
+ * @param[out]  clock       The clock state.
+ */
+void
+rxclock_init(rxclock_t *clock)
+{
+    clock->valid = false;
+    clock->tick_ns = SNAPSHOT_TICK_NS;
+}
+
+/**
+ * Start a new measurement from a snapshot. The tick length measured so far
+ * is kept.
+ *
+ * @param[in,out]   clock       The clock state.
+ * @param[in]       rx_clock    The receiver's clock in the snapshot.
+ * @param[in]       now         When the snapshot was read, in nanoseconds.
+ */
+static void
+rxclock_restart(rxclock_t *clock, uint32_t rx_clock, uint64_t now)
+{
+    clock->valid = true;
+    clock->last_clock = rx_clock;
+    clock->last_time = now;
+    clock->ref_time = now;
+    clock->ref_ticks = 0;
+}
+
+/**
+ * Update the clock tracking from a snapshot.
+ *
+ * @param[in,out]   clock       The clock state.
+ * @param[in]       rx_clock    The receiver's clock in the snapshot.
+ * @param[in]       now         When the snapshot was read (CLOCK_MONOTONIC,
+ *                              in nanoseconds).
+ */
+void
+rxclock_update(rxclock_t *clock, uint32_t rx_clock, uint64_t now)
+{
+    uint32_t    ticks;
+    int64_t     elapsed;
+    int64_t     error;
+    uint64_t    span;
+    double      tick_ns;
+
+    if (!clock->valid || now < clock->last_time)
+    {
+        rxclock_restart(clock, rx_clock, now);
+        return;
+    }
+
+    /*
+     * The clock wraps, so the difference is taken modulo 2^32. If it
+     * doesn't match the time between snapshots, the receiver has reset (or
+     * we haven't looked at it for long enough for it to wrap).
+     */
+    ticks = rx_clock - clock->last_clock;
+    elapsed = (int64_t)(now - clock->last_time);
+    error = (int64_t)(ticks * clock->tick_ns) - elapsed;
+
+    if (error < 0)
+        error = -error;
+
+    if (error > RXCLOCK_TOLERANCE + elapsed / 100)
+    {
+        syslog(LOG_NOTICE, "receiver clock is off by %lld ms, resynchronising",
+            (long long)(error / 1000000));
+        trace(TRACE_RESYNC, (int32_t)(error / 1000000));
+        rxclock_restart(clock, rx_clock, now);
+        return;
+    }
+
+    clock->ref_ticks += ticks;
+    clock->last_clock = rx_clock;
+    clock->last_time = now;
+
+    span = now - clock->ref_time;
+
+    if (span >= RXCLOCK_MIN_SPAN && clock->ref_ticks > 0)
+    {
+        tick_ns = (double)span / clock->ref_ticks;
+
+        if
+        (
+            tick_ns > SNAPSHOT_TICK_NS * (1.0 - RXCLOCK_MAX_PPM / 1e6)
+            &&
+            tick_ns < SNAPSHOT_TICK_NS * (1.0 + RXCLOCK_MAX_PPM / 1e6)
+        )
+            clock->tick_ns = tick_ns;
+    }
+
+    if (span >= RXCLOCK_WINDOW)
+        rxclock_restart(clock, rx_clock, now);
+}
+
+/**
+ * Convert an age from a snapshot into nanoseconds, using the measured tick
+ * length.
+ *
+ * @param[in]   clock       The clock state.
+ * @param[in]   age_ticks   The age, in receiver clock ticks.
+ *
+ * @return      the age, in nanoseconds.
+ */
+uint64_t
+rxclock_age(const rxclock_t *clock, uint32_t age_ticks)
+{
+    return (uint64_t)(age_ticks * clock->tick_ns);
+}
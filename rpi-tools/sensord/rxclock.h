@@ -0,0 +1,40 @@
+#ifndef __RXCLOCK_H__
+#define __RXCLOCK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Tracking of the receiver's clock against ours, so that the ages in
+ * snapshots (in receiver clock ticks) can be turned into accurate times.
+ * The receiver's clock wraps and restarts when the receiver resets, and
+ * its crystal runs a little fast or slow, so the length of a tick is
+ * measured rather than assumed.
+ */
+typedef struct
+{
+    /** set once a snapshot with the receiver's clock has been seen */
+    bool                valid;
+
+    /** the receiver's clock at the last snapshot */
+    uint32_t            last_clock;
+
+    /** our time at the last snapshot, in nanoseconds */
+    uint64_t            last_time;
+
+    /** our time at the start of the measurement, in nanoseconds */
+    uint64_t            ref_time;
+
+    /** receiver clock ticks since the start of the measurement */
+    uint64_t            ref_ticks;
+
+    /** the measured length of a receiver clock tick, in nanoseconds */
+    double              tick_ns;
+}
+    rxclock_t;
+
+extern void             rxclock_init(rxclock_t *clock);
+extern void             rxclock_update(rxclock_t *clock, uint32_t rx_clock, uint64_t now);
+extern uint64_t         rxclock_age(const rxclock_t *clock, uint32_t age_ticks);
+
+#endif /* __RXCLOCK_H__ */
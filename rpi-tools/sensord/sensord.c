@@ -3,15 +3,41 @@
  *
  * Sensord periodically polls the status of the sensor receiver via an I2C interface.
  * Any changes to sensor status result in updates to a remote MySQL database. Sensord
- * can be halted by sending it a TERM signal.
+ * can be halted by sending it a TERM signal, and told to poll straight away through
+ * its control socket (see control.h). It sleeps in epoll between events.
  *
- * gcc -Wall -I../../include -o sensord sensord.c -lmysqlclient
+ * Station events (loss of reception, low battery and so on) are raised by alert rules
+ * (see alert.c), which report to syslog, a local socket or a webhook spool file.
+ *
+ * Settings are read from /etc/sensors.conf (or the file given with -c; see
+ * ../sensors.conf), and reread on a HUP signal. Built-in defaults are used if the
+ * default file doesn't exist.
+ *
+ * The raw snapshots read from the receiver can be recorded to a capture file (-w),
+ * and a capture file can be replayed in place of the receiver (-r), at the speed it
+ * was recorded or as fast as possible (-f).
+ *
+ * The current state of each station is published in a shared memory segment
+ * (see livestate.h), for local readers such as "query -m".
+ *
+ * Every so often the receiver's diagnostics (reset cause, watchdog timeouts, uptime,
+ * lost frames and free memory) are read too, and stored in the receiver_diagnostics
+ * table, so that gaps in the readings can be matched with what the receiver was doing.
+ *
+ * A trace of recent events (polls, reads, rows written, errors) is kept in memory,
+ * and written to the trace file on a USR1 signal or a fatal error; tracedump decodes it.
+ *
+ * Readings far from the median of their sensor's recent values are held back in
+ * the quarantine table (see spike.c).
+ *
+ * gcc -Wall -I../../include -I../common -o sensord sensord.c ingest.c alert.c rxclock.c spike.c trace.c control.c db.c capture.c ../common/receiver.c ../common/livestate.c ../common/snapshot.c ../common/config.c ../common/derived.c -lmysqlclient -lrt -lm
  */
 
-#define _XOPEN_SOURCE   /* for sigaction, daemon */
+#define _DEFAULT_SOURCE /* for sigaction, daemon */
 
-#include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -22,492 +48,636 @@
 #include <unistd.h>
 #include <syslog.h>
 #include <signal.h>
-#include <mysql/mysql.h>
 
 #include "wireless.h"
+#include "snapshot.h"
+#include "config.h"
+#include "receiver.h"
+#include "capture.h"
+#include "db.h"
+#include "alert.h"
+#include "rxclock.h"
+#include "livestate.h"
+#include "trace.h"
+#include "control.h"
+#include "ingest.h"
 
 /**
- * I2C device name
- */
-static const char       *I2C_DEVICE         = "/dev/i2c-0";
-
-/**
- * RPi receiver slave address
- */
-static const int        I2C_SLAVE_ADDRESS   = 0x41;
-
-/**
- * The host where the MySQL database resides.
- */
-static const char       *DB_HOST            = "moonbase";
-
-/**
- * The name of the database
- */
-static const char       *DB_NAME            = "sensors";
-
-/**
- * The username to connect to the database.  No password should be required
- * to connect and insert rows.
+ * A flag set by signal handlers to indicate that we should terminate (when
+ * replaying; the daemon takes its signals through a signalfd).
  */
-static const char       *DB_USER            = "sensord";
-
-/**
- * The text of the SQL insert statement
- */
-static const char       *SQL_TEXT           = "insert into sensor (timestamp, station, sensor, value)"
-                                                "values(date_sub(now(), interval ? second), ?, ?, ?)";
+static volatile int Shutdown            = 0;
 
 /**
- * The number of bind parameters in the above statement.
+ * What sensord knows of the receiver's diagnostics.
  */
-static const int        SQL_NBIND           = 4;    /* must match the statement above */
+typedef struct
+{
+    uint64_t            last_read;      /* CLOCK_MONOTONIC ns, or 0 if never */
+    bool                unsupported;    /* the receiver doesn't send them */
+    bool                valid;          /* last is set */
+    receiver_diag_t     last;
+}
+    diag_state_t;
 
 /**
- * The time in seconds after which we regard a station as dead if we haven't
- * received a message from it.
+ * Signal handler for shutting down the daemon.
+ *
+ * @param[in]   signum  The signal that we are handling.
  */
-static const int16_t    STATION_DEAD_THRESHOLD  = 600;
+static void
+set_shutdown_flag(int signum)
+{
+    Shutdown = 1;
+}
 
 /**
- * If the station battery drops to this level, log a warning
+ * Read the configuration file. A missing file is only an error if it was
+ * named on the command line.
+ *
+ * @param[in]       path        The configuration file.
+ * @param[in]       required    The file must exist.
+ * @param[in,out]   cfg         The configuration.
+ *
+ * @return      true for success, false otherwise.
  */
-static const int16_t    STATION_LOWBATT_THRESHOLD   = 26;
+static bool
+load_config(const char *path, bool required, config_t *cfg)
+{
+    int     status;
 
-/**
- * If the station battery rises to this level, log a notice
- */
-static const int16_t    STATION_OKBATT_THRESHOLD    = 28;
+    if ((status = config_load(path, cfg)) == 0)
+        return true;
 
-/**
- * Station state flag - station is off the air
- */
-static const uint8_t    STATION_FLAG_DEAD       = 0x1;
+    if (status < 0)
+    {
+        if (errno == ENOENT && !required)
+            return true;
 
-/**
- * Station state flag - station has a low battery
- */
-static const uint8_t    STATION_FLAG_LOWBATT    = 0x2;
+        fprintf(stderr, "Failed to read %s: %s\n", path, strerror(errno));
+    }
+    else
+        fprintf(stderr, "%s: error at line %d\n", path, status);
 
-typedef uint8_t             station_state_t;
-typedef struct reading_t    reading_t;
+    return false;
+}
 
 /**
- * A structure to keep track of the most recent sensor readings from
- * each station.
+ * Reread the configuration file, reconnecting to the receiver and the
+ * database if their settings have changed, and rebuilding the alert rules.
+ * If the file has an error, or a reconnect fails, the old settings are kept.
+ *
+ * @param[in]       path        The configuration file.
+ * @param[in,out]   cfg         The configuration.
+ * @param[in,out]   db          The database handle.
+ * @param[in,out]   i2c_device  The I2C file descriptor.
+ * @param[in,out]   alerts      The alert rules engine.
  */
-struct reading_t
+static void
+reload_config
+(
+    const char      *path,
+    config_t        *cfg,
+    db_t            **db,
+    int             *i2c_device,
+    alert_engine_t  **alerts
+)
 {
-    /** station ID */
-    uint8_t             station;
+    config_t        new_cfg     = *cfg;
+    db_t            *new_db;
+    int             new_device;
+    alert_engine_t  *new_alerts;
+    int             status;
 
-    /** sensor type */
-    uint8_t             sensor;
+    if ((status = config_load(path, &new_cfg)) != 0)
+    {
+        if (status < 0)
+            syslog(LOG_ERR, "error: failed to read %s: %s; configuration unchanged", path, strerror(errno));
+        else
+            syslog(LOG_ERR, "error: %s: error at line %d; configuration unchanged", path, status);
+        trace(TRACE_RELOAD, 1);
+        return;
+    }
 
-    /** seqno when we received value */
-    int16_t             seqno;
+    if
+    (
+        strcmp(new_cfg.db_host, cfg->db_host) != 0
+        ||
+        strcmp(new_cfg.db_name, cfg->db_name) != 0
+        ||
+        strcmp(new_cfg.db_user, cfg->db_user) != 0
+    )
+    {
+        if (db_start(&new_db, &new_cfg) != 0)
+        {
+            syslog(LOG_ERR, "error: failed to connect to database %s on %s; keeping the old connection",
+                new_cfg.db_name, new_cfg.db_host);
+            strcpy(new_cfg.db_host, cfg->db_host);
+            strcpy(new_cfg.db_name, cfg->db_name);
+            strcpy(new_cfg.db_user, cfg->db_user);
+        }
+        else
+        {
+            db_end(*db);
+            *db = new_db;
+        }
+    }
 
-    /** next entry in list */
-    reading_t           *next;
-};
+    if
+    (
+        strcmp(new_cfg.i2c_device, cfg->i2c_device) != 0
+        ||
+        new_cfg.i2c_address != cfg->i2c_address
+    )
+    {
+        if ((new_device = receiver_open(&new_cfg)) < 0)
+        {
+            syslog(LOG_ERR, "error: failed to open receiver at %s address 0x%02x: %s; keeping the old one",
+                new_cfg.i2c_device, new_cfg.i2c_address, strerror(errno));
+            strcpy(new_cfg.i2c_device, cfg->i2c_device);
+            new_cfg.i2c_address = cfg->i2c_address;
+        }
+        else
+        {
+            close(*i2c_device);
+            *i2c_device = new_device;
+        }
+    }
 
-/**
- * A flag set by signal handlers to indicate that we should terminate.
- */
-static volatile int Shutdown            = 0;
+    if ((new_alerts = alert_start(&new_cfg, *alerts)) == NULL)
+        syslog(LOG_ERR, "error: failed to set up alert rules; keeping the old ones");
+    else
+    {
+        alert_end(*alerts);
+        *alerts = new_alerts;
+    }
 
-/**
- * Signal handler for shutting down the daemon.
- *
- * @param[in]   signum  The signal that we are handling.
- */
-static void
-set_shutdown_flag(int signum)
-{
-    Shutdown = 1;
+    *cfg = new_cfg;
+
+    trace(TRACE_RELOAD, 0);
+    syslog(LOG_INFO, "configuration reloaded from %s", path);
 }
 
 /**
- * Connect to the database and create a prepared insert statement.
+ * Poll the receiver, and process the snapshot read.
  *
- * @param[out]  inst_p  The address of a MySQL database instance pointer.
- * @param[out]  stmt_p  The address of a MySQL statement handle pointer.
+ * @param[in]       i2c_device      The receiver.
+ * @param[in,out]   capture         The capture file, or NULL. It's closed
+ *                                  and set to NULL if writing fails.
+ * @param[in,out]   clock           The receiver clock tracking.
+ * @param[in,out]   alerts          The alert rules engine.
+ * @param[in,out]   sensor_state    List of current sensor states.
+ * @param[in]       db              The database handle.
+ * @param[in,out]   live            The shared station states, or NULL.
+ * @param[in]       cfg             The configuration.
  *
- * @return      zero for success, non-zero otherwise.
+ * @return      true for success, false on a fatal error.
  */
-static int
-db_start(MYSQL **inst_p, MYSQL_STMT **stmt_p)
+static bool
+poll_receiver
+(
+    int             i2c_device,
+    FILE            **capture,
+    rxclock_t       *clock,
+    alert_engine_t  *alerts,
+    reading_t       **sensor_state,
+    db_t            *db,
+    livestate_t     *live,
+    const config_t  *cfg
+)
 {
-    MYSQL       *inst;
-    MYSQL_STMT  *stmt;
+    char            i2c_message[CAPTURE_MAX_LENGTH];
+    capture_time_t  read_time;
+    uint64_t        start;
+    int             n;
 
-    if ((inst = mysql_init(NULL)) == NULL)
-        return 1;
+    /*
+     * Read current state from the sensor receiver
+     */
+    start = capture_now();
+    trace(TRACE_POLL_START, 0);
 
-    if (mysql_real_connect(inst, DB_HOST, DB_USER, NULL, DB_NAME, 0, NULL, 0) == NULL)
+    if ((n = receiver_read(i2c_device, cfg->i2c_address, i2c_message, sizeof(i2c_message))) < 0)
     {
-        mysql_close(inst);
-        return 2;
+        syslog(LOG_ERR, "error: message read failed: %s", strerror(errno));
+        trace(TRACE_ERROR, TRACE_ERR_READ);
+        return false;
     }
 
-    if ((stmt = mysql_stmt_init(inst)) == NULL)
+    capture_time(&read_time);
+    trace(TRACE_READ, n);
+
+    /*
+     * Record the snapshot
+     */
+    if
+    (
+        *capture != NULL
+        &&
+        n > 0
+        &&
+        !capture_write(*capture, &read_time, i2c_message, n)
+    )
     {
-        mysql_close(inst);
-        return 3;
+        syslog(LOG_ERR, "error: failed to write capture file; capture stopped");
+        trace(TRACE_ERROR, TRACE_ERR_CAPTURE);
+        fclose(*capture);
+        *capture = NULL;
     }
-    
-    if (mysql_stmt_prepare(stmt, SQL_TEXT, strlen(SQL_TEXT)) != 0)
+
+    if (!process_message(i2c_message, n, &read_time, clock, alerts, sensor_state, db, live, cfg))
     {
-        mysql_stmt_close(stmt);
-        mysql_close(inst);
-        return 4;
+        syslog(LOG_ERR, "error: message process failed");
+        return false;
     }
 
-    *inst_p = inst;
-    *stmt_p = stmt;
+    trace(TRACE_POLL_END, (int32_t)((capture_now() - start) / 1000));
 
-    return 0;
+    return true;
 }
 
 /**
- * Insert a new row into the database.
+ * Read and store the receiver's diagnostics, if they are due, and log
+ * resets and watchdog timeouts since the last read.
  *
- * @param[in]   stmt            The prepared database insert statement.
- * @param[in]   station_id      The station ID.
- * @param[in]   sensor_type     The sensor type.
- * @param[in]   sensor_value    The sensor value.
- * @param[in]   age             The age of the sensor reading, in seconds.
+ * @param[in]       i2c_device      The receiver.
+ * @param[in]       db              The database handle.
+ * @param[in,out]   state           The diagnostics read before.
+ * @param[in]       cfg             The configuration.
+ *
+ * @return      true for success, false on a fatal error.
  */
 static bool
-db_insert
-(
-    MYSQL_STMT  *stmt,
-    uint8_t     station_id,
-    uint8_t     sensor_type,
-    int16_t     sensor_value,
-    int16_t     age
-)
+poll_diagnostics(int i2c_device, db_t *db, diag_state_t *state, const config_t *cfg)
 {
-    MYSQL_BIND  params[SQL_NBIND];
-
-    memset(params, 0, sizeof(params));
-
-    /* age */
-    params[0].buffer_type = MYSQL_TYPE_SHORT;
-    params[0].buffer = &age;
-    params[0].buffer_length = sizeof(age);
-    params[0].is_null = (my_bool *)0;
-    params[0].is_unsigned = 0;
-
-    /* station */
-    params[1].buffer_type = MYSQL_TYPE_TINY;
-    params[1].buffer = &station_id;
-    params[1].buffer_length = sizeof(station_id);
-    params[1].is_null = (my_bool *)0;
-    params[1].is_unsigned = 1;
-
-    /* sensor */
-    params[2].buffer_type = MYSQL_TYPE_TINY;
-    params[2].buffer = &sensor_type;
-    params[2].buffer_length = sizeof(sensor_type);
-    params[2].is_null = (my_bool *)0;
-    params[2].is_unsigned = 1;
-
-    /* value */
-    params[3].buffer_type = MYSQL_TYPE_SHORT;
-    params[3].buffer = &sensor_value;
-    params[3].buffer_length = sizeof(sensor_value);
-    params[3].is_null = (my_bool *)0;
-    params[3].is_unsigned = 0;
-
-    if (mysql_stmt_bind_param(stmt, params))
+    receiver_diag_t diag;
+    capture_time_t  read_time;
+
+    if
+    (
+        cfg->diagnostics == 0
+        ||
+        state->unsupported
+        ||
+        (
+            state->last_read != 0
+            &&
+            capture_now() - state->last_read < (uint64_t)cfg->diagnostics * 1000000000
+        )
+    )
+        return true;
+
+    if (receiver_diagnostics(i2c_device, cfg->i2c_address, &diag) < 0)
+    {
+        if (errno == ENOTSUP)
+        {
+            syslog(LOG_INFO, "receiver doesn't send diagnostics");
+            state->unsupported = true;
+            return true;
+        }
+
+        syslog(LOG_ERR, "error: diagnostics read failed: %s", strerror(errno));
+        trace(TRACE_ERROR, TRACE_ERR_DIAGNOSTICS);
         return false;
+    }
+
+    capture_time(&read_time);
+    trace(TRACE_DIAGNOSTICS, diag.uptime > INT32_MAX ? INT32_MAX : (int32_t)diag.uptime);
 
-    if (mysql_stmt_execute(stmt))
+    /*
+     * A reset since the last read, or on the first read, one for any reason
+     * but the power coming on
+     */
+    if
+    (
+        (state->valid && diag.uptime < state->last.uptime)
+        ||
+        (!state->valid && (diag.reset_cause & RECEIVER_RESET_POWER) == 0)
+    )
+    {
+        syslog(LOG_WARNING, "receiver reset %lu s ago (cause 0x%02x)",
+            (unsigned long)diag.uptime, diag.reset_cause);
+    }
+
+    if (state->valid && diag.watchdog_timeouts != state->last.watchdog_timeouts)
+    {
+        syslog(LOG_WARNING, "receiver watchdog timed out (%u times in all)",
+            diag.watchdog_timeouts);
+    }
+
+    if (!db_insert_diagnostics(db, &diag, (int64_t)(read_time.realtime / 1000000)))
+    {
+        syslog(LOG_ERR, "error: diagnostics insert failed");
+        trace(TRACE_ERROR, TRACE_ERR_DB);
         return false;
+    }
+
+    state->last_read = read_time.monotonic;
+    state->last = diag;
+    state->valid = true;
 
     return true;
 }
 
 /**
- * Clean up our connection to the MySQL database.
+ * Set the poll timer to go off once, after the poll interval.
  *
- * @param[in]   inst    A MySQL database instance pointer.
- * @param[in]   stmt    A MySQL statement handle pointer.
+ * @param[in]   timer_fd    The timerfd.
+ * @param[in]   seconds     The poll interval.
  */
 static void
-db_end(MYSQL *inst, MYSQL_STMT *stmt)
+poll_timer_set(int timer_fd, int seconds)
 {
-    mysql_stmt_close(stmt);
-    mysql_close(inst);
+    struct itimerspec   its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = seconds;
+
+    timerfd_settime(timer_fd, 0, &its, NULL);
 }
 
 /**
- * Check to see if this is a new reading from the station sensor.
+ * Add a file descriptor to the epoll set, for reading.
  *
- * @param[in]       station         The station ID.
- * @param[in]       sensor          The sensor type.
- * @param[in]       seqno           The seqno for the latest sensor value.
- * @param[in,out]   sensor_state    List of current sensor states.
+ * @param[in]   epoll_fd    The epoll instance.
+ * @param[in]   fd          The file descriptor.
  *
- * @return true if this is a new sensor value, false otherwise.
+ * @return      true for success, false otherwise (see errno).
  */
 static bool
-sensor_changed
-(
-    uint8_t     station,
-    uint8_t     sensor,
-    int16_t     seqno,
-    reading_t   **sensor_state
-)
+epoll_add(int epoll_fd, int fd)
 {
-    reading_t   *r;
+    struct epoll_event  ev;
 
-    /*
-     * Look for a matching sensor state record. If found, tell the caller
-     * whether the seqno has changed (a new reading was received).
-     */
-    for (r = *sensor_state; r != NULL; r = r->next)
-    {
-        if (r->station == station && r->sensor == sensor)
-        {
-            if (r->seqno != seqno)
-            {
-                r->seqno = seqno;
-                return true;
-            }
-            else
-                return false;
-        }
-    }
-
-    /*
-     * This must be a new station/sensor reading; add it to our state.
-     */
-    if ((r = malloc(sizeof(reading_t))) == NULL)
-        return false;   /* dodgy, I know */
-
-    r->station = station;
-    r->sensor = sensor;
-    r->seqno = seqno;
-    r->next = *sensor_state;
-    *sensor_state = r;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
 
-    return true;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
 }
 
 /**
- * Process a message from the RPi receiver
+ * Replay a capture file through process_message(), in place of reading
+ * the receiver, and report the throughput.
  *
- * @param[in]       message         The message data.
- * @param[in]       length          The length of the message data.
- * @param[in,out]   station_state   List of current station states.
+ * @param[in]       path            The capture file.
+ * @param[in]       fast            Replay as fast as possible, rather than
+ *                                  at the speed it was recorded.
+ * @param[in,out]   clock           The receiver clock tracking.
+ * @param[in,out]   alerts          The alert rules engine.
  * @param[in,out]   sensor_state    List of current sensor states.
- * @param[in]       stmt            The prepared database insert statement.
+ * @param[in]       db              The database handle.
+ * @param[in]       cfg             The configuration.
  *
  * @return      zero for success, non-zero otherwise.
  */
-static bool
-process_message
+static int
+replay
 (
-    const char      *message,
-    int             length,
-    station_state_t *station_state,
+    const char      *path,
+    bool            fast,
+    rxclock_t       *clock,
+    alert_engine_t  *alerts,
     reading_t       **sensor_state,
-    MYSQL_STMT      *stmt
+    db_t            *db,
+    const config_t  *cfg
 )
 {
-    uint8_t     n_stations;
-    uint8_t     station_id;
-    uint8_t     n_sensors;
-    uint8_t     sensor_type;
-    int16_t     sensor_value;
-    int16_t     age;
-    int16_t     seqno;
-    int16_t     battery;
-    uint8_t     i;
-    uint8_t     j;
-    const char  *p;
+    FILE            *f;
+    char            message[CAPTURE_MAX_LENGTH];
+    capture_time_t  timestamp;
+    capture_time_t  start_time;
+    uint64_t        first       = 0;
+    uint64_t        last        = 0;
+    uint64_t        start;
+    uint64_t        elapsed;
+    long            count       = 0;
+    long            bytes       = 0;
+    int             n           = 0;
+
+    if ((f = capture_open_read(path)) == NULL)
+    {
+        fprintf(stderr, "Failed to open capture file %s\n", path);
+        return 1;
+    }
 
-    /*
-     * Message format (shorts are LSB first):
-     *
-     * len
-     *  1   0x01
-     *  1   message length
-     *  1   number of stations
-     *
-     *  1   station 1 id
-     *  1   number of sensors (n)
-     *  1   sensor type 1
-     *  2   sensor value 1
-     *          [...]
-     *  1   sensor type n
-     *  2   sensor value n
-     *  2   age
-     *
-     *  2   station 2 id
-     *          [... etc]
-     */
-    n_stations = *(uint8_t *)&message[2];
+    capture_time(&start_time);
+    start = start_time.monotonic;
 
-    p = message + 3;
-    for (i = 0; i < n_stations; ++i)
+    while (!Shutdown && (n = capture_read(f, &timestamp, message, sizeof(message))) > 0)
     {
-        station_id  = *(uint8_t *)&p[0];
-        n_sensors   = *(uint8_t *)&p[1];
-        p += 2;
-
         /*
-         * Only consider valid station IDs
+         * Keep to the recorded timing
          */
-        if (station_id != 0 && station_id != 255)
+        if (count == 0)
+            first = timestamp.monotonic;
+        else
+        if (timestamp.monotonic < last)
         {
             /*
-             * The age of the datagram from the sender is after all the
-             * sensor readings.
+             * sensord was restarted (the monotonic clock starts again at
+             * boot), so carry on from here without waiting
              */
-            age = *(uint16_t *)(p + n_sensors * 3);
+            first = timestamp.monotonic - (capture_now() - start);
+        }
+        else
+        if (!fast && timestamp.monotonic - first > capture_now() - start)
+            capture_sleep((timestamp.monotonic - first) - (capture_now() - start));
 
-            /*
-             * Log messages if a station dies or revives.
-             */
-            if (age > STATION_DEAD_THRESHOLD)
-            {
-                if ((station_state[station_id] & STATION_FLAG_DEAD) == 0)
-                {
-                    syslog(LOG_ERR, "error: no message from station %d for %d seconds", station_id, age);
-                    station_state[station_id] |= STATION_FLAG_DEAD;
-                }
-            }
-            else
-            {
-                if ((station_state[station_id] & STATION_FLAG_DEAD) != 0)
-                {
-                    syslog(LOG_NOTICE, "message received from previously dead station %d", station_id);
-                    station_state[station_id] &= ~STATION_FLAG_DEAD;
-                }
-            }
+        last = timestamp.monotonic;
 
-            /*
-             * Extract some standard sensor information.
-             */
-            seqno = -1;
-            battery = -1;
-            for (j = 0; j < n_sensors; j++)
-            {
-                sensor_type     = *(uint8_t *)(p + j*3 + 0);
-                sensor_value    = *(int16_t *)(p + j*3 + 1);
+        /*
+         * Older captures don't have the real time, so their readings are
+         * timestamped as if the capture had started now
+         */
+        if (timestamp.realtime == 0)
+            timestamp.realtime = start_time.realtime + (timestamp.monotonic - first);
 
-                if (sensor_type == WL_SENSOR_TYPE_COUNTER)
-                    seqno = sensor_value;
-                else if (sensor_type == WL_SENSOR_TYPE_BATTERY)
-                    battery = sensor_value;
-            }
+        if (!process_message(message, n, &timestamp, clock, alerts, sensor_state, db, NULL, cfg))
+        {
+            fprintf(stderr, "message process failed\n");
+            fclose(f);
+            return 1;
+        }
 
-            /*
-             * Process the various sensor values
-             */
-            for (j = 0; j < n_sensors; j++)
-            {
-                sensor_type     = *(uint8_t *)(p + j*3 + 0);
-                sensor_value    = *(int16_t *)(p + j*3 + 1);
+        count++;
+        bytes += n;
+    }
 
-                if (sensor_type == WL_SENSOR_TYPE_COUNTER)
-                    continue;
+    if (n < 0)
+        fprintf(stderr, "%s: capture file is truncated or corrupt\n", path);
 
-                /*
-                 * If this sensor is a newer reading from the last time we
-                 * checked, then update the database with the new value.
-                 */
-                if (sensor_changed(station_id, sensor_type, seqno, sensor_state))
-                {
-                    if (!db_insert(stmt, station_id, sensor_type, sensor_value, age))
-                        return false;
-                }
-            }
+    elapsed = capture_now() - start;
 
-            /*
-             * Log messages if a station battery enters/leaves low voltage state
-             */
-            if (battery != -1)
-            {
-                if (battery <= STATION_LOWBATT_THRESHOLD)
-                {
-                    if ((station_state[station_id] & STATION_FLAG_LOWBATT) == 0)
-                    {
-                        syslog(LOG_ERR, "error: low battery warning from station %d (%.1fV)",
-                            station_id, battery / 10.0);
-                        station_state[station_id] |= STATION_FLAG_LOWBATT;
-                    }
-                }
-                else
-                if (battery >= STATION_OKBATT_THRESHOLD)
-                {
-                    if ((station_state[station_id] & STATION_FLAG_LOWBATT) != 0)
-                    {
-                        syslog(LOG_NOTICE, "normal battery level restored for station %d (%.1fV)",
-                            station_id, battery / 10.0);
-                        station_state[station_id] &= ~STATION_FLAG_LOWBATT;
-                    }
-                }
-            }
-        }
+    printf("replayed %ld snapshots (%ld bytes) in %.3f s: %.1f snapshots/s\n",
+        count, bytes, elapsed / 1e9, elapsed ? count / (elapsed / 1e9) : 0.0);
 
-        p += n_sensors * 3; /* skip sensor type/values */
-        p += 2;             /* skip age */
-    }
+    fclose(f);
 
-    return true;
+    return n < 0;
+}
+
+/**
+ * Print a usage message.
+ *
+ * @param[in]   prog    The program name.
+ */
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-c config] [-w capture] [-c config -r capture [-f]]\n", prog);
+    fprintf(stderr, "\t-c\tConfiguration file (default %s)\n", CONFIG_PATH);
+    fprintf(stderr, "\t-w\tRecord raw snapshots to a capture file (appended to if it exists)\n");
+    fprintf(stderr, "\t-r\tReplay a capture file instead of reading the receiver. The readings\n");
+    fprintf(stderr, "\t\tare stored in the database set by -c, which is required and should\n");
+    fprintf(stderr, "\t\tname a scratch database; alerts are checked but not reported\n");
+    fprintf(stderr, "\t-f\tReplay as fast as possible\n");
 }
 
 int
 main(int argc, char*argv[])
 {
     int                 i2c_device;
-    MYSQL               *inst;
-    MYSQL_STMT          *stmt;
-    station_state_t     station_state[256];
+    db_t                *db;
+    config_t            cfg;
+    const char          *config_path    = CONFIG_PATH;
+    bool                config_required = false;
+    alert_engine_t      *alerts;
     reading_t           *sensor_state   = NULL;
+    rxclock_t           clock;
+    livestate_t         *live;
+    diag_state_t        diag;
     struct sigaction    sigact;
+    sigset_t            sigmask;
+    int                 signal_fd;
+    int                 timer_fd;
+    int                 epoll_fd;
+    int                 control_fd;
+    bool                stop            = false;
+    bool                reload          = false;
+    bool                dump            = false;
+    bool                poll_now        = true;
+    const char          *capture_path   = NULL;
+    const char          *replay_path    = NULL;
+    bool                fast            = false;
+    FILE                *capture        = NULL;
+    int                 opt;
     int                 i;
 
+    while ((opt = getopt(argc, argv, "c:w:r:fh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            config_path = optarg;
+            config_required = true;
+            break;
+        case 'w':
+            capture_path = optarg;
+            break;
+        case 'r':
+            replay_path = optarg;
+            break;
+        case 'f':
+            fast = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /*
+     * A replay stores every reading again, so it mustn't go to the
+     * configured database by default
+     */
+    if (replay_path != NULL && !config_required)
+    {
+        fprintf(stderr, "%s: -r needs -c with a scratch database\n", argv[0]);
+        usage(argv[0]);
+        return 1;
+    }
+
+    config_defaults(&cfg);
+    if (!load_config(config_path, config_required, &cfg))
+        return 1;
+
     openlog("sensord", 0, LOG_LOCAL1);
+    rxclock_init(&clock);
+    memset(&diag, 0, sizeof(diag));
 
-    if ((i2c_device = open(I2C_DEVICE, O_RDWR)) < 0)
+    if (replay_path != NULL)
     {
-        fprintf(stderr, "Failed to open %s: %s\n", I2C_DEVICE, strerror(errno));
+        int     status;
+
+        if (db_start(&db, &cfg) != 0)
+        {
+            fprintf(stderr, "Database initialisation failed\n");
+            return 1;
+        }
+
+        if ((alerts = alert_start(&cfg, NULL)) == NULL)
+        {
+            fprintf(stderr, "Alert initialisation failed\n");
+            return 1;
+        }
+
+        alert_mute(alerts);
+
+        sigemptyset(&sigact.sa_mask);
+        sigact.sa_flags = 0;
+        sigact.sa_handler = set_shutdown_flag;
+        sigaction(SIGINT, &sigact, NULL);
+        sigaction(SIGTERM, &sigact, NULL);
+
+        status = replay(replay_path, fast, &clock, alerts, &sensor_state, db, &cfg);
+
+        sensor_state_free(&sensor_state);
+        alert_end(alerts);
+        db_end(db);
+        closelog();
+
+        return status;
+    }
+
+    if (capture_path != NULL && (capture = capture_open_write(capture_path)) == NULL)
+    {
+        fprintf(stderr, "Failed to open capture file %s: %s\n", capture_path,
+            errno == EINVAL ? "not a capture file of this version" : strerror(errno));
         return 1;
     }
-    if (ioctl(i2c_device, I2C_SLAVE, (long)I2C_SLAVE_ADDRESS) < 0)
+
+    if ((i2c_device = receiver_open(&cfg)) < 0)
     {
-        fprintf(stderr, "ioctl(I2C_SLAVE) failed: %s\n", strerror(errno));
-        close(i2c_device);
+        fprintf(stderr, "Failed to open receiver at %s address 0x%02x: %s\n",
+            cfg.i2c_device, cfg.i2c_address, strerror(errno));
         return 1;
     }
 
-    if (db_start(&inst, &stmt) != 0)
+    if (db_start(&db, &cfg) != 0)
     {
         fprintf(stderr, "Database initialisation failed\n");
         return 1;
     }
 
+    if ((alerts = alert_start(&cfg, NULL)) == NULL)
+    {
+        fprintf(stderr, "Alert initialisation failed\n");
+        return 1;
+    }
+
     /*
-     * Set up signal handling:
-     *  ignore HUP
+     * Signals are taken through a signalfd, so block them:
+     *  reload the configuration on HUP
+     *  write out the event trace on USR1
      *  terminate on INT, TERM
      */
-    sigemptyset(&sigact.sa_mask);
-    sigact.sa_flags = 0;
-
-    sigact.sa_handler = SIG_IGN;
-    sigaction(SIGHUP, &sigact, NULL);
-
-    sigact.sa_handler = set_shutdown_flag;
-    sigaction(SIGINT, &sigact, NULL);
-    sigaction(SIGTERM, &sigact, NULL);
-
-    memset(station_state, 0, sizeof(station_state));
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGHUP);
+    sigaddset(&sigmask, SIGUSR1);
+    sigaddset(&sigmask, SIGINT);
+    sigaddset(&sigmask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &sigmask, NULL);
 
     syslog(LOG_INFO, "started; entering event loop");
 
@@ -516,39 +686,179 @@ main(int argc, char*argv[])
      */
     daemon(0, 0);
 
+    if
+    (
+        (signal_fd = signalfd(-1, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0
+        ||
+        (timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0
+        ||
+        (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0
+        ||
+        !epoll_add(epoll_fd, signal_fd)
+        ||
+        !epoll_add(epoll_fd, timer_fd)
+    )
+    {
+        syslog(LOG_ERR, "error: failed to set up the event loop: %s", strerror(errno));
+        return 1;
+    }
+
+    if ((control_fd = control_open(cfg.control_socket)) < 0 || !epoll_add(epoll_fd, control_fd))
+    {
+        syslog(LOG_WARNING, "warning: no control socket at %s: %s", cfg.control_socket, strerror(errno));
+        control_close(control_fd, cfg.control_socket);
+        control_fd = -1;
+    }
+
+    if ((live = livestate_create(cfg.shared_state)) == NULL)
+        syslog(LOG_WARNING, "warning: no shared state at %s: %s", cfg.shared_state, strerror(errno));
+
     /*
-     * Main event loop
+     * Main event loop. Nothing runs between events: polls are scheduled
+     * with the timer, and signals and control commands wake us straight
+     * away.
      */
-    while (!Shutdown)
+    while (!stop)
     {
-        char    i2c_message[256];
-        int     n;
+        struct epoll_event      events[3];
+        struct signalfd_siginfo si;
+        uint64_t                expirations;
+        int                     n;
 
-        /*
-         * Read current state from the sensor receiver
-         */
-        if ((n = read(i2c_device, i2c_message, sizeof(i2c_message))) < 0)
+        if (reload)
         {
-            fprintf(stderr, "message read failed: %s\n", strerror(errno));
-            return 1;
+            char    old_control[CONFIG_MAX_STRING];
+            char    old_shared[CONFIG_MAX_STRING];
+            int     old_interval    = cfg.poll_interval;
+
+            reload = false;
+            strcpy(old_control, cfg.control_socket);
+            strcpy(old_shared, cfg.shared_state);
+            reload_config(config_path, &cfg, &db, &i2c_device, &alerts);
+
+            /*
+             * The receiver may have been reflashed
+             */
+            diag.unsupported = false;
+
+            if (strcmp(old_control, cfg.control_socket) != 0)
+            {
+                control_close(control_fd, old_control);
+
+                if ((control_fd = control_open(cfg.control_socket)) < 0 || !epoll_add(epoll_fd, control_fd))
+                {
+                    syslog(LOG_WARNING, "warning: no control socket at %s: %s", cfg.control_socket, strerror(errno));
+                    control_close(control_fd, cfg.control_socket);
+                    control_fd = -1;
+                }
+            }
+
+            if (strcmp(old_shared, cfg.shared_state) != 0)
+            {
+                livestate_remove(live, old_shared);
+
+                if ((live = livestate_create(cfg.shared_state)) == NULL)
+                    syslog(LOG_WARNING, "warning: no shared state at %s: %s", cfg.shared_state, strerror(errno));
+            }
+
+            if (cfg.poll_interval != old_interval)
+                poll_timer_set(timer_fd, cfg.poll_interval);
         }
 
-        if (!process_message(i2c_message, n, station_state, &sensor_state, stmt))
+        if (dump)
         {
-            fprintf(stderr, "message process failed\n");
+            dump = false;
+            if (!trace_dump(cfg.trace_file))
+                syslog(LOG_ERR, "error: failed to write trace to %s: %s", cfg.trace_file, strerror(errno));
+        }
+
+        if (poll_now)
+        {
+            poll_now = false;
+
+            if
+            (
+                !poll_receiver(i2c_device, &capture, &clock, alerts, &sensor_state, db, live, &cfg)
+                ||
+                !poll_diagnostics(i2c_device, db, &diag, &cfg)
+            )
+            {
+                trace_dump(cfg.trace_file);
+                return 1;
+            }
+
+            /*
+             * Sensors send messages every 64 seconds, so the default interval
+             * will ensure we don't miss any updates. A poll on demand starts
+             * the interval again.
+             */
+            poll_timer_set(timer_fd, cfg.poll_interval);
+        }
+
+        if ((n = epoll_wait(epoll_fd, events, 3, -1)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            syslog(LOG_ERR, "error: epoll_wait failed: %s", strerror(errno));
             return 1;
         }
 
-        /*
-         * Sensors send messages every 64 seconds, so this will ensure we don't miss 
-         * any updates.
-         */
-        for (i = 0; !Shutdown && i < 45; ++i)
-            sleep(1);
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == signal_fd)
+            {
+                while (read(signal_fd, &si, sizeof(si)) == sizeof(si))
+                {
+                    if (si.ssi_signo == SIGHUP)
+                        reload = true;
+                    else
+                    if (si.ssi_signo == SIGUSR1)
+                        dump = true;
+                    else
+                        stop = true;
+                }
+            }
+            else
+            if (events[i].data.fd == timer_fd)
+            {
+                if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                    poll_now = true;
+            }
+            else
+            if (events[i].data.fd == control_fd)
+            {
+                int     command;
+
+                while ((command = control_read(control_fd)) != CONTROL_NONE)
+                {
+                    trace(TRACE_CONTROL, command);
+
+                    if (command == CONTROL_POLL)
+                        poll_now = true;
+                    else
+                    if (command == CONTROL_RELOAD)
+                        reload = true;
+                    else
+                    if (command == CONTROL_TRACE)
+                        dump = true;
+                }
+            }
+        }
     }
 
-    db_end(inst, stmt);
+    sensor_state_free(&sensor_state);
+    alert_end(alerts);
+    db_end(db);
+
+    if (capture != NULL)
+        fclose(capture);
 
+    control_close(control_fd, cfg.control_socket);
+    livestate_remove(live, cfg.shared_state);
+    close(epoll_fd);
+    close(timer_fd);
+    close(signal_fd);
     close(i2c_device);
 
     syslog(LOG_INFO, "terminating");
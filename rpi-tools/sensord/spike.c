@@ -0,0 +1,210 @@
+/*
+ * Filtering of spikes in sensor readings (see spike.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "wireless.h"
+#include "spike.h"
+
+/**
+ * The fewest readings in a window before readings are checked against it
+ */
+#define SPIKE_MIN_VALUES    3
+
+/**
+ * After this long without a reading, a sensor's window is started again,
+ * in milliseconds
+ */
+#define SPIKE_STALE_MS      (60 * 60 * 1000LL)
+
+/**
+ * The temperature a DS1820 reports before its first conversion (85.0C).
+ * It turns up just when a station's readings start, before there are
+ * enough in the window to judge it by, so it is held back on sight then.
+ */
+#define SPIKE_DS1820_RESET  850
+
+/**
+ * The smallest distance from the median that makes a reading suspect, by
+ * sensor type, in the sensor's units (see wireless.h); 0 if the type isn't
+ * checked. It keeps a sensor that hardly changes from having its normal
+ * noise taken for spikes.
+ */
+static const int32_t    spike_min_limit[WL_SENSOR_TYPE_MAX + 1] =
+{
+    0,          /* invalid */
+    50,         /* temperature: 5.0C */
+    50,         /* pressure: 5.0hPa */
+    0,          /* counter */
+    0,          /* light: it can change at any moment */
+    150,        /* humidity: 15.0%RH */
+    5           /* battery: 0.5V */
+};
+
+/**
+ * The recent readings of a station sensor.
+ */
+typedef struct
+{
+    int32_t             values[SPIKE_WINDOW];
+
+    /** when the last reading was checked (ms since the epoch) */
+    int64_t             last;
+
+    /** the number of readings in values[], and where the next one goes */
+    uint8_t             count;
+    uint8_t             next;
+
+    /** whether the last reading was suspect */
+    bool                suspect;
+}
+    spike_window_t;
+
+static spike_window_t   spike_windows[256][WL_SENSOR_TYPE_MAX + 1];
+
+/**
+ * Find the median of some values, sorting them.
+ *
+ * @param[in,out]   v       The values.
+ * @param[in]       n       The number of values (at least one).
+ *
+ * @return      the median (the lower middle value, for an even number).
+ */
+static int32_t
+median_of(int32_t *v, int n)
+{
+    int32_t     x;
+    int         i;
+    int         j;
+
+    for (i = 1; i < n; i++)
+    {
+        x = v[i];
+
+        for (j = i; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+
+        v[j] = x;
+    }
+
+    return v[(n - 1) / 2];
+}
+
+/**
+ * Check a new reading against the sensor's recent readings, then add it to
+ * them.
+ *
+ * @param[in]   station     The station ID.
+ * @param[in]   sensor      The sensor type.
+ * @param[in]   value       The reading.
+ * @param[in]   timestamp   When it was received (ms since the epoch).
+ * @param[in]   threshold   How many median absolute deviations from the
+ *                          median a reading can be.
+ * @param[out]  median      The median of the recent readings, if suspect.
+ *
+ * @return      true if the reading is suspect.
+ */
+bool
+spike_check
+(
+    uint8_t     station,
+    uint8_t     sensor,
+    int32_t     value,
+    int64_t     timestamp,
+    int         threshold,
+    int32_t     *median
+)
+{
+    spike_window_t  *w;
+    int32_t         v[SPIKE_WINDOW];
+    int32_t         mid;
+    int64_t         limit;
+    int64_t         distance;
+    int             i;
+
+    if (sensor > WL_SENSOR_TYPE_MAX || spike_min_limit[sensor] == 0)
+        return false;
+
+    w = &spike_windows[station][sensor];
+
+    if (w->count != 0 && timestamp - w->last > SPIKE_STALE_MS)
+    {
+        w->count = 0;
+        w->next = 0;
+    }
+
+    w->suspect = false;
+
+    if (w->count >= SPIKE_MIN_VALUES)
+    {
+        for (i = 0; i < w->count; i++)
+            v[i] = w->values[i];
+
+        mid = median_of(v, w->count);
+
+        /*
+         * The deviations, kept within range (a corrupt reading can be
+         * anything)
+         */
+        for (i = 0; i < w->count; i++)
+        {
+            distance = (int64_t)v[i] - mid;
+            if (distance < 0)
+                distance = -distance;
+
+            v[i] = distance > INT32_MAX ? INT32_MAX : (int32_t)distance;
+        }
+
+        limit = (int64_t)median_of(v, w->count) * threshold;
+        if (limit < spike_min_limit[sensor])
+            limit = spike_min_limit[sensor];
+
+        distance = (int64_t)value - mid;
+
+        if (distance > limit || -distance > limit)
+        {
+            w->suspect = true;
+            *median = mid;
+        }
+    }
+    else
+    if (sensor == WL_SENSOR_TYPE_TEMPERATURE && value == SPIKE_DS1820_RESET)
+    {
+        /*
+         * The median is the reading itself if there is nothing else yet.
+         * Unlike other suspect readings, this one is known to be wrong, so
+         * it's kept out of the window.
+         */
+        for (i = 0; i < w->count; i++)
+            v[i] = w->values[i];
+
+        w->suspect = true;
+        *median = w->count != 0 ? median_of(v, w->count) : value;
+
+        return true;
+    }
+
+    w->values[w->next] = value;
+    w->next = (w->next + 1) % SPIKE_WINDOW;
+    if (w->count < SPIKE_WINDOW)
+        w->count++;
+    w->last = timestamp;
+
+    return w->suspect;
+}
+
+/**
+ * Find whether a sensor's last reading was suspect.
+ *
+ * @param[in]   station     The station ID.
+ * @param[in]   sensor      The sensor type.
+ *
+ * @return      true if it was.
+ */
+bool
+spike_suspect(uint8_t station, uint8_t sensor)
+{
+    return sensor <= WL_SENSOR_TYPE_MAX && spike_windows[station][sensor].suspect;
+}
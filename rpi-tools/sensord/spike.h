@@ -0,0 +1,36 @@
+#ifndef __SPIKE_H__
+#define __SPIKE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * A filter for spikes in each station sensor's readings: a DS1820's 85C
+ * power-on value, say, or a corrupt frame that got past the 8-bit CRC. A
+ * reading is suspect if it is further from the median of the sensor's last
+ * SPIKE_WINDOW readings than a multiple of their median absolute deviation
+ * (or, if that is larger, a limit for the sensor type). Until there are
+ * enough readings to judge by (after sensord starts, or a station has been
+ * silent for an hour), only the DS1820's 85C is suspect, and it is left
+ * out of the window. Other suspect readings still go into the window, so a
+ * real step change is accepted once it makes up most of the window.
+ *
+ * The windows are kept in a static table indexed by station and sensor
+ * type, so a check costs the same whatever the number of stations, and
+ * allocates nothing. Counters, light levels and derived values aren't
+ * checked.
+ */
+#define SPIKE_WINDOW        7
+
+extern bool             spike_check
+                        (
+                            uint8_t     station,
+                            uint8_t     sensor,
+                            int32_t     value,
+                            int64_t     timestamp,
+                            int         threshold,
+                            int32_t     *median
+                        );
+extern bool             spike_suspect(uint8_t station, uint8_t sensor);
+
+#endif /* __SPIKE_H__ */
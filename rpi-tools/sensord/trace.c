@@ -0,0 +1,177 @@
+/*
+ * The event trace ring, and writing it out.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* for clock_gettime */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define TRACE_MAGIC         "RFST"
+#define TRACE_HDR_LEN       28
+#define TRACE_REC_LEN       16
+
+typedef struct
+{
+    /** CLOCK_MONOTONIC time of the event, in nanoseconds */
+    uint64_t            time;
+
+    /** the event (TRACE_*) */
+    uint16_t            event;
+
+    /** the event's argument */
+    int32_t             arg;
+}
+    trace_event_t;
+
+/**
+ * The ring of events, and the number of events ever recorded (so the next
+ * slot is trace_next % TRACE_EVENTS)
+ */
+static trace_event_t    trace_ring[TRACE_EVENTS];
+static uint32_t         trace_next;
+
+/**
+ * Event names, indexed by TRACE_*
+ */
+static const char *const    trace_events[TRACE_MAX + 1] =
+{
+    "unknown", "poll-start", "poll-end", "read", "parse", "rows", "error",
+    "reload", "resync", "control", "diagnostics", "quarantine"
+};
+
+/**
+ * Error names, indexed by TRACE_ERR_*
+ */
+static const char *const    trace_errors[] =
+{
+    "unknown", "read", "db", "capture", "diagnostics"
+};
+
+/**
+ * Record an event, overwriting the oldest once the ring is full.
+ *
+ * @param[in]   event       The event (TRACE_*).
+ * @param[in]   arg         The event's argument.
+ */
+void
+trace(uint16_t event, int32_t arg)
+{
+    trace_event_t       *e  = &trace_ring[trace_next++ & (TRACE_EVENTS - 1)];
+    struct timespec     ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    e->time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    e->event = event;
+    e->arg = arg;
+}
+
+/**
+ * Put a little-endian integer.
+ */
+static void
+put_le(uint8_t *p, uint64_t v, int n)
+{
+    int         i;
+
+    for (i = 0; i < n; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+/**
+ * Write the trace ring out to a file. It's written to a temporary file
+ * first, so a reader never sees a partial trace.
+ *
+ * @param[in]   path    The name of the file.
+ *
+ * @return      true for success, false otherwise.
+ */
+bool
+trace_dump(const char *path)
+{
+    char                tmp[256];
+    uint8_t             hdr[TRACE_HDR_LEN];
+    uint8_t             rec[TRACE_REC_LEN];
+    struct timespec     mono;
+    struct timespec     real;
+    uint32_t            count;
+    uint32_t            i;
+    trace_event_t       *e;
+    bool                ok;
+    FILE                *f;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return false;
+
+    if ((f = fopen(tmp, "wb")) == NULL)
+        return false;
+
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+
+    count = trace_next < TRACE_EVENTS ? trace_next : TRACE_EVENTS;
+
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, TRACE_MAGIC, 4);
+    hdr[4] = TRACE_VERSION;
+    put_le(hdr + 8, (uint64_t)mono.tv_sec * 1000000000 + mono.tv_nsec, 8);
+    put_le(hdr + 16, (uint64_t)real.tv_sec * 1000000000 + real.tv_nsec, 8);
+    put_le(hdr + 24, count, 4);
+
+    ok = fwrite(hdr, sizeof(hdr), 1, f) == 1;
+
+    for (i = trace_next - count; ok && i != trace_next; i++)
+    {
+        e = &trace_ring[i & (TRACE_EVENTS - 1)];
+
+        memset(rec, 0, sizeof(rec));
+        put_le(rec, e->time, 8);
+        put_le(rec + 8, e->event, 2);
+        put_le(rec + 12, (uint32_t)e->arg, 4);
+
+        ok = fwrite(rec, sizeof(rec), 1, f) == 1;
+    }
+
+    if (fclose(f) != 0)
+        ok = false;
+
+    if (ok && rename(tmp, path) == 0)
+        return true;
+
+    remove(tmp);
+    return false;
+}
+
+/**
+ * Return the name of an event.
+ *
+ * @param[in]   event       The event (TRACE_*).
+ */
+const char *
+trace_event_name(int event)
+{
+    if (event < 1 || event > TRACE_MAX)
+        return trace_events[0];
+
+    return trace_events[event];
+}
+
+/**
+ * Return the name of an error.
+ *
+ * @param[in]   error       The error (TRACE_ERR_*).
+ */
+const char *
+trace_error_name(int error)
+{
+    if (error < 1 || error >= (int)(sizeof(trace_errors) / sizeof(trace_errors[0])))
+        return trace_errors[0];
+
+    return trace_errors[error];
+}
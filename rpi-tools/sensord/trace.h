@@ -0,0 +1,67 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * A trace of sensord's recent events, kept in a fixed ring in memory and
+ * written out on request (SIGUSR1) for tracedump to decode. Recording an
+ * event is a clock read (through the vDSO, so no system call) and three
+ * stores, so tracing is always on.
+ *
+ * Trace files (all integers LSB first):
+ *
+ * File header:
+ *  4   "RFST"
+ *  1   file format version (TRACE_VERSION)
+ *  3   reserved (zero)
+ *  8   CLOCK_MONOTONIC time the trace was written, in nanoseconds
+ *  8   CLOCK_REALTIME time the trace was written, in nanoseconds since the
+ *      epoch
+ *  4   number of events
+ *
+ * Then per event, oldest first:
+ *  8   CLOCK_MONOTONIC time of the event, in nanoseconds
+ *  2   event (TRACE_*)
+ *  2   reserved (zero)
+ *  4   argument (signed; see below)
+ */
+#define TRACE_VERSION       1
+
+/*
+ * The number of events kept (a power of 2)
+ */
+#define TRACE_EVENTS        4096
+
+/*
+ * Events, and their arguments
+ */
+#define TRACE_POLL_START    1   /* poll of the receiver started (0) */
+#define TRACE_POLL_END      2   /* poll finished (microseconds taken) */
+#define TRACE_READ          3   /* snapshot read (bytes) */
+#define TRACE_PARSE         4   /* snapshot parsed (stations, -1 if malformed) */
+#define TRACE_ROWS          5   /* rows written for a snapshot */
+#define TRACE_ERROR         6   /* an error (TRACE_ERR_*) */
+#define TRACE_RELOAD        7   /* configuration reloaded (0, or 1 on failure) */
+#define TRACE_RESYNC        8   /* receiver clock resynchronised (ms out) */
+#define TRACE_CONTROL       9   /* control command received (CONTROL_*) */
+#define TRACE_DIAGNOSTICS   10  /* receiver diagnostics read (its uptime, seconds) */
+#define TRACE_QUARANTINE    11  /* reading quarantined (station * 256 + sensor) */
+
+#define TRACE_MAX           11
+
+/*
+ * Errors
+ */
+#define TRACE_ERR_READ      1   /* I2C read failed */
+#define TRACE_ERR_DB        2   /* database insert failed */
+#define TRACE_ERR_CAPTURE   3   /* capture file write failed */
+#define TRACE_ERR_DIAGNOSTICS 4 /* receiver diagnostics read failed */
+
+extern void             trace(uint16_t event, int32_t arg);
+extern bool             trace_dump(const char *path);
+extern const char       *trace_event_name(int event);
+extern const char       *trace_error_name(int error);
+
+#endif /* __TRACE_H__ */
@@ -0,0 +1,241 @@
+/*
+ * Decoder for sensord's event traces (see trace.h).
+ *
+ * Prints one line per event, oldest first: the wall clock time, the time
+ * since the previous event, and the event with its argument. The trace
+ * file is the one given, or trace_file from the configuration.
+ */
+
+#define _POSIX_C_SOURCE 200112L     /* for getopt, localtime_r */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "trace.h"
+#include "control.h"
+
+#define TRACE_MAGIC         "RFST"
+#define TRACE_HDR_LEN       28
+#define TRACE_REC_LEN       16
+
+/**
+ * Get a little-endian integer.
+ */
+static uint64_t
+get_le(const uint8_t *p, int n)
+{
+    uint64_t    v   = 0;
+    int         i;
+
+    for (i = 0; i < n; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+
+    return v;
+}
+
+/**
+ * Print an event's argument.
+ *
+ * @param[in]   event       The event (TRACE_*).
+ * @param[in]   arg         The event's argument.
+ */
+static void
+print_arg(int event, int32_t arg)
+{
+    switch (event)
+    {
+    case TRACE_POLL_END:
+        printf(" %.3f ms", arg / 1000.0);
+        break;
+    case TRACE_READ:
+        printf(" %d bytes", arg);
+        break;
+    case TRACE_PARSE:
+        if (arg < 0)
+            printf(" malformed");
+        else
+            printf(" %d stations", arg);
+        break;
+    case TRACE_ROWS:
+        printf(" %d rows", arg);
+        break;
+    case TRACE_ERROR:
+        printf(" %s", trace_error_name(arg));
+        break;
+    case TRACE_RELOAD:
+        printf(" %s", arg == 0 ? "ok" : "failed");
+        break;
+    case TRACE_RESYNC:
+        printf(" %d ms out", arg);
+        break;
+    case TRACE_CONTROL:
+        printf(" %s", arg == CONTROL_POLL ? "poll" : arg == CONTROL_RELOAD ? "reload"
+            : arg == CONTROL_TRACE ? "trace" : "unknown");
+        break;
+    case TRACE_DIAGNOSTICS:
+        printf(" up %d s", arg);
+        break;
+    case TRACE_QUARANTINE:
+        printf(" station %d sensor %d", arg >> 8, arg & 0xff);
+        break;
+    case TRACE_POLL_START:
+        break;
+    default:
+        printf(" %d", arg);
+        break;
+    }
+}
+
+/**
+ * Decode a trace file.
+ *
+ * @param[in]   path        The trace file.
+ *
+ * @return      zero for success, non-zero otherwise.
+ */
+static int
+decode(const char *path)
+{
+    uint8_t     hdr[TRACE_HDR_LEN];
+    uint8_t     rec[TRACE_REC_LEN];
+    uint64_t    dump_mono;
+    uint64_t    dump_real;
+    uint64_t    real;
+    uint64_t    t;
+    uint64_t    prev        = 0;
+    uint32_t    count;
+    uint32_t    i;
+    time_t      secs;
+    struct tm   tm;
+    char        when[32];
+    FILE        *f;
+
+    if ((f = fopen(path, "rb")) == NULL)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if
+    (
+        fread(hdr, sizeof(hdr), 1, f) != 1
+        ||
+        memcmp(hdr, TRACE_MAGIC, 4) != 0
+        ||
+        hdr[4] != TRACE_VERSION
+    )
+    {
+        fprintf(stderr, "%s: not a sensord trace file\n", path);
+        fclose(f);
+        return 1;
+    }
+
+    dump_mono = get_le(hdr + 8, 8);
+    dump_real = get_le(hdr + 16, 8);
+    count = (uint32_t)get_le(hdr + 24, 4);
+
+    for (i = 0; i < count; i++)
+    {
+        if (fread(rec, sizeof(rec), 1, f) != 1)
+        {
+            fprintf(stderr, "%s: truncated after %u events\n", path, i);
+            fclose(f);
+            return 1;
+        }
+
+        t = get_le(rec, 8);
+
+        /*
+         * Events are timed on the monotonic clock; map them to the wall
+         * clock through the times the trace was written
+         */
+        real = dump_real - (dump_mono - t);
+        secs = (time_t)(real / 1000000000);
+        localtime_r(&secs, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+
+        printf("%s.%06lu %+12.6f  %-10s", when,
+            (unsigned long)(real % 1000000000 / 1000),
+            i == 0 ? 0.0 : (double)(int64_t)(t - prev) / 1e9,
+            trace_event_name((int)get_le(rec + 8, 2)));
+        print_arg((int)get_le(rec + 8, 2), (int32_t)get_le(rec + 12, 4));
+        printf("\n");
+
+        prev = t;
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+/**
+ * Print a usage message.
+ *
+ * @param[in]   prog    The program name.
+ */
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-f config] [trace-file]\n", prog);
+    fprintf(stderr, "\t-f\tConfiguration file, for the trace file (default %s)\n", CONFIG_PATH);
+}
+
+int
+main(int argc, char *argv[])
+{
+    config_t    cfg;
+    const char  *config_path    = CONFIG_PATH;
+    int         config_required = 0;
+    int         status;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "f:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            config_path = optarg;
+            config_required = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind < argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (optind == argc - 1)
+        return decode(argv[optind]);
+
+    /*
+     * The default configuration file is optional
+     */
+    config_defaults(&cfg);
+    status = config_load(config_path, &cfg);
+
+    if (status > 0)
+    {
+        fprintf(stderr, "%s: %s: error at line %d\n", argv[0], config_path, status);
+        return 1;
+    }
+
+    if (status < 0 && (config_required || errno != ENOENT))
+    {
+        fprintf(stderr, "%s: failed to read %s: %s\n", argv[0], config_path, strerror(errno));
+        return 1;
+    }
+
+    return decode(cfg.trace_file);
+}
@@ -0,0 +1,296 @@
+/*
+ * Host checks for the parts of sensord that keep state between readings:
+ * the spike filter (spike.c), the count of missed messages from a
+ * station's counter (snapshot_missed()), and the alert rule index
+ * (alert.c). The program exits non-zero if any check fails.
+ *
+ * spike.c and alert.c are included, so their static tables and hash can be
+ * looked at directly.
+ *
+ * make check
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "spike.c"
+#include "alert.c"
+
+static int              failures    = 0;
+
+/**
+ * Count a failed check, and say what it was.
+ *
+ * @param[in]   ok          The check passed.
+ * @param[in]   format      printf() format for what was checked.
+ */
+static void
+check(bool ok, const char *format, ...)
+{
+    va_list     ap;
+
+    if (ok)
+        return;
+
+    va_start(ap, format);
+    vprintf(format, ap);
+    va_end(ap);
+    printf("\n");
+
+    failures++;
+}
+
+/**
+ * Check a temperature reading with the spike filter.
+ *
+ * @param[in]   station     The station ID.
+ * @param[in]   value       The reading, in tenths of a degree.
+ * @param[in]   timestamp   When it was received (ms since the epoch).
+ * @param[in]   suspect     Whether it should be suspect.
+ * @param[in]   median      The median it should be given, if suspect.
+ */
+static void
+spike_expect(uint8_t station, int32_t value, int64_t timestamp, bool suspect, int32_t median)
+{
+    int32_t     m       = INT32_MIN;
+    bool        s;
+
+    s = spike_check(station, WL_SENSOR_TYPE_TEMPERATURE, value, timestamp, 5, &m);
+
+    check(s == suspect, "spike: station %u reading %d suspect %d, expected %d",
+        station, value, s, suspect);
+    check(!suspect || m == median, "spike: station %u reading %d median %d, expected %d",
+        station, value, m, median);
+    check(spike_suspect(station, WL_SENSOR_TYPE_TEMPERATURE) == s,
+        "spike: station %u reading %d spike_suspect() disagrees", station, value);
+}
+
+static void
+test_spike(void)
+{
+    const spike_window_t    *w      = &spike_windows[1][WL_SENSOR_TYPE_TEMPERATURE];
+    int64_t                 t       = 1000000;
+    int32_t                 m;
+    int                     i;
+    int                     n;
+
+    /*
+     * A DS1820's 85.0C before there is a window: suspect, its own median,
+     * and kept out of the window
+     */
+    spike_expect(1, 850, t++, true, 850);
+    check(w->count == 0, "spike: 85.0C went into an empty window");
+
+    spike_expect(1, 200, t++, false, 0);
+    spike_expect(1, 202, t++, false, 0);
+
+    spike_expect(1, 850, t++, true, 200);
+    check(w->count == 2, "spike: 85.0C went into a window of %d", w->count);
+
+    /*
+     * Only the temperature's 85.0 is held back; 85.0%RH is a reading
+     */
+    check(!spike_check(1, WL_SENSOR_TYPE_HUMIDITY, 850, t++, 5, &m),
+        "spike: 85.0%%RH suspect before the window filled");
+
+    /*
+     * With a window, 85.0C is judged like any other reading
+     */
+    spike_expect(1, 201, t++, false, 0);
+    spike_expect(1, 850, t++, true, 201);
+    check(w->count == 4, "spike: window of %d after a checked 85.0C, expected 4", w->count);
+
+    /*
+     * Readings within the sensor's limit aren't suspect, however steady
+     * the window; one further out is
+     */
+    spike_expect(2, 100, t++, false, 0);
+    for (i = 0; i < SPIKE_WINDOW - 1; i++)
+        spike_expect(2, 100, t++, false, 0);
+    spike_expect(2, 150, t++, false, 0);
+    spike_expect(2, 151, t++, true, 100);
+
+    /*
+     * A step change is suspect until it makes up most of the window
+     */
+    for (i = 0; i < SPIKE_WINDOW; i++)
+        spike_expect(4, 100, t++, false, 0);
+    for (n = 0; n < SPIKE_WINDOW; n++)
+        if (!spike_check(4, WL_SENSOR_TYPE_TEMPERATURE, 400, t++, 5, &m))
+            break;
+    check(n == SPIKE_WINDOW / 2 + 1, "spike: step accepted after %d suspect readings, expected %d",
+        n, SPIKE_WINDOW / 2 + 1);
+
+    /*
+     * Stations have windows of their own
+     */
+    spike_expect(3, 400, t++, false, 0);
+
+    /*
+     * After an hour without readings, the window starts again
+     */
+    t += SPIKE_STALE_MS + 1;
+    spike_expect(1, 850, t++, true, 850);
+    check(w->count == 0, "spike: stale window kept %d readings", w->count);
+}
+
+/**
+ * Check the number of messages missed between two counter values.
+ *
+ * @param[in]   seqno       The new counter value.
+ * @param[in]   last        The previous counter value.
+ * @param[in]   missed      The number missed.
+ */
+static void
+missed_expect(int32_t seqno, int32_t last, int32_t missed)
+{
+    int32_t     n       = snapshot_missed(seqno, last);
+
+    check(n == missed, "missed: %#x after %#x gives %d, expected %d", seqno, last, n, missed);
+}
+
+static void
+test_missed(void)
+{
+    missed_expect(5, 5, 0);
+    missed_expect(5, 4, 0);
+    missed_expect(9, 4, 4);
+
+    /*
+     * The counter wraps at 15 bits
+     */
+    missed_expect(0, WL_COUNTER_MASK, 0);
+    missed_expect(2, WL_COUNTER_MASK - 1, 3);
+    missed_expect(WL_COUNTER_MASK, WL_COUNTER_MASK - 2, 1);
+
+    /*
+     * Up to half the range is a gap; more is a reset, and only the
+     * messages since it are missed
+     */
+    missed_expect(WL_COUNTER_MASK / 2 + 1, 1, WL_COUNTER_MASK / 2 - 1);
+    missed_expect(WL_COUNTER_MASK / 2 + 2, 1, WL_COUNTER_MASK / 2 + 2);
+    missed_expect(3, 1000, 3);
+    missed_expect(0, 1000, 0);
+}
+
+/**
+ * Add a rule to a configuration.
+ *
+ * @param[in,out]   cfg     The configuration.
+ * @param[in]       station The station ID, or 0 for all stations.
+ * @param[in]       sensor  The sensor type.
+ * @param[in]       above   The rule's threshold, for an "above" rule.
+ */
+static void
+alert_rule(config_t *cfg, int station, int sensor, int32_t above)
+{
+    config_alert_t  *def    = &cfg->alerts[cfg->nalerts++];
+
+    memset(def, 0, sizeof(*def));
+    snprintf(def->name, sizeof(def->name), "rule-%d", cfg->nalerts);
+    def->station = station;
+    def->sensor = sensor;
+    def->kind = ALERT_KIND_ABOVE;
+    def->threshold = above;
+    def->clear = above;
+}
+
+static void
+test_alert(void)
+{
+    static config_t     cfg;
+    alert_engine_t      *engine;
+    alert_engine_t      *reloaded;
+    alert_key_t         *key;
+    unsigned int        h;
+    unsigned int        station;
+    unsigned int        sensor;
+    unsigned int        other;
+    int                 i;
+
+    for (station = 0; station < 256; station++)
+        for (sensor = 0; sensor <= WL_SENSOR_TYPE_MAX; sensor++)
+            check(alert_hash(station, sensor) < ALERT_HASH_SIZE,
+                "alert: hash of %u/%u out of range", station, sensor);
+
+    /*
+     * Find a station whose temperature hashes with station 1's
+     */
+    h = alert_hash(1, WL_SENSOR_TYPE_TEMPERATURE);
+    for (other = 2; other < 256; other++)
+        if (alert_hash(other, WL_SENSOR_TYPE_TEMPERATURE) == h)
+            break;
+    check(other < 256, "alert: no hash collision to test with");
+
+    memset(&cfg, 0, sizeof(cfg));
+    alert_rule(&cfg, 1, WL_SENSOR_TYPE_TEMPERATURE, 300);
+    alert_rule(&cfg, other, WL_SENSOR_TYPE_TEMPERATURE, 200);
+    alert_rule(&cfg, 1, WL_SENSOR_TYPE_HUMIDITY, 900);
+    alert_rule(&cfg, 0, WL_SENSOR_TYPE_TEMPERATURE, 400);
+
+    if ((engine = alert_start(&cfg, NULL)) == NULL)
+    {
+        check(false, "alert: alert_start() failed");
+        return;
+    }
+
+    alert_mute(engine);
+
+    /*
+     * Each (station, sensor) has its own entry, whatever shares its bucket
+     */
+    for (i = 0; i < cfg.nalerts; i++)
+    {
+        key = alert_find(engine, cfg.alerts[i].station, cfg.alerts[i].sensor);
+
+        check(key != NULL && key->nrules == 1 && key->rules[0] == &engine->rules[i],
+            "alert: rule %d not found under %d/%d", i,
+            cfg.alerts[i].station, cfg.alerts[i].sensor);
+    }
+
+    check(alert_find(engine, other, WL_SENSOR_TYPE_HUMIDITY) == NULL,
+        "alert: found a rule for %u/humidity", other);
+
+    /*
+     * A reading is checked against its station's rules and the rules for
+     * all stations, and no others
+     */
+    alert_reading(engine, other, WL_SENSOR_TYPE_TEMPERATURE, 250, 1000);
+    alert_reading(engine, 1, WL_SENSOR_TYPE_TEMPERATURE, 250, 1000);
+    alert_reading(engine, 5, WL_SENSOR_TYPE_TEMPERATURE, 450, 1000);
+
+    check(!engine->rules[0].state[1].active, "alert: station 1 raised at 25.0C");
+    check(engine->rules[1].state[other].active, "alert: station %u not raised at 25.0C", other);
+    check(!engine->rules[1].state[1].active, "alert: station %u's rule raised for station 1", other);
+    check(!engine->rules[2].state[1].active, "alert: humidity rule raised by a temperature");
+    check(engine->rules[3].state[5].active, "alert: rule for all stations not raised");
+    check(!engine->rules[3].state[1].active, "alert: rule for all stations raised at 25.0C");
+
+    /*
+     * Reloading the same rules keeps raised alerts raised
+     */
+    if ((reloaded = alert_start(&cfg, engine)) == NULL)
+        check(false, "alert: alert_start() failed on reload");
+    else
+    {
+        check(reloaded->rules[1].state[other].active, "alert: raised alert lost on reload");
+        alert_end(reloaded);
+    }
+
+    alert_end(engine);
+}
+
+int
+main(void)
+{
+    test_spike();
+    test_missed();
+    test_alert();
+
+    printf("%s: %d failures\n", failures ? "FAIL" : "ok", failures);
+
+    return failures != 0;
+}
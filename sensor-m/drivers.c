@@ -0,0 +1,125 @@
+/*
+ * Sensor drivers for the multi-sensor station
+ */
+#include <avr/io.h>
+#include <avr/power.h>
+#include <util/delay.h>
+#include MCU_H
+
+#include "avr-common.h"
+
+#include "one-wire.h"
+#include "ds1820.h"
+#include "../sensor-t/battery.h"
+#include "drivers.h"
+
+/**
+ * Convert a DS1820 reading to tenths of a degree (see sensor-t).
+ */
+#define DS1820_TENTHS(TEMP, FRACT)  \
+    (((TEMP) << 3) + ((TEMP) << 1) + ((FRACT) << 2) + (FRACT))
+
+/**
+ * Set up the 1-wire connection to the DS1820.
+ */
+void
+ds1820_sensor_init(void)
+{
+    onewire_init(&DDRB, &PORTB, &PINB, PIN_DS1820);
+}
+
+/**
+ * Read the temperature from the DS1820.
+ *
+ *  @param[out] value   The temperature in tenths of a degree.
+ *
+ *  @return     Non-zero (the DS1820 always gives a reading).
+ */
+uint8_t
+ds1820_sensor_read(int32_t *value)
+{
+    uint8_t     temp, fract;
+
+    ds1820_get_temperature(&temp, &fract);
+    *value = DS1820_TENTHS(temp, fract);
+
+    return 1;
+}
+
+/**
+ * The light sensor is an LDR between Vcc and PIN_LIGHT, with a resistor from
+ * PIN_LIGHT to ground. Turn off the digital input on the pin, as it sits at
+ * an analogue level.
+ */
+void
+light_sensor_init(void)
+{
+    cbi(DDRB, PIN_LIGHT);
+    cbi(PORTB, PIN_LIGHT);
+    sbi(DIDR0, ADC1D);
+}
+
+/**
+ * Read the light level.
+ *
+ * The reading is taken against Vcc, so it doesn't depend on the battery
+ * voltage.
+ *
+ *  @param[out] value   The light level, 0 (dark) to 1023 (bright).
+ *
+ *  @return     Non-zero (always gives a reading).
+ */
+uint8_t
+light_sensor_read(int32_t *value)
+{
+    uint16_t    adc;
+
+    /*
+     * ADMUX.REFS[2:0] = 000    => reference is Vcc
+     * ADMUX.MUX[3:0] = 0001    => input is ADC1 (PB2)
+     */
+    power_adc_enable();
+    ADMUX = (1 << MUX0);
+    sbi(ADCSRA, ADSC);
+
+    while ((ADCSRA & (1<<ADSC)) != 0)
+        continue;
+
+    adc = ADCL;
+    adc += (ADCH & 0x3) << 8;
+
+    power_adc_disable();
+
+    *value = adc;
+
+    return 1;
+}
+
+/**
+ * Set up the ADC for battery measurements.
+ */
+void
+battery_sensor_init(void)
+{
+    battery_init();
+}
+
+/**
+ * Read the battery voltage.
+ *
+ *  @param[out] value   The battery voltage in tenths of a volt.
+ *
+ *  @return     Non-zero (always gives a reading).
+ */
+uint8_t
+battery_sensor_read(int32_t *value)
+{
+    /*
+     * Give the bandgap reference time to settle after the input switch
+     */
+    battery_start();
+    _delay_ms(1);
+    *value = battery_read();
+
+    return 1;
+}
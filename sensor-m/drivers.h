@@ -0,0 +1,37 @@
+#ifndef __DRIVERS_H__
+#define __DRIVERS_H__
+
+#include <stdint.h>
+
+/*
+ * A sensor driver. The station keeps a table of these (in ascending order
+ * of type), and samples each one every 'interval' measurement cycles.
+ *
+ * read() returns non-zero if it stored a value.
+ */
+typedef struct
+{
+    uint8_t     type;                       /* WL_SENSOR_TYPE_* */
+    uint8_t     interval;                   /* in measurement cycles */
+    void        (*init)(void);
+    uint8_t     (*read)(int32_t *value);
+}
+    sensor_driver_t;
+
+/*
+ * Pin assignments (PORTB). PB1 is the transmitter, and PB3/PB4 hold the
+ * crystal.
+ */
+#define PIN_DS1820          PB0
+#define PIN_LIGHT           PB2     /* ADC1 */
+
+extern void             ds1820_sensor_init(void);
+extern uint8_t          ds1820_sensor_read(int32_t *value);
+
+extern void             light_sensor_init(void);
+extern uint8_t          light_sensor_read(int32_t *value);
+
+extern void             battery_sensor_init(void);
+extern uint8_t          battery_sensor_read(int32_t *value);
+
+#endif /* __DRIVERS_H__ */
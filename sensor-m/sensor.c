@@ -0,0 +1,359 @@
+/*
+ * Wireless Transmitter for a station with several sensors
+ *
+ * Each sensor has a driver (see drivers.h), sampled on its own interval.
+ * Whatever readings are due in a cycle are sent together in one message.
+ */
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+#include <avr/wdt.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
+#include MCU_H
+
+#include "avr-common.h"
+
+#include "../include/wireless.h"
+#include "../sensor-t/jitter.h"
+#include "../sensor-t/transmit.h"
+#include "drivers.h"
+
+/**
+ * Send compact messages (WL_SYNC_COMPACT) rather than standard ones (only
+ * if asked for, as they need an up to date receiver).
+ */
+#ifndef MSG_FORMAT_COMPACT
+#define MSG_FORMAT_COMPACT  0
+#endif
+
+/**
+ * Send frames with forward error correction (WL_SYNC_FLAG_FEC).
+ */
+#ifndef TX_FEC
+#define TX_FEC              0
+#endif
+
+#if TX_FEC
+#define TX_SYNC_FLAGS       WL_SYNC_FLAG_FEC
+#else
+#define TX_SYNC_FLAGS       0
+#endif
+
+/**
+ * The number of watchdog interrupts (every 8 seconds) in a measurement
+ * cycle. Currently gives us 64s cycles.
+ */
+#define WATCHDOG_INTR_THRESOLD      8
+
+/**
+ * Randomise the length of each cycle (see jitter.h).
+ */
+#ifndef TX_JITTER
+#define TX_JITTER                   1
+#endif
+
+/**
+ * Which sensors are fitted, and how often (in measurement cycles) each is
+ * sampled. The battery is always measured.
+ */
+#ifndef SENSOR_DS1820
+#define SENSOR_DS1820               1
+#endif
+
+#ifndef SENSOR_LIGHT
+#define SENSOR_LIGHT                1
+#endif
+
+#ifndef TEMPERATURE_INTERVAL
+#define TEMPERATURE_INTERVAL        1
+#endif
+
+#ifndef LIGHT_INTERVAL
+#define LIGHT_INTERVAL              5
+#endif
+
+#define BATTERY_CHECK_THRESHOLD     60
+
+#define NUM_DRIVERS                 (SENSOR_DS1820 + SENSOR_LIGHT + 1)
+
+#if NUM_DRIVERS + 1 > WL_SENSOR_MAX_VALUES
+#error "Too many sensors for one message (WL_SENSOR_MAX_VALUES)"
+#endif
+
+/**
+ * The sensor drivers, in ascending order of type (the order in which
+ * compact messages carry their values).
+ */
+static const sensor_driver_t    drivers[NUM_DRIVERS] PROGMEM =
+{
+#if SENSOR_DS1820
+    {
+        WL_SENSOR_TYPE_TEMPERATURE, TEMPERATURE_INTERVAL,
+        ds1820_sensor_init, ds1820_sensor_read
+    },
+#endif
+#if SENSOR_LIGHT
+    {
+        WL_SENSOR_TYPE_LIGHT, LIGHT_INTERVAL,
+        light_sensor_init, light_sensor_read
+    },
+#endif
+    {
+        WL_SENSOR_TYPE_BATTERY, BATTERY_CHECK_THRESHOLD,
+        battery_sensor_init, battery_sensor_read
+    },
+};
+
+/**
+ * The number of measurement cycles until each driver is next sampled.
+ * Everything is sampled on the first cycle.
+ */
+static uint8_t          driver_countdown[NUM_DRIVERS];
+
+/**
+ * A counter of the number of watchdog interrupts we have received.
+ */
+static volatile int16_t intr_counter;
+
+/**
+ * Set by the watchdog interrupt handler when it's time to take a
+ * measurement.
+ */
+static volatile uint8_t measure_pending;
+
+#if TX_JITTER
+/**
+ * The number of watchdog interrupts in the current cycle.
+ */
+static uint8_t          cycle_intervals = WATCHDOG_INTR_THRESOLD;
+
+/**
+ * Set when the watchdog is running a short jitter interval, at the end of
+ * which we transmit.
+ */
+static uint8_t          jitter_pending;
+
+/**
+ * Jitter generator state; seeded from our station ID.
+ */
+static uint16_t         jitter_state;
+
+/**
+ * Watchdog timeouts for the jitter interval (see JITTER_OFFSET_INDEX).
+ */
+static const uint8_t    jitter_timeouts[] PROGMEM =
+{
+    WDTO_15MS, WDTO_30MS, WDTO_60MS, WDTO_120MS,
+    WDTO_250MS, WDTO_500MS, WDTO_1S, WDTO_2S
+};
+#endif
+
+/**
+ * A counter that is incremented for each message.
+ */
+static int16_t          msg_counter;
+
+/**
+ * Our station ID; retrieved from EEPROM.
+ */
+static uint8_t          station_id;
+
+/**
+ * Sample the sensors that are due, and transmit the readings to the
+ * receiver in one message, along with the message sequence number.
+ */
+static void
+send_measurement(void)
+{
+    sensor_driver_t     d;
+    int32_t             value;
+    uint8_t             i;
+#if MSG_FORMAT_COMPACT
+    uint8_t             msg[WL_COMPACT_MSG_MAX_SIZE];
+    uint8_t             mask    = WL_COMPACT_TYPE_BIT(WL_SENSOR_TYPE_COUNTER);
+    uint8_t             *p      = msg + WL_COMPACT_MSG_HDR_LEN;
+#else
+    uint8_t             msg[WL_SENSOR_MSG_MAX_SIZE];
+    uint8_t             *p      = msg + WL_SENSOR_MSG_HDR_LEN;
+    uint8_t             n       = 0;
+#endif
+
+    for (i = 0; i < NUM_DRIVERS; i++)
+    {
+        if (driver_countdown[i] != 0)
+        {
+            driver_countdown[i]--;
+            continue;
+        }
+
+        memcpy_P(&d, &drivers[i], sizeof(d));
+        driver_countdown[i] = d.interval - 1;
+
+        if (!d.read(&value))
+            continue;
+
+#if MSG_FORMAT_COMPACT
+        mask |= WL_COMPACT_TYPE_BIT(d.type);
+        if (WL_SENSOR_TYPE_WIDTH(d.type) == 4)
+            p = wl_compact_put_value32(p, value);
+        else
+            p = wl_compact_put_value(p, value);
+#else
+        p = wl_sensor_put_value(p, d.type, value);
+        n++;
+#endif
+    }
+
+    /*
+     * Compact messages send every value as an absolute value (a key frame),
+     * as the temperature may not be sampled on the key frame boundaries.
+     */
+#if MSG_FORMAT_COMPACT
+    WL_COMPACT_MSG_STATION_ID(msg) = station_id;
+    WL_COMPACT_MSG_MASK(msg) = mask;
+    WL_COMPACT_MSG_SEQ(msg) = (uint8_t)msg_counter;
+
+    tx_message(WL_SYNC_COMPACT | TX_SYNC_FLAGS, msg, p - msg);
+#else
+    p = wl_sensor_put_value(p, WL_SENSOR_TYPE_COUNTER, msg_counter);
+    n++;
+
+    WL_SENSOR_MSG_STATION_ID(msg) = station_id;
+    WL_SENSOR_MSG_NUM_VALUES(msg) =
+        WL_SENSOR_MSG_NVALUES(WL_SENSOR_MSG_VERSION_1, n);
+
+    tx_message(WL_SYNC_STANDARD | TX_SYNC_FLAGS, msg, p - msg);
+#endif
+
+    if (++msg_counter < 0)
+        msg_counter = 0;
+}
+
+/**
+ * Watchdog interrupt handler.
+ *
+ * Called every 8 seconds. Every 8th time this is called (i.e. every 64 seconds)
+ * ask the main loop to take a measurement. With TX_JITTER, the cycle length
+ * is randomised as for sensor-t.
+ */
+#if TX_JITTER
+ISR(WDT_vect)
+{
+    uint16_t    r;
+
+    if (jitter_pending)
+    {
+        jitter_pending = 0;
+        wdt_enable(WDTO_8S);
+
+        measure_pending = 1;
+    }
+    else
+    if (++intr_counter >= cycle_intervals)
+    {
+        intr_counter = 0;
+
+        r = jitter_next(&jitter_state);
+        cycle_intervals = JITTER_CYCLE_INTERVALS(r);
+
+        jitter_pending = 1;
+        wdt_enable(pgm_read_byte(&jitter_timeouts[JITTER_OFFSET_INDEX(r)]));
+    }
+
+    sbi(WDTCR, WDIE);
+}
+#else
+ISR(WDT_vect)
+{
+    if (++intr_counter == WATCHDOG_INTR_THRESOLD)
+    {
+        measure_pending = 1;
+        intr_counter = 0;
+    }
+
+    sbi(WDTCR, WDIE);
+}
+#endif
+
+static uint8_t mcusr_saved \
+    __attribute__ ((section (".noinit")));
+
+void
+watchdog_init(void) \
+    __attribute__((naked)) \
+    __attribute__((section(".init3")));
+
+/**
+ * Save the state of MCUSR (so we know if we had a reset).
+ *
+ * Also disable the watchdog timer. This is called before main().
+ */
+void watchdog_init(void)
+{
+    mcusr_saved = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+}
+
+int
+main(void)
+{
+    sensor_driver_t     d;
+    uint8_t             i;
+
+    /*
+     * Setup the GPIO pin connected to the RF transmitter
+     */
+    tx_init();
+
+    /*
+     * Read our station ID from the EEPROM
+     */
+    station_id = eeprom_read_byte(0x00);
+
+#if TX_JITTER
+    jitter_state = jitter_seed(station_id);
+#endif
+
+    /*
+     * Set up the sensors
+     */
+    for (i = 0; i < NUM_DRIVERS; i++)
+    {
+        memcpy_P(&d, &drivers[i], sizeof(d));
+        d.init();
+    }
+
+    /*
+     * Turn off unnecessary features to save power
+     */
+    power_adc_disable();
+    power_usi_disable();
+    power_timer0_disable();
+    power_timer1_disable();
+
+    /*
+     * Set the watchdog timer to generate an interrupt after 8s, and spend
+     * the rest of the time asleep.
+     */
+    wdt_enable(WDTO_8S);
+    sbi(WDTCR, WDIE);
+
+    sei();
+
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+
+    for (;;)
+    {
+        sleep_mode();
+
+        if (measure_pending)
+        {
+            measure_pending = 0;
+            send_measurement();
+        }
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * Battery voltage measurement
+ *
+ * The ADC measures the 1.1V bandgap reference against Vcc, so the battery
+ * voltage can be worked out without any external components.
+ */
+#include <avr/io.h>
+#include <avr/power.h>
+#include <avr/pgmspace.h>
+#include MCU_H
+
+#include "avr-common.h"
+
+#include "battery.h"
+#include "battery_lut.h"
+
+/**
+ * Set up the ADC, and leave it powered down.
+ *
+ * ADMUX.REFS[2:0] = 000    => reference is Vcc
+ * ADMUX.MUX[3:0] = 1100    => input is Vbg (1.1v)
+ * ADCSRA.ADEN = 1          => enable ADC
+ */
+void
+battery_init(void)
+{
+    sbi(ADMUX, MUX3);
+    sbi(ADMUX, MUX2);
+    sbi(ADCSRA, ADEN);
+    sbi(ADCSRA, ADSC);  // start 1st conversion
+
+    power_adc_disable();
+}
+
+/**
+ * Start a battery measurement, by selecting the bandgap input and starting
+ * a conversion. The bandgap reference takes a while to settle, so the
+ * reading is taken by battery_read(), which should be called a little
+ * later (e.g. after a temperature conversion).
+ */
+void
+battery_start(void)
+{
+    power_adc_enable();
+    ADMUX = (1 << MUX3) | (1 << MUX2);
+    sbi(ADCSRA, ADSC);
+}
+
+/**
+ * Take the measurement started by battery_start(), and power the ADC down
+ * again.
+ *
+ *  @return     The battery voltage in tenths of a volt.
+ */
+int16_t
+battery_read(void)
+{
+    uint16_t    adc;
+
+    /*
+     * Discard the conversion started with the input switch, and take a
+     * fresh one now the reference has settled
+     */
+    while ((ADCSRA & (1<<ADSC)) != 0)
+        continue;
+
+    sbi(ADCSRA, ADSC);
+    while ((ADCSRA & (1<<ADSC)) != 0)
+        continue;
+
+    adc = ADCL;
+    adc += (ADCH & 0x3) << 8;
+
+    power_adc_disable();
+
+    return adc_to_battery(adc);
+}
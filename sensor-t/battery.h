@@ -0,0 +1,10 @@
+#ifndef __BATTERY_H__
+#define __BATTERY_H__
+
+#include <stdint.h>
+
+extern void             battery_init(void);
+extern void             battery_start(void);
+extern int16_t          battery_read(void);
+
+#endif /* __BATTERY_H__ */
@@ -0,0 +1,69 @@
+/*
+ * Conversion of battery ADC readings to volts
+ *
+ * This is shared with the host-side test in sim/, so it only needs
+ * <stdint.h>; the includer defines PROGMEM and pgm_read_word() (from
+ * <avr/pgmspace.h> on the AVR).
+ */
+#ifndef __BATTERY_LUT_H__
+#define __BATTERY_LUT_H__
+
+#include <stdint.h>
+
+/*
+ * Lookup table to convert from ADC readings to battery voltage. A reading
+ * at or below the first entry is 3.4V, and each entry after it takes off
+ * another 0.1V.
+ *
+ *  Vbg / Vcc = adc / 1023  =>  adc = Vbg * 1023 / Vcc
+ *
+ * Entry i is the reading for Vcc = 3.3V - 0.1V * i, rounded down. The
+ * table is generated at compile time and searched with adc_to_battery().
+ */
+#define ADC_VBG_MV          1100
+#define ADC_LUT_MAX_VOLTS   34      /* x10 */
+#define ADC_LUT_ENTRY(I)    \
+    ((uint16_t)((ADC_VBG_MV * 1023UL) / (3300 - 100 * (I))))
+#define ADC_LUT_ENTRIES     (sizeof(adc_lut) / sizeof(adc_lut[0]))
+
+static const uint16_t   adc_lut[]   PROGMEM =
+{
+    ADC_LUT_ENTRY(0),  ADC_LUT_ENTRY(1),  ADC_LUT_ENTRY(2),  ADC_LUT_ENTRY(3),
+    ADC_LUT_ENTRY(4),  ADC_LUT_ENTRY(5),  ADC_LUT_ENTRY(6),  ADC_LUT_ENTRY(7),
+    ADC_LUT_ENTRY(8),  ADC_LUT_ENTRY(9),  ADC_LUT_ENTRY(10), ADC_LUT_ENTRY(11),
+    ADC_LUT_ENTRY(12), ADC_LUT_ENTRY(13), ADC_LUT_ENTRY(14), ADC_LUT_ENTRY(15),
+    ADC_LUT_ENTRY(16), ADC_LUT_ENTRY(17), ADC_LUT_ENTRY(18), ADC_LUT_ENTRY(19),
+    ADC_LUT_ENTRY(20), ADC_LUT_ENTRY(21), ADC_LUT_ENTRY(22)
+};
+
+/**
+ * Convert an ADC reading of the bandgap reference to the battery voltage.
+ *
+ * Binary search for the first table entry at or above the reading; each
+ * entry below it takes 0.1V off the maximum.
+ *
+ *  @param[in]  adc     The ADC reading.
+ *
+ *  @return     The battery voltage in tenths of a volt.
+ */
+static inline int16_t
+adc_to_battery(uint16_t adc)
+{
+    uint8_t     lo  = 0;
+    uint8_t     hi  = ADC_LUT_ENTRIES;
+    uint8_t     mid;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) >> 1;
+
+        if (pgm_read_word(&adc_lut[mid]) >= adc)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return ADC_LUT_MAX_VOLTS - lo;
+}
+
+#endif /* __BATTERY_LUT_H__ */
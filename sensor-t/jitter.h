@@ -0,0 +1,68 @@
+/*
+ * Transmit jitter for sensor stations
+ *
+ * Stations wake from an 8 second watchdog timer, and every station's timer
+ * runs at a slightly different rate. Without jitter, two stations whose
+ * timers drift into phase will collide on every cycle until they drift out
+ * again, which can take hours. Instead, each cycle is made up of a random
+ * number of watchdog intervals (7, 8, 8 or 9, so the mean cycle length is
+ * unchanged), followed by a short random watchdog interval before the
+ * message is sent. Any collision is then independent of the last one.
+ *
+ * The random sequence is a 16-bit xorshift generator seeded from the station
+ * ID, so each station follows its own schedule.
+ *
+ * This is shared with the host-side simulation in sim/.
+ */
+#ifndef __JITTER_H__
+#define __JITTER_H__
+
+#include <stdint.h>
+
+/**
+ * Seed the generator for a station. The seed is never zero.
+ *
+ *  @param[in]  station_id  The station ID.
+ *
+ *  @return     The initial generator state.
+ */
+static inline uint16_t
+jitter_seed(uint8_t station_id)
+{
+    return ((uint16_t)station_id << 8) ^ 0xace1;
+}
+
+/**
+ * Advance the generator.
+ *
+ *  @param[in,out]  state   The generator state.
+ *
+ *  @return     The next random value.
+ */
+static inline uint16_t
+jitter_next(uint16_t *state)
+{
+    uint16_t    x   = *state;
+
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+
+    return *state = x;
+}
+
+/**
+ * The number of 8 second watchdog intervals in the next cycle, given a
+ * random value from jitter_next().
+ */
+#define JITTER_CYCLE_INTERVALS(R)   \
+    (((R) & 0x3) == 0 ? 7 : ((R) & 0x3) == 3 ? 9 : 8)
+
+/**
+ * The short watchdog interval to wait before transmitting, given a random
+ * value from jitter_next(). This is an index into the watchdog timeouts
+ * 16ms, 32ms, 64ms, ... 2s (i.e. WDTO_15MS to WDTO_2S).
+ */
+#define JITTER_OFFSET_INDEX(R)      (((R) >> 2) & 0x7)
+
+#endif /* __JITTER_H__ */
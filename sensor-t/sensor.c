@@ -19,13 +19,45 @@
 #include "one-wire.h"
 #include "ds1820.h"
 #include "../include/wireless.h"
+#include "battery.h"
+#include "jitter.h"
+#include "transmit.h"
 
 /**
  * The size of a message for a DS1820-based sensor.
  */
 #define MSG_SIZE_DS1820     (WL_SENSOR_MSG_HDR_LEN + 3*WL_SENSOR_MSG_VALUE_LEN)
 
-#define PIN_TX      PB1
+/**
+ * The largest compact message: temperature and battery (the counter is
+ * carried in the header).
+ */
+#define MSG_SIZE_COMPACT    (WL_COMPACT_MSG_HDR_LEN + 2*WL_COMPACT_VALUE_MAX_LEN)
+
+/**
+ * Send compact messages (WL_SYNC_COMPACT) rather than standard ones. A
+ * compact frame is about half the length of a standard one, but needs a
+ * receiver that understands them, so they are only sent if asked for.
+ */
+#ifndef MSG_FORMAT_COMPACT
+#define MSG_FORMAT_COMPACT  0
+#endif
+
+/**
+ * Send frames with forward error correction (WL_SYNC_FLAG_FEC). This doubles
+ * the length of the frame after the sync byte, but lets the receiver correct
+ * bit errors, so it suits stations at the edge of reception.
+ */
+#ifndef TX_FEC
+#define TX_FEC              0
+#endif
+
+#if TX_FEC
+#define TX_SYNC_FLAGS       WL_SYNC_FLAG_FEC
+#else
+#define TX_SYNC_FLAGS       0
+#endif
+
 #define PIN_SENSOR  PB2
 
 /**
@@ -35,176 +67,166 @@
 #define WATCHDOG_INTR_THRESOLD      8
 
 /**
- * The number of message we send before we should include a battery check.
+ * Randomise the length of each cycle (see jitter.h), so that stations whose
+ * clocks drift into phase don't keep colliding.
+ */
+#ifndef TX_JITTER
+#define TX_JITTER                   1
+#endif
+
+/**
+ * The number of measurement cycles before we should include a battery check.
  */
 #define BATTERY_CHECK_THRESHOLD     60
 
+/**
+ * Only transmit when the temperature has moved by REPORT_THRESHOLD (in
+ * tenths of a degree) since the last value we sent, or when we have been
+ * silent for HEARTBEAT_CYCLES measurement cycles. The temperature is still
+ * read every cycle.
+ */
+#ifndef REPORT_ON_CHANGE
+#define REPORT_ON_CHANGE            0
+#endif
+
+#ifndef REPORT_THRESHOLD
+#define REPORT_THRESHOLD            5
+#endif
+
+#ifndef HEARTBEAT_CYCLES
+#define HEARTBEAT_CYCLES            4
+#endif
+
+/**
+ * The longest a measurement cycle can take, in seconds.
+ */
+#if TX_JITTER
+#define CYCLE_MAX_SECONDS           (8 * 9 + 2)
+#else
+#define CYCLE_MAX_SECONDS           (8 * WATCHDOG_INTR_THRESOLD)
+#endif
+
+#if REPORT_ON_CHANGE && \
+    2 * HEARTBEAT_CYCLES * CYCLE_MAX_SECONDS >= WL_STATION_DEAD_THRESHOLD
+#error "HEARTBEAT_CYCLES is too long: a lost heartbeat would mark the station dead"
+#endif
+
 /**
  * A counter of the number of watchdog interrupts we have received.
  */
 static volatile int16_t intr_counter;
 
 /**
- * A counter that is incremented for each message. This is used by the
- * receiver to determine if our state has changed.
+ * Set by the watchdog interrupt handler when it's time to take a
+ * measurement. The measurement is taken from the main loop, so that the
+ * transmitter interrupt can run while it sends.
  */
-static volatile int16_t msg_counter;
+static volatile uint8_t measure_pending;
 
+#if TX_JITTER
 /**
- * A counter of the number of messages we have sent. Used to decide when to
- * perform a voltage measurement.
+ * The number of watchdog interrupts in the current cycle.
  */
-static volatile uint8_t batt_counter;
+static uint8_t          cycle_intervals = WATCHDOG_INTR_THRESOLD;
 
 /**
- * Our station ID; retrieved from EEPROM.
+ * Set when the watchdog is running a short jitter interval, at the end of
+ * which we transmit.
  */
-static uint8_t          station_id;
+static uint8_t          jitter_pending;
 
-/*
- * Lookup table to convert from ADC readings to battery voltage.
- * First entry is 3.4V, thereafter descending by 0.1V for each step.
+/**
+ * Jitter generator state; seeded from our station ID.
  */
-static const uint16_t   adc_lut[]   PROGMEM = {341, 351, 363, 375, 388, 401, 416, 432, 450, 468, 489, 511, 535, 562, 592, 625, 661, 703, 750, 803, 865, 937, 1023};
+static uint16_t         jitter_state;
 
 /**
- * Delay 210us.
- *
- * Don't do it on one call as there are frequency-dependent
- * limitations on the max delay.
+ * Watchdog timeouts for the jitter interval (see JITTER_OFFSET_INDEX).
  */
-static void inline
-state_delay(void)
+static const uint8_t    jitter_timeouts[] PROGMEM =
 {
-    _delay_us(50);
-    _delay_us(50);
-    _delay_us(50);
-    _delay_us(50);
-    _delay_us(10);
-}
+    WDTO_15MS, WDTO_30MS, WDTO_60MS, WDTO_120MS,
+    WDTO_250MS, WDTO_500MS, WDTO_1S, WDTO_2S
+};
+#endif
 
 /**
- * Send one bit using Machester encoding.
- *
- *  0 = 0 -> 1
- *  1 = 1 -> 0
- *
- *  @param[in]  bit     The bit value to transmit.
+ * A counter that is incremented for each message. This is used by the
+ * receiver to determine if our state has changed.
  */
-static void
-send_bit(uint8_t bit)
-{
-    if (bit)
-    {
-        sbi(PORTB, PIN_TX);
-        state_delay();
+static volatile int16_t msg_counter;
 
-        cbi(PORTB, PIN_TX);
-        state_delay();
-    }
-    else
-    {
-        cbi(PORTB, PIN_TX);
-        state_delay();
+/**
+ * A counter of the number of measurement cycles. Used to decide when to
+ * perform a voltage measurement.
+ */
+static volatile uint8_t batt_counter;
 
-        sbi(PORTB, PIN_TX);
-        state_delay();
-    }
-}
+#if REPORT_ON_CHANGE
+/**
+ * The last temperature we transmitted.
+ */
+static int16_t          reported_temperature;
 
 /**
- * Transmit one byte of data.
- *
- *  @param[in]  byte   The byte value to transmit.
+ * The number of measurement cycles since we last transmitted. Starts out
+ * large so that the first measurement is always sent.
  */
-static void
-send_byte(uint8_t byte)
-{
-    for (uint8_t i = 0; i < 8; i++)
-    {
-        send_bit(byte & 0x01);
-        byte >>= 1;
-    }
-}
+static uint8_t          silent_cycles   = HEARTBEAT_CYCLES;
+#endif
 
 /**
- * Transmit the preamble bit pattern.
+ * Our station ID; retrieved from EEPROM.
  */
-static void
-send_preamble(void)
-{
-    for (uint8_t i = 0; i < 32; i++)
-        send_bit(0);
+static uint8_t          station_id;
 
-    send_bit(1);
-    send_bit(1);
-}
+#if MSG_FORMAT_COMPACT
+/**
+ * The temperature sent in the last compact key frame. Other compact messages
+ * send the temperature as a delta from this.
+ */
+static int16_t          key_temperature;
+#endif
 
 /**
- * Transmit a message to the receiver.
+ * Convert a DS1820 reading to tenths of a degree.
  *
- * A message consists of:
- *  - preamble to allow the receiver to lock on to the signal
- *  - sync byte marking the start of the message
- *  - message length
- *  - message data
- *  - a CRC of (message length + data)
- *
- *  @param[in]  data    The data to transmit.
- *  @param[in]  length  The length of the message payload.
+ * The DS1820 has 0.5C resolution, so this is just temp * 10 + fract * 5,
+ * done with shifts as the ATtiny has no multiplier.
  */
-static void
-tx_message(const char *data, uint8_t length)
-{
-    uint8_t     crc = 0;
-
-    sbi(DDRB, PIN_TX);
-    cbi(PORTB, PIN_TX);
-
-    send_preamble();
-
-    // send sync
-    send_byte(0xc4);
-
-    // send msg size
-    send_byte(length);
-    crc = _crc_ibutton_update(crc, length);
-
-    // send msg
-    for (uint8_t i = 0; i < length; i++)
-    {
-        send_byte(data[i]);
-        crc = _crc_ibutton_update(crc, data[i]);
-    }
-
-    // send CRC
-    send_byte(crc);
-
-    cbi(DDRB, PIN_TX);
-    cbi(PORTB, PIN_TX);
-}
+#define DS1820_TENTHS(TEMP, FRACT)  \
+    (((TEMP) << 3) + ((TEMP) << 1) + ((FRACT) << 2) + (FRACT))
 
 /**
  * Take a temperature measurement and and transmit it to the receiver.
+ *
+ * In report-on-change mode, the measurement is only transmitted if it has
+ * changed enough, if it includes a battery reading, or if a heartbeat is due.
  */
 static void
 send_measurement(void)
 {
     uint8_t temp, fract;
     int16_t t;
-    int16_t adc;
-    int     i;
     int16_t battery             = 0;
     uint8_t do_battery_check    = 0;
-    char    msg[MSG_SIZE_DS1820];
+#if REPORT_ON_CHANGE
+    int16_t change;
+#endif
+#if MSG_FORMAT_COMPACT
+    uint8_t msg[MSG_SIZE_COMPACT];
+    uint8_t mask;
+    uint8_t *p;
+#else
+    uint8_t msg[MSG_SIZE_DS1820];
+#endif
 
     /*
      * Kick off an ADC conversion to check the battery (every 60 messages)
      */
     if (batt_counter == 0)
     {
-        power_adc_enable();
-        sbi(ADCSRA, ADSC);
+        battery_start();
         do_battery_check = 1;
     }
 
@@ -216,34 +238,29 @@ send_measurement(void)
      * Retrieve the temperature from the sensor
      */
     ds1820_get_temperature(&temp, &fract);
-    t = (temp << 3) + (temp << 1) + (fract << 2) + fract;
+    t = DS1820_TENTHS(temp, fract);
 
     if (do_battery_check)
-    {
-        /*
-         * Wait for the ADC conversion to complete
-         */
-        while ((ADCSRA & (1<<ADSC)) != 0)
-            continue;
-
-        adc = ADCL;
-        adc += (ADCH & 0x3) << 8;
-
-        /*
-         * Vbg / Vcc = adc / 1023
-         * => Vcc = Vbg * 1023 / adc
-         */
-        battery = 34;
-        for (i = 0; i < sizeof(adc_lut); i++)
-        {
-            uint16_t   threshold    = pgm_read_dword(&adc_lut[i]);
-
-            if (threshold >= adc)
-                break;
-
-            --battery;
-        }
-    }
+        battery = battery_read();
+
+#if REPORT_ON_CHANGE
+    change = t - reported_temperature;
+    if (change < 0)
+        change = -change;
+
+    if
+    (
+        !do_battery_check
+        &&
+        change < REPORT_THRESHOLD
+        &&
+        ++silent_cycles < HEARTBEAT_CYCLES
+    )
+        return;
+
+    reported_temperature = t;
+    silent_cycles = 0;
+#endif
 
     /*
      * Construct a message. The message contains:
@@ -251,6 +268,37 @@ send_measurement(void)
      *  - the temperature measurement
      *  - the message sequence number
      */
+#if MSG_FORMAT_COMPACT
+    mask =
+        WL_COMPACT_TYPE_BIT(WL_SENSOR_TYPE_TEMPERATURE)
+        |
+        WL_COMPACT_TYPE_BIT(WL_SENSOR_TYPE_COUNTER);
+
+    WL_COMPACT_MSG_STATION_ID(msg) = station_id;
+    WL_COMPACT_MSG_SEQ(msg) = (uint8_t)msg_counter;
+    p = msg + WL_COMPACT_MSG_HDR_LEN;
+
+    if ((msg_counter & (WL_COMPACT_KEYFRAME_INTERVAL - 1)) == 0)
+    {
+        key_temperature = t;
+        p = wl_compact_put_value(p, t);
+    }
+    else
+    {
+        mask |= WL_COMPACT_FLAG_DELTA;
+        p = wl_compact_put_value(p, t - key_temperature);
+    }
+
+    if (do_battery_check)
+    {
+        mask |= WL_COMPACT_TYPE_BIT(WL_SENSOR_TYPE_BATTERY);
+        p = wl_compact_put_value(p, battery);
+    }
+
+    WL_COMPACT_MSG_MASK(msg) = mask;
+
+    tx_message(WL_SYNC_COMPACT | TX_SYNC_FLAGS, msg, p - msg);
+#else
     WL_SENSOR_MSG_STATION_ID(msg) = station_id;
     WL_SENSOR_MSG_TYPE(msg, 0)  = WL_SENSOR_TYPE_TEMPERATURE;
     WL_SENSOR_MSG_VALUE(msg, 0) = t;
@@ -265,7 +313,8 @@ send_measurement(void)
     else
         WL_SENSOR_MSG_NUM_VALUES(msg) = 2;
 
-    tx_message(msg, MSG_SIZE_DS1820);
+    tx_message(WL_SYNC_STANDARD | TX_SYNC_FLAGS, msg, MSG_SIZE_DS1820);
+#endif
 
     if (++msg_counter < 0)
         msg_counter = 0;
@@ -275,18 +324,49 @@ send_measurement(void)
  * Watchdog interrupt handler.
  *
  * Called every 8 seconds. Every 8th time this is called (i.e. every 64 seconds)
- * transmit a temperature measurement.
+ * ask the main loop to transmit a temperature measurement.
+ *
+ * With TX_JITTER, a cycle is a random 7-9 intervals long, and the message is
+ * sent after a further short random interval.
  */
+#if TX_JITTER
+ISR(WDT_vect)
+{
+    uint16_t    r;
+
+    if (jitter_pending)
+    {
+        jitter_pending = 0;
+        wdt_enable(WDTO_8S);
+
+        measure_pending = 1;
+    }
+    else
+    if (++intr_counter >= cycle_intervals)
+    {
+        intr_counter = 0;
+
+        r = jitter_next(&jitter_state);
+        cycle_intervals = JITTER_CYCLE_INTERVALS(r);
+
+        jitter_pending = 1;
+        wdt_enable(pgm_read_byte(&jitter_timeouts[JITTER_OFFSET_INDEX(r)]));
+    }
+
+    sbi(WDTCR, WDIE);
+}
+#else
 ISR(WDT_vect)
 {
     if (++intr_counter == WATCHDOG_INTR_THRESOLD)
     {
-        send_measurement();
+        measure_pending = 1;
         intr_counter = 0;
     }
 
     sbi(WDTCR, WDIE);
 }
+#endif
 static uint8_t mcusr_saved \
     __attribute__ ((section (".noinit")));
 
@@ -314,36 +394,33 @@ main(void)
     /*
      * Setup the GPIO pin connected to the RF transmitter
      */
-    sbi(DDRB, PIN_TX);
-    cbi(PORTB, PIN_TX);
+    tx_init();
 
     /*
      * Read our station ID from the EEPROM
      */
     station_id = eeprom_read_byte(0x00);
 
+#if TX_JITTER
+    jitter_state = jitter_seed(station_id);
+#endif
+
     /*
      * Set up the 1-wire protocol connection to the DS1820
      */
     onewire_init(&DDRB, &PORTB, &PINB, PIN_SENSOR);
 
     /*
-     * Set up the ADC
-     *
-     * ADMUX.REFS[2:0] = 000    => reference is Vcc
-     * ADMUX.MUX[3:0] = 1100    => input is Vbg (1.1v)
-     * ADCSRA.ADEN = 1          => enable ADC
+     * Set up the ADC for battery measurements
      */
-    sbi(ADMUX, MUX3);
-    sbi(ADMUX, MUX2);
-    sbi(ADCSRA, ADEN);
-    sbi(ADCSRA, ADSC);  // start 1st conversion
+    battery_init();
 
     /*
      * Turn off unnecessary features to save power
      */
-    power_adc_disable();
     power_usi_disable();
+    power_timer0_disable();
+    power_timer1_disable();
 
     /*
      * Set the watchdog timer to generate an interrupt after 8s. Bascially
@@ -362,8 +439,20 @@ main(void)
     sleep_enable();
 
     /*
-     * Busy loop where we just put ourselves to sleep
+     * Busy loop where we just put ourselves to sleep. The watchdog wakes us,
+     * and every so often asks for a measurement.
+     *
+     * The measurement starts straight after the watchdog has fired, so it
+     * can't interrupt the (timing-sensitive) 1-wire transfer.
      */
     for (;;)
+    {
         sleep_mode();
+
+        if (measure_pending)
+        {
+            measure_pending = 0;
+            send_measurement();
+        }
+    }
 }
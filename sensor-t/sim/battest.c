@@ -0,0 +1,129 @@
+/*
+ * Check the battery voltage conversion (see battery_lut.h) on the host.
+ *
+ * The generated table is compared with the one it replaced, then readings
+ * for a set of reference voltages are converted, and every possible ADC
+ * reading is checked to give a voltage in range, falling as the reading
+ * rises. The program exits non-zero if any check fails.
+ *
+ * gcc -Wall -O2 -o battest battest.c
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_word(P)    (*(const uint16_t *)(P))
+
+#include "../battery_lut.h"
+
+/**
+ * The hand-written table that ADC_LUT_ENTRY() replaced.
+ */
+static const uint16_t   REFERENCE_LUT[]     =
+{
+    341, 351, 363, 375, 388, 401, 416, 432, 450, 468, 489, 511,
+    535, 562, 592, 625, 661, 703, 750, 803, 865, 937, 1023
+};
+
+/**
+ * Reference battery voltages, and the reading the station should send.
+ */
+static const struct
+{
+    /** battery voltage, mV */
+    uint16_t            mv;
+
+    /** expected result, in tenths of a volt */
+    int16_t             tenths;
+}
+    REFERENCE_VOLTS[]   =
+{
+    { 3600, 34 },       /* above the table: clamped */
+    { 3300, 34 },
+    { 3250, 33 },
+    { 3200, 33 },
+    { 3000, 31 },
+    { 2950, 30 },
+    { 2700, 28 },
+    { 2400, 25 },
+    { 2050, 21 },
+    { 1800, 19 },
+    { 1500, 16 },
+    { 1150, 12 },
+    { 1100, 12 },
+    { 1000, 12 },       /* below 1.1V the ADC saturates */
+};
+
+#define NELEM(A)        (sizeof(A) / sizeof((A)[0]))
+
+/**
+ * The ADC reading for a battery voltage: the bandgap measured against Vcc,
+ * truncated to 10 bits as the ADC does.
+ *
+ *  @param[in]  mv      The battery voltage, in mV.
+ *
+ *  @return     The ADC reading.
+ */
+static uint16_t
+reading_for(uint16_t mv)
+{
+    uint32_t    adc = (uint32_t)ADC_VBG_MV * 1023 / mv;
+
+    return adc > 1023 ? 1023 : (uint16_t)adc;
+}
+
+int
+main(void)
+{
+    int         failures    = 0;
+    int16_t     last        = ADC_LUT_MAX_VOLTS;
+    int16_t     v;
+    unsigned    i;
+
+    if (ADC_LUT_ENTRIES != NELEM(REFERENCE_LUT))
+    {
+        printf("table has %u entries, expected %u\n",
+            (unsigned)ADC_LUT_ENTRIES, (unsigned)NELEM(REFERENCE_LUT));
+        return 1;
+    }
+
+    for (i = 0; i < ADC_LUT_ENTRIES; i++)
+    {
+        if (adc_lut[i] != REFERENCE_LUT[i])
+        {
+            printf("entry %u is %u, expected %u\n", i, adc_lut[i], REFERENCE_LUT[i]);
+            failures++;
+        }
+    }
+
+    for (i = 0; i < NELEM(REFERENCE_VOLTS); i++)
+    {
+        v = adc_to_battery(reading_for(REFERENCE_VOLTS[i].mv));
+
+        if (v != REFERENCE_VOLTS[i].tenths)
+        {
+            printf("%umV (adc %u) gives %d, expected %d\n",
+                REFERENCE_VOLTS[i].mv, reading_for(REFERENCE_VOLTS[i].mv),
+                v, REFERENCE_VOLTS[i].tenths);
+            failures++;
+        }
+    }
+
+    for (i = 0; i <= 1023; i++)
+    {
+        v = adc_to_battery(i);
+
+        if (v > last || v < ADC_LUT_MAX_VOLTS - (int16_t)ADC_LUT_ENTRIES)
+        {
+            printf("adc %u gives %d, after %d\n", i, v, last);
+            failures++;
+        }
+
+        last = v;
+    }
+
+    printf("%s: %d failures\n", failures ? "FAIL" : "ok", failures);
+
+    return failures != 0;
+}
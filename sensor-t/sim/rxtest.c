@@ -0,0 +1,361 @@
+/*
+ * Check the receiver's Manchester decoder (see rpi-receiver/wireless_rx.h)
+ * on the host, for one F_CPU/WL_BAUD pair.
+ *
+ * Frames are built the way sensor-t's transmit.c sends them, turned into
+ * edges on a simulated line, and sampled at the receiver's actual sample
+ * rate. The transmitter's rate is put at each end of the error the
+ * firmware builds allow (WL_BAUD_MAX_ERROR_PPT), and every edge is moved
+ * by up to RXTEST_JITTER of a half-bit (see jitter_t). The program exits
+ * non-zero if any frame isn't decoded, and reports how much jitter the
+ * decoder took before it first lost a frame.
+ *
+ * gcc -Wall -O2 -DF_CPU=10000000UL -DWL_BAUD=4800 -o rxtest rxtest.c
+ */
+
+#define _XOPEN_SOURCE   /* for drand48 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../../include/wireless_timing.h"
+
+/**
+ * The CRC the receiver checks, as <util/crc16.h> defines it on the AVR.
+ */
+static uint8_t
+_crc_ibutton_update(uint8_t crc, uint8_t data)
+{
+    uint8_t     i;
+
+    crc ^= data;
+    for (i = 0; i < 8; i++)
+    {
+        if (crc & 0x01)
+            crc = (crc >> 1) ^ 0x8c;
+        else
+            crc >>= 1;
+    }
+
+    return crc;
+}
+
+#include "../../rpi-receiver/wireless_rx.h"
+
+/**
+ * The edge jitter every frame must survive, as a fraction of a half-bit:
+ * half a sample period. The transmitter's own edges move by a few cycles
+ * of interrupt latency, well under 1/100 of a half-bit even at 19200; the
+ * rest is left for the radio.
+ */
+#define RXTEST_JITTER       (0.5 / WL_RX_SAMPLES_PER_HALF_BIT)
+
+/**
+ * The preamble sent by transmit.c: 32 x 0-bits, followed by 2 x 1-bits.
+ */
+#define TX_PREAMBLE_BITS    34
+
+/**
+ * Random frames sent for each transmitter rate and jitter pattern.
+ */
+#define RXTEST_FRAMES       200
+
+/**
+ * The longest line: preamble, then a whole FEC frame, as half-bits.
+ */
+#define RXTEST_MAX_HALF_BITS    \
+    (2 * (TX_PREAMBLE_BITS + 8 * (1 + 2 * (MSG_MAX_LENGTH + 2))))
+
+typedef enum
+{
+    /** every edge on time */
+    JITTER_NONE = 0,
+
+    /** edges alternately late and early, so half-bits are long and short */
+    JITTER_ALTERNATE,
+
+    /** rising edges early and falling edges late, as an OOK radio does */
+    JITTER_STRETCH,
+
+    /** edges moved at random */
+    JITTER_RANDOM,
+
+    JITTER_PATTERNS
+}
+    jitter_t;
+
+/**
+ * The line levels of one frame, one per half-bit.
+ */
+typedef struct
+{
+    uint8_t             level[RXTEST_MAX_HALF_BITS];
+    int                 n;
+}
+    line_t;
+
+/**
+ * Add a bit to the line, Manchester-coded:
+ *
+ *  0 = 0 -> 1
+ *  1 = 1 -> 0
+ *
+ *  @param[in,out]  line    The line.
+ *  @param[in]      bit     The bit to send.
+ */
+static void
+line_bit(line_t *line, uint8_t bit)
+{
+    line->level[line->n++] = bit;
+    line->level[line->n++] = !bit;
+}
+
+/**
+ * Add a byte to the line, LSB first.
+ *
+ *  @param[in,out]  line    The line.
+ *  @param[in]      byte    The byte to send.
+ */
+static void
+line_byte(line_t *line, uint8_t byte)
+{
+    uint8_t     i;
+
+    for (i = 0; i < 8; i++, byte >>= 1)
+        line_bit(line, byte & 0x01);
+}
+
+/**
+ * Build the line for a frame, as tx_message() sends it.
+ *
+ *  @param[out] line    The line.
+ *  @param[in]  sync    The sync byte (WL_SYNC_*).
+ *  @param[in]  data    The message.
+ *  @param[in]  length  The length of the message.
+ */
+static void
+line_frame(line_t *line, uint8_t sync, const uint8_t *data, uint8_t length)
+{
+    uint8_t     frame[3 + MSG_MAX_LENGTH];
+    uint8_t     crc     = 0;
+    uint8_t     i;
+
+    line->n = 0;
+
+    for (i = 0; i < TX_PREAMBLE_BITS; i++)
+        line_bit(line, i >= TX_PREAMBLE_BITS - 2);
+
+    frame[0] = length;
+    crc = _crc_ibutton_update(crc, length);
+    for (i = 0; i < length; i++)
+    {
+        frame[1 + i] = data[i];
+        crc = _crc_ibutton_update(crc, data[i]);
+    }
+    frame[1 + length] = crc;
+
+    line_byte(line, sync);
+
+    for (i = 0; i < length + 2; i++)
+    {
+        if (sync & WL_SYNC_FLAG_FEC)
+        {
+            line_byte(line, wl_fec_encode(frame[i]));
+            line_byte(line, wl_fec_encode(frame[i] >> 4));
+        }
+        else
+            line_byte(line, frame[i]);
+    }
+}
+
+/**
+ * Feed the decoder some samples of the idle (low) line.
+ *
+ *  @param[in]  n       The number of samples.
+ */
+static void
+rx_idle(int n)
+{
+    while (n-- > 0)
+        wireless_rx_sample(0);
+}
+
+/**
+ * Sample a line with the decoder.
+ *
+ * The transmitter's half-bit edges are at its own rate, each moved by the
+ * jitter; the receiver samples at its actual rate, starting at a random
+ * point in its sample period.
+ *
+ *  @param[in]  line        The line.
+ *  @param[in]  tx_rate     The transmitter's rate, half-bits per second.
+ *  @param[in]  jitter      The jitter pattern.
+ *  @param[in]  amount      The most an edge is moved, in half-bits.
+ */
+static void
+rx_line(const line_t *line, double tx_rate, jitter_t jitter, double amount)
+{
+    double      half_bit    = 1.0 / tx_rate;
+    double      sample      = (WL_RX_TIMER_TOP + 1.0) / F_CPU;
+    double      t           = drand48() * sample;
+    double      edge;
+    int         k;
+
+    /*
+     * Edge k + 1 ends half-bit k
+     */
+    for (k = 0; k < line->n; k++)
+    {
+        edge = (k + 1) * half_bit;
+
+        if (jitter == JITTER_ALTERNATE)
+            edge += (k & 1 ? -amount : amount) * half_bit;
+        else
+        if (jitter == JITTER_STRETCH && k + 1 < line->n)
+            edge += (line->level[k] - line->level[k + 1]) * amount * half_bit;
+        else
+        if (jitter == JITTER_RANDOM)
+            edge += (2 * drand48() - 1) * amount * half_bit;
+
+        for (; t < edge; t += sample)
+            wireless_rx_sample(line->level[k]);
+    }
+}
+
+/**
+ * Check that the decoder has the frame that was sent.
+ *
+ *  @param[in]  sync    The sync byte sent.
+ *  @param[in]  data    The message sent.
+ *  @param[in]  length  The length of the message.
+ *
+ *  @return     1 if the frame was received, 0 if not.
+ */
+static int
+rx_check(uint8_t sync, const uint8_t *data, uint8_t length)
+{
+    uint8_t     crc;
+    uint8_t     i;
+
+    if (!msg_pending || msg_sync != sync || msg_length != length)
+        return 0;
+
+    if (!(sync & WL_SYNC_FLAG_FEC))
+        return memcmp(msg_buffer, data, length) == 0;
+
+    /*
+     * FEC frames are kept as codewords, message then CRC, for the main
+     * loop to decode.
+     */
+    crc = _crc_ibutton_update(0, length);
+    for (i = 0; i <= length; i++)
+    {
+        uint8_t     byte    = i < length ? data[i] : crc;
+
+        if
+        (
+            (uint8_t)fec_buffer[2 * i] != wl_fec_encode(byte)
+            ||
+            (uint8_t)fec_buffer[2 * i + 1] != wl_fec_encode(byte >> 4)
+        )
+            return 0;
+
+        crc = _crc_ibutton_update(crc, byte);
+    }
+
+    return 1;
+}
+
+/**
+ * Send random frames, standard and FEC-coded, with the transmitter at each
+ * end of its allowed rate error.
+ *
+ *  @param[in]  jitter      The jitter pattern.
+ *  @param[in]  amount      The most an edge is moved, in half-bits.
+ *
+ *  @return     the number of frames lost.
+ */
+static int
+rx_run(jitter_t jitter, double amount)
+{
+    static line_t   line;
+    static const int    error_ppt[] = { -WL_BAUD_MAX_ERROR_PPT, WL_BAUD_MAX_ERROR_PPT };
+    uint8_t         data[MSG_MAX_LENGTH];
+    uint8_t         length;
+    uint8_t         sync;
+    double          tx_rate;
+    int             lost    = 0;
+    int             e;
+    int             n;
+    int             i;
+
+    for (e = 0; e < 2; e++)
+    {
+        tx_rate = WL_BAUD * (1000.0 + error_ppt[e]) / 1000;
+
+        for (n = 0; n < RXTEST_FRAMES; n++)
+        {
+            sync = n & 1 ? WL_SYNC_STANDARD | WL_SYNC_FLAG_FEC : WL_SYNC_STANDARD;
+            length = 1 + lrand48() % MSG_MAX_LENGTH;
+            for (i = 0; i < length; i++)
+                data[i] = lrand48();
+
+            line_frame(&line, sync, data, length);
+
+            msg_pending = 0;
+            rx_idle(8 * WL_RX_SAMPLES_PER_HALF_BIT);
+            rx_line(&line, tx_rate, jitter, amount);
+            rx_idle(8 * WL_RX_SAMPLES_PER_HALF_BIT);
+
+            if (!rx_check(sync, data, length))
+                lost++;
+        }
+    }
+
+    return lost;
+}
+
+int
+main(void)
+{
+    static const char   *names[]    = { "none", "alternate", "stretch", "random" };
+    double      amount;
+    int         failed  = 0;
+    int         lost;
+    jitter_t    j;
+
+    srand48(1);
+
+    printf("rx %lu Hz %u baud: %lu samples/s, jitter %.3f half-bit\n",
+        (unsigned long)F_CPU, WL_BAUD,
+        (unsigned long)(F_CPU / (WL_RX_TIMER_TOP + 1)), RXTEST_JITTER);
+
+    for (j = JITTER_NONE; j < JITTER_PATTERNS; j++)
+    {
+        amount = j == JITTER_NONE ? 0 : RXTEST_JITTER;
+        lost = rx_run(j, amount);
+        failed |= lost != 0;
+
+        printf("  %-9s  %d/%d frames lost", names[j], lost, 2 * RXTEST_FRAMES);
+
+        if (j != JITTER_NONE)
+        {
+            /*
+             * Find the margin: the jitter at which a frame is first lost
+             */
+            while (lost == 0 && amount < 0.5)
+            {
+                amount += 1.0 / 64;
+                lost = rx_run(j, amount);
+            }
+
+            printf(", first loss at %.3f half-bit", amount);
+        }
+
+        printf("\n");
+    }
+
+    return failed;
+}
@@ -0,0 +1,78 @@
+/*
+ * Check the line timing in wireless_timing.h for one F_CPU/WL_BAUD pair.
+ *
+ * The Makefile builds this once for each pair the firmwares support (and
+ * for the receiver, each pair it must reject), with -DF_CPU and -DWL_BAUD.
+ * "tx" checks the transmitter's timer settings, and "rx" the receiver's,
+ * against the limits the firmware builds enforce with #error. The program
+ * exits non-zero if the settings fail them.
+ *
+ * gcc -Wall -O2 -DF_CPU=3686400UL -DWL_BAUD=4800 -o timingtest timingtest.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../../include/wireless_timing.h"
+
+/**
+ * Check the transmitter's Timer0 settings.
+ *
+ *  @return     0 if they are within the limits, 1 if not.
+ */
+static int
+check_tx(void)
+{
+#if WL_TX_PRESCALE != 0
+    unsigned long   actual  = WL_TX_BAUD_ACTUAL;
+    unsigned long   error   = WL_BAUD_ERROR_PPT(actual);
+
+    printf("tx %lu Hz %u baud: prescale %u top %lu actual %lu error %lu/1000\n",
+        (unsigned long)F_CPU, WL_BAUD, WL_TX_PRESCALE,
+        (unsigned long)WL_TX_TIMER_TOP, actual, error);
+
+    return WL_TX_TIMER_TOP > 0xff || error > WL_BAUD_MAX_ERROR_PPT;
+#else
+    printf("tx %lu Hz %u baud: no prescaler fits\n", (unsigned long)F_CPU, WL_BAUD);
+
+    return 1;
+#endif
+}
+
+/**
+ * Check the receiver's Timer1 settings, and that the sampling interrupt
+ * has time to run.
+ *
+ *  @return     0 if they are within the limits, 1 if not.
+ */
+static int
+check_rx(void)
+{
+    unsigned long   actual  = WL_RX_BAUD_ACTUAL;
+    unsigned long   error   = WL_BAUD_ERROR_PPT(actual);
+
+    printf("rx %lu Hz %u baud: top %lu actual %lu error %lu/1000, %lu cycles per sample\n",
+        (unsigned long)F_CPU, WL_BAUD, (unsigned long)WL_RX_TIMER_TOP,
+        actual, error, (unsigned long)WL_RX_TIMER_TOP + 1);
+
+    return
+        WL_RX_TIMER_TOP > 0xffff
+        ||
+        error > WL_BAUD_MAX_ERROR_PPT
+        ||
+        WL_RX_TIMER_TOP + 1 < WL_RX_ISR_CYCLES;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc == 2 && strcmp(argv[1], "tx") == 0)
+        return check_tx();
+
+    if (argc == 2 && strcmp(argv[1], "rx") == 0)
+        return check_rx();
+
+    fprintf(stderr, "Usage: %s tx|rx\n", argv[0]);
+
+    return 2;
+}
@@ -0,0 +1,290 @@
+/*
+ * Simulate RF frame collisions across a network of sensor-t stations.
+ *
+ * Each station transmits once per cycle, timed by its own watchdog
+ * oscillator, which runs a little fast or slow. Any two frames that overlap
+ * on air are both lost (the receiver has no way to recover either). We run
+ * the same network with a fixed 64 second cycle and with the per-station
+ * jitter from jitter.h, and report the fraction of frames delivered, plus
+ * the longest run of consecutive frames any one station lost.
+ *
+ * gcc -Wall -O2 -o txsim txsim.c
+ */
+
+#define _XOPEN_SOURCE   /* for drand48 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../include/wireless.h"
+#include "../../include/wireless_timing.h"
+#include "../jitter.h"
+
+/**
+ * Nominal watchdog jitter timeouts in seconds (see JITTER_OFFSET_INDEX).
+ */
+static const double     JITTER_OFFSETS[]    =
+    { 0.016, 0.032, 0.064, 0.125, 0.25, 0.5, 1.0, 2.0 };
+
+typedef struct frame_t  frame_t;
+
+/**
+ * A single transmission.
+ */
+struct frame_t
+{
+    /** start time, seconds */
+    double              start;
+
+    /** station ID */
+    uint8_t             station;
+};
+
+/**
+ * Simulation parameters.
+ */
+typedef struct
+{
+    /** simulated time, seconds */
+    double              duration;
+
+    /** frame time on air, seconds */
+    double              airtime;
+
+    /** maximum watchdog oscillator error, as a fraction */
+    double              spread;
+
+    /** if true, all stations power up together */
+    int                 in_phase;
+}
+    params_t;
+
+/**
+ * Results of a single simulation run.
+ */
+typedef struct
+{
+    long                frames;
+    long                delivered;
+    int                 worst_run;
+}
+    result_t;
+
+static int
+frame_cmp(const void *a, const void *b)
+{
+    double  d = ((const frame_t *)a)->start - ((const frame_t *)b)->start;
+
+    return d < 0 ? -1 : d > 0 ? 1 : 0;
+}
+
+/**
+ * Work out how long a frame is on air.
+ *
+ * @param[in]   payload     The message length in bytes.
+ * @param[in]   baud        The line rate (Manchester half-bits per second).
+ *
+ * @return      The frame duration in seconds.
+ */
+static double
+frame_airtime(int payload, int baud)
+{
+    /* preamble, then sync + length + payload + CRC; 2 half-bits per bit */
+    int     bits    = 34 + 8 * (3 + payload);
+
+    return 2.0 * bits / baud;
+}
+
+/**
+ * Simulate one network configuration.
+ *
+ * @param[in]   n_stations  The number of stations.
+ * @param[in]   jitter      Non-zero to use per-station jitter.
+ * @param[in]   p           The simulation parameters.
+ * @param[in]   seed        Seed for the station clocks and start times.
+ * @param[out]  result      The simulation result.
+ *
+ * @return      zero for success, non-zero otherwise.
+ */
+static int
+simulate(int n_stations, int jitter, const params_t *p, long seed, result_t *result)
+{
+    frame_t     *frames;
+    long        max_frames;
+    long        n_frames    = 0;
+    double      max_end;
+    int         run[256];
+    long        i;
+    int         s;
+
+    max_frames = (long)(p->duration / (8 * 7 * (1 - p->spread)) + 2) * n_stations;
+    if ((frames = malloc(max_frames * sizeof(frame_t))) == NULL)
+        return 1;
+
+    srand48(seed);
+
+    for (s = 1; s <= n_stations; s++)
+    {
+        double      rate    = 1 + p->spread * (2 * drand48() - 1);
+        double      t       = p->in_phase ? 0 : 64 * drand48();
+        uint16_t    state   = jitter_seed(s);
+        uint16_t    r;
+
+        while (t < p->duration && n_frames < max_frames)
+        {
+            frames[n_frames].start = t;
+            frames[n_frames].station = s;
+            n_frames++;
+
+            if (jitter)
+            {
+                r = jitter_next(&state);
+                t += rate * (8 * JITTER_CYCLE_INTERVALS(r) + JITTER_OFFSETS[JITTER_OFFSET_INDEX(r)]);
+            }
+            else
+                t += rate * 64;
+        }
+    }
+
+    qsort(frames, n_frames, sizeof(frame_t), frame_cmp);
+
+    memset(run, 0, sizeof(run));
+    memset(result, 0, sizeof(*result));
+
+    max_end = -1;
+    for (i = 0; i < n_frames; i++)
+    {
+        double  end     = frames[i].start + p->airtime;
+        int     lost;
+
+        lost =
+            frames[i].start < max_end
+            ||
+            (i + 1 < n_frames && frames[i + 1].start < end);
+
+        if (end > max_end)
+            max_end = end;
+
+        result->frames++;
+        if (lost)
+        {
+            if (++run[frames[i].station] > result->worst_run)
+                result->worst_run = run[frames[i].station];
+        }
+        else
+        {
+            result->delivered++;
+            run[frames[i].station] = 0;
+        }
+    }
+
+    free(frames);
+
+    return 0;
+}
+
+static void
+usage(const char *prog)
+{
+    printf("Usage: %s [-h hours] [-b baud] [-l length] [-s spread] [-r seed] [-p] [stations ...]\n", prog);
+    printf("\t-h\tSimulated time in hours (default 24)\n");
+    printf("\t-b\tLine rate in baud (default %d)\n", WL_BAUD);
+    printf("\t-l\tMessage length in bytes (default %d, a compact DS1820 message)\n",
+        WL_COMPACT_MSG_HDR_LEN + 2);
+    printf("\t-s\tWatchdog oscillator spread in %% (default 5)\n");
+    printf("\t-r\tRandom seed (default 1)\n");
+    printf("\t-p\tAll stations power up at the same time\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    params_t    params;
+    int         baud        = WL_BAUD;
+    int         length      = WL_COMPACT_MSG_HDR_LEN + 2;
+    long        seed        = 1;
+    int         default_stations[]  = { 10, 50, 200 };
+    int         opt;
+    int         i;
+
+    params.duration = 24 * 3600;
+    params.spread = 0.05;
+    params.in_phase = 0;
+
+    while ((opt = getopt(argc, argv, "h:b:l:s:r:p")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            params.duration = atof(optarg) * 3600;
+            break;
+        case 'b':
+            baud = atoi(optarg);
+            break;
+        case 'l':
+            length = atoi(optarg);
+            break;
+        case 's':
+            params.spread = atof(optarg) / 100;
+            break;
+        case 'r':
+            seed = atol(optarg);
+            break;
+        case 'p':
+            params.in_phase = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (baud <= 0 || length <= 0 || params.duration <= 0
+        || params.spread < 0 || params.spread >= 0.5)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    params.airtime = frame_airtime(length, baud);
+
+    printf("%.1f hours, %d baud, %.1f ms frames, +/-%.1f%% clock spread%s\n\n",
+        params.duration / 3600, baud, params.airtime * 1000, params.spread * 100,
+        params.in_phase ? ", powered up in phase" : "");
+
+    printf("                     fixed cycle        jittered cycle\n");
+    printf("stations   frames    delivered  run     delivered  run\n");
+
+    for (i = optind; i < argc || (optind == argc && i < optind + 3); i++)
+    {
+        int         n_stations;
+        result_t    fixed;
+        result_t    jittered;
+
+        n_stations = optind == argc ? default_stations[i - optind] : atoi(argv[i]);
+        if (n_stations < 1 || n_stations > 254)
+        {
+            fprintf(stderr, "%s: station count must be 1-254\n", argv[0]);
+            return 1;
+        }
+
+        if (simulate(n_stations, 0, &params, seed, &fixed) != 0
+            || simulate(n_stations, 1, &params, seed, &jittered) != 0)
+        {
+            fprintf(stderr, "%s: out of memory\n", argv[0]);
+            return 1;
+        }
+
+        printf("%8d %8ld    %8.2f%% %4d     %8.2f%% %4d\n",
+            n_stations, fixed.frames,
+            100.0 * fixed.delivered / fixed.frames, fixed.worst_run,
+            100.0 * jittered.delivered / jittered.frames, jittered.worst_run);
+    }
+
+    printf("\n(run = the longest run of consecutive frames lost by any one station)\n");
+
+    return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * Manchester-coded RF transmitter
+ *
+ * Frames are sent from the Timer0 compare interrupt, one half-bit per
+ * interrupt, while the core sleeps in idle mode between edges. The timer
+ * period comes from F_CPU and WL_BAUD at compile time.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/power.h>
+#include <avr/sleep.h>
+#include <util/crc16.h>
+#include MCU_H
+
+#include "avr-common.h"
+
+#include "../include/wireless.h"
+#include "../include/wireless_timing.h"
+#include "../include/wireless_fec.h"
+#include "transmit.h"
+
+/*
+ * Timer0 runs in CTC mode and interrupts once per half-bit. The period
+ * comes from WL_BAUD and F_CPU (see wireless_timing.h).
+ */
+#if WL_TX_PRESCALE == 1
+#define TX_CLOCK_SELECT     (1 << CS00)
+#elif WL_TX_PRESCALE == 8
+#define TX_CLOCK_SELECT     (1 << CS01)
+#elif WL_TX_PRESCALE == 64
+#define TX_CLOCK_SELECT     ((1 << CS01) | (1 << CS00))
+#else
+#error "F_CPU is too fast to generate WL_BAUD with Timer0"
+#endif
+
+#if WL_BAUD_ERROR_PPT(WL_TX_BAUD_ACTUAL) > WL_BAUD_MAX_ERROR_PPT
+#error "WL_BAUD can't be generated accurately enough from F_CPU"
+#endif
+
+/**
+ * The preamble is 32 x 0-bits, followed by 2 x 1-bits
+ */
+#define TX_PREAMBLE_BITS    34
+
+/**
+ * The largest frame: sync byte, length, message and CRC. With FEC, the
+ * bytes after the sync byte are encoded as they are sent, so the buffer
+ * doesn't need to hold the codewords.
+ */
+#define TX_FRAME_MAX_SIZE   (3 + WL_FRAME_MSG_MAX_SIZE)
+
+/*
+ * Transmitter state, shared with the interrupt handler
+ */
+static volatile uint8_t     tx_frame[TX_FRAME_MAX_SIZE];
+static volatile uint8_t     tx_frame_len;
+static volatile uint8_t     tx_index;
+static volatile uint8_t     tx_byte;
+static volatile uint8_t     tx_bits;
+static volatile uint8_t     tx_preamble;
+static volatile uint8_t     tx_level;
+static volatile uint8_t     tx_second_half;
+static volatile uint8_t     tx_stop;
+static volatile uint8_t     tx_busy;
+static volatile uint8_t     tx_fec;
+static volatile uint8_t     tx_high_nibble;
+
+/**
+ * Timer0 compare interrupt handler.
+ *
+ * Called at the start of each half-bit. The output level is set first, from
+ * the value worked out on the previous call, so that every edge has the
+ * same interrupt latency. Then the level for the next half-bit is worked
+ * out:
+ *
+ *  0 = 0 -> 1
+ *  1 = 1 -> 0
+ */
+ISR(TIM0_COMPA_vect)
+{
+    uint8_t     bit;
+
+    if (tx_level)
+        sbi(PORTB, TX_PIN);
+    else
+        cbi(PORTB, TX_PIN);
+
+    if (tx_stop)
+    {
+        /*
+         * The last half-bit has finished; stop the timer.
+         */
+        TCCR0B = 0;
+        cbi(TIMSK, OCIE0A);
+        tx_busy = 0;
+        return;
+    }
+
+    if (tx_second_half)
+    {
+        /*
+         * The second half of a bit is the inverse of the first
+         */
+        tx_level ^= 1;
+        tx_second_half = 0;
+        return;
+    }
+
+    /*
+     * Start the next bit: first the preamble, then the frame bytes,
+     * LSB first.
+     */
+    if (tx_preamble)
+    {
+        bit = --tx_preamble < 2;
+    }
+    else
+    {
+        if (tx_bits == 0)
+        {
+            if (tx_index == tx_frame_len)
+            {
+                tx_level = 0;
+                tx_stop = 1;
+                return;
+            }
+
+            if (tx_fec && tx_index != 0)
+            {
+                /*
+                 * Send each byte after the sync byte as two codewords,
+                 * low nibble first
+                 */
+                if (tx_high_nibble)
+                    tx_byte = wl_fec_encode(tx_frame[tx_index++] >> 4);
+                else
+                    tx_byte = wl_fec_encode(tx_frame[tx_index]);
+
+                tx_high_nibble ^= 1;
+            }
+            else
+                tx_byte = tx_frame[tx_index++];
+
+            tx_bits = 8;
+        }
+
+        bit = tx_byte & 0x01;
+        tx_byte >>= 1;
+        tx_bits--;
+    }
+
+    tx_level = bit;
+    tx_second_half = 1;
+}
+
+/**
+ * Set up the transmitter pin. The transmitter is left idle (low).
+ */
+void
+tx_init(void)
+{
+    sbi(DDRB, TX_PIN);
+    cbi(PORTB, TX_PIN);
+}
+
+/**
+ * Transmit a message to the receiver, and return when it has been sent.
+ *
+ * A message consists of:
+ *  - preamble to allow the receiver to lock on to the signal
+ *  - sync byte marking the start of the message (and its encoding)
+ *  - message length
+ *  - message data
+ *  - a CRC of (message length + data)
+ *
+ * If the sync byte has WL_SYNC_FLAG_FEC set, everything after the sync byte
+ * is sent FEC-coded.
+ *
+ * The core sleeps in idle mode while the frame is sent, and is returned to
+ * power-down mode afterwards.
+ *
+ *  @param[in]  sync    The sync byte (WL_SYNC_*).
+ *  @param[in]  data    The data to transmit.
+ *  @param[in]  length  The length of the message payload.
+ */
+void
+tx_message(uint8_t sync, const uint8_t *data, uint8_t length)
+{
+    uint8_t     crc = 0;
+    uint8_t     i;
+
+    if (length > WL_FRAME_MSG_MAX_SIZE)
+        return;
+
+    /*
+     * Build the frame
+     */
+    tx_frame[0] = sync;
+    tx_frame[1] = length;
+    crc = _crc_ibutton_update(crc, length);
+
+    for (i = 0; i < length; i++)
+    {
+        tx_frame[2 + i] = data[i];
+        crc = _crc_ibutton_update(crc, data[i]);
+    }
+
+    tx_frame[2 + length] = crc;
+    tx_frame_len = 3 + length;
+
+    tx_index = 0;
+    tx_bits = 0;
+    tx_preamble = TX_PREAMBLE_BITS;
+    tx_level = 0;
+    tx_second_half = 0;
+    tx_stop = 0;
+    tx_fec = sync & WL_SYNC_FLAG_FEC;
+    tx_high_nibble = 0;
+    tx_busy = 1;
+
+    sbi(DDRB, TX_PIN);
+    cbi(PORTB, TX_PIN);
+
+    /*
+     * Start Timer0 in CTC mode, interrupting every half-bit
+     */
+    power_timer0_enable();
+    TCCR0A = (1 << WGM01);
+    TCNT0 = 0;
+    OCR0A = WL_TX_TIMER_TOP;
+    TIFR = (1 << OCF0A);
+    sbi(TIMSK, OCIE0A);
+    TCCR0B = TX_CLOCK_SELECT;
+
+    /*
+     * Sleep until the frame has gone. Interrupts are re-enabled by the
+     * instruction before sleep, so a wakeup can't be missed.
+     */
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    cli();
+    while (tx_busy)
+    {
+        sei();
+        sleep_cpu();
+        cli();
+    }
+    sei();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+
+    power_timer0_disable();
+
+    cbi(DDRB, TX_PIN);
+    cbi(PORTB, TX_PIN);
+}
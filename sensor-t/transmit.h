@@ -0,0 +1,14 @@
+#ifndef __TRANSMIT_H__
+#define __TRANSMIT_H__
+
+#include <stdint.h>
+
+/*
+ * The GPIO pin (on PORTB) connected to the RF transmitter
+ */
+#define TX_PIN      PB1
+
+extern void             tx_init(void);
+extern void             tx_message(uint8_t sync, const uint8_t *data, uint8_t length);
+
+#endif /* __TRANSMIT_H__ */